@@ -0,0 +1,107 @@
+#include "bench.hpp"
+
+#include "instances.hpp"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <random>
+
+namespace {
+	std::atomic<size_t> allocations = 0;
+}
+
+void* operator new(size_t size) {
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	if (void* p = std::malloc(size ? size : 1)) {
+		return p;
+	}
+	throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+	std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+	std::free(p);
+}
+
+size_t allocationCount() {
+	return allocations.load(std::memory_order_relaxed);
+}
+
+void BenchReport::add(BenchResult result) {
+	fprintf(stderr, "%s side_edges=%d threads=%d: %zu items in %.3f ms\n",
+		result.benchmark.c_str(), result.side_edges, result.threads, result.items, result.seconds * 1e3);
+	results.push_back(std::move(result));
+}
+
+void BenchReport::fail(const std::string& message) {
+	fprintf(stderr, "CHECK FAILED: %s\n", message.c_str());
+	failed_checks = true;
+}
+
+void BenchReport::print(const std::string& format) const {
+	if (format == "json") {
+		printf("[\n");
+		for (size_t i = 0; i < results.size(); i++) {
+			auto& r = results[i];
+			printf("  {\"benchmark\": \"%s\", \"side_edges\": %d, \"threads\": %d, \"items\": %zu, \"seconds\": %.9f, \"ns_per_item\": %.3f}%s\n",
+				r.benchmark.c_str(), r.side_edges, r.threads, r.items, r.seconds,
+				r.items ? r.seconds * 1e9 / r.items : 0.0, i + 1 < results.size() ? "," : "");
+		}
+		printf("]\n");
+		return;
+	}
+	printf("benchmark,side_edges,threads,items,seconds,ns_per_item\n");
+	for (auto& r : results) {
+		printf("%s,%d,%d,%zu,%.9f,%.3f\n", r.benchmark.c_str(), r.side_edges, r.threads, r.items, r.seconds,
+			r.items ? r.seconds * 1e9 / r.items : 0.0);
+	}
+}
+
+std::vector<Vector2> randomMazePoints(int side_edges, size_t count, int seed) {
+	float step = BENCH_LENGTH + BENCH_WIDTH * sqrtf(3);
+	std::mt19937 gen(seed);
+	std::uniform_real_distribution<float> xs(0, 3 * side_edges * step);
+	std::uniform_real_distribution<float> ys(0, 2 * side_edges * step * sqrtf(3) / 2);
+	std::vector<Vector2> res(count);
+	for (auto& p : res) {
+		p = {xs(gen), ys(gen)};
+	}
+	return res;
+}
+
+MazeInstances mazeInstances(const Maze& maze, const MazeMeshes& meshes) {
+	MazeInstances res;
+	res.cuboids = maze.transformations_cuboid.size();
+	res.hexprisms = maze.transformations_hexprism.size();
+	res.floors = maze.transformations_floor.size();
+	res.matrices.resize(res.cuboids + res.hexprisms + res.floors);
+	std::span<InstanceMatrix> matrices = res.matrices;
+	storeCuboidMatrices(maze.transformations_cuboid, matrices.data());
+	storeTranslationMatrices(maze.transformations_hexprism, matrices.data() + res.cuboids);
+	storeTranslationMatrices(maze.transformations_floor, matrices.data() + res.cuboids + res.hexprisms);
+	res.bounds.resize(matrices.size());
+	res.bounds.set(0, meshBounds(meshes.cuboid), matrices.subspan(0, res.cuboids));
+	res.bounds.set(res.cuboids, meshBounds(meshes.hexprism), matrices.subspan(res.cuboids, res.hexprisms));
+	res.bounds.set(res.cuboids + res.hexprisms, meshBounds(meshes.floor), matrices.subspan(res.cuboids + res.hexprisms));
+	return res;
+}
+
+CollisionWorld mazeCollisionWorld(std::span<const CuboidTransformation> walls, std::span<const TranslationTransformation> pillars,
+	bool indexed) {
+	CollisionWorld world;
+	for (auto& t : walls) {
+		world.addRectangle(t, BENCH_LENGTH, BENCH_WIDTH);
+	}
+	for (auto& t : pillars) {
+		world.addCircle(t.translation, BENCH_WIDTH);
+	}
+	if (indexed) {
+		world.buildIndex(BENCH_LENGTH, BENCH_WIDTH);
+	}
+	return world;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "base.hpp"
+#include "collisionworld.hpp"
+#include "culling.hpp"
+#include "maze.hpp"
+#include "mazemesh.hpp"
+#include <chrono>
+#include <span>
+#include <string>
+#include <vector>
+
+// Same maze dimensions as initTriangleAndInstanceData.
+constexpr float BENCH_LENGTH = 2;
+constexpr float BENCH_WIDTH = .2;
+constexpr float BENCH_HEIGHT = .5;
+
+struct BenchOptions {
+	std::vector<int> sizes = {30, 100, 300, 1000};
+	std::vector<int> threads = {1, 2, 4, 8};
+	int seed = 1;
+	// Time budget for benchmarks that repeat a query.
+	double min_time = 0.2;
+	std::string format = "csv";
+	std::vector<std::string> only;
+};
+
+struct BenchResult {
+	std::string benchmark;
+	int side_edges;
+	int threads;
+	size_t items;
+	double seconds;
+};
+
+class BenchReport {
+	std::vector<BenchResult> results;
+	bool failed_checks = false;
+public:
+	void add(BenchResult result);
+	// Logs a failed sanity check, maze_bench then exits with an error.
+	void fail(const std::string& message);
+	bool failed() const { return failed_checks; }
+	void print(const std::string& format) const;
+};
+
+// Number of operator new calls so far, maze_bench replaces the global allocator to count them.
+size_t allocationCount();
+
+using bench_clock = std::chrono::steady_clock;
+
+inline double secondsSince(bench_clock::time_point start) {
+	return std::chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+// Calls f(i) for i = 0, 1, ... until max_items calls or min_time seconds, returns the number of calls.
+template<typename F>
+size_t timedLoop(size_t max_items, double min_time, double& seconds, F f) {
+	auto start = bench_clock::now();
+	size_t i = 0;
+	while (i < max_items) {
+		f(i++);
+		if (i % 64 == 0 && secondsSince(start) >= min_time) {
+			break;
+		}
+	}
+	seconds = secondsSince(start);
+	return i;
+}
+
+// Uniformly distributed points over the bounding box of a side_edges maze.
+std::vector<Vector2> randomMazePoints(int side_edges, size_t count, int seed);
+
+// Walls, pillars and floors of a maze in one array, in that order as in the
+// instance buffer, with the bounds of every instance.
+struct MazeInstances {
+	std::vector<InstanceMatrix> matrices;
+	InstanceBounds bounds;
+	size_t cuboids = 0;
+	size_t hexprisms = 0;
+	size_t floors = 0;
+};
+
+MazeInstances mazeInstances(const Maze& maze, const MazeMeshes& meshes);
+
+// Walls and pillars of a maze as a collision world, indexed unless indexed is false.
+CollisionWorld mazeCollisionWorld(std::span<const CuboidTransformation> walls, std::span<const TranslationTransformation> pillars,
+	bool indexed = true);
@@ -0,0 +1,1683 @@
+#include "bench.hpp"
+#include "collisionkernels.hpp"
+#include "culling.hpp"
+#include "indexedmesh.hpp"
+#include "instances.hpp"
+#include "maze.hpp"
+#include "mazeagents.hpp"
+#include "mazebvh.hpp"
+#include "mazechunks.hpp"
+#include "mazefile.hpp"
+#include "mazegrid.hpp"
+#include "mazenav.hpp"
+#include "mazephysics.hpp"
+#include "mazeportals.hpp"
+#include "mazepvs.hpp"
+#include "objectpool.hpp"
+#include "occlusion.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <sstream>
+
+// Headless benchmarks of the maze and physics core.
+// Usage: maze_bench [--sizes 30,100,...] [--threads 1,2,...] [--seed N]
+//                   [--time seconds] [--format csv|json] [--only name,...]
+
+namespace {
+	// Also checks that getMaze makes the same number of allocations for every size.
+	void benchGenerate(const BenchOptions& options, BenchReport& report) {
+		size_t expected_allocations = 0;
+		for (int side_edges : options.sizes) {
+			size_t allocations_before = allocationCount();
+			auto start = bench_clock::now();
+			Maze maze = getMaze(BENCH_LENGTH, BENCH_WIDTH, BENCH_HEIGHT, side_edges, options.seed);
+			double seconds = secondsSince(start);
+			size_t allocations = allocationCount() - allocations_before;
+			report.add({"generate", side_edges, 1, maze.transformations_hexprism.size(), seconds});
+			fprintf(stderr, "  %zu allocations\n", allocations);
+			if (expected_allocations == 0) {
+				expected_allocations = allocations;
+			}
+			else if (allocations != expected_allocations) {
+				report.fail("getMaze made " + std::to_string(allocations) + " allocations, expected " + std::to_string(expected_allocations));
+			}
+		}
+	}
+
+	void benchGenerateParallel(const BenchOptions& options, BenchReport& report) {
+		for (int side_edges : options.sizes) {
+			for (int threads : options.threads) {
+				auto start = bench_clock::now();
+				Maze maze = getMazeParallel(BENCH_LENGTH, BENCH_WIDTH, BENCH_HEIGHT, side_edges, options.seed, threads);
+				report.add({"generate_parallel", side_edges, threads, maze.transformations_hexprism.size(), secondsSince(start)});
+			}
+		}
+	}
+
+	void benchGenerateEller(const BenchOptions& options, BenchReport& report) {
+		for (int side_edges : options.sizes) {
+			auto start = bench_clock::now();
+			Maze maze = generateMaze(MazeGenerator::Eller, BENCH_LENGTH, BENCH_WIDTH, BENCH_HEIGHT, side_edges, options.seed);
+			report.add({"generate_eller", side_edges, 1, maze.transformations_hexprism.size(), secondsSince(start)});
+		}
+	}
+
+	void benchInstanceMatrices(const BenchOptions& options, BenchReport& report) {
+		for (int side_edges : options.sizes) {
+			Maze maze = getMaze(BENCH_LENGTH, BENCH_WIDTH, BENCH_HEIGHT, side_edges, options.seed);
+			size_t cuboids = maze.transformations_cuboid.size();
+			size_t hexprisms = maze.transformations_hexprism.size();
+			size_t total = cuboids + hexprisms + maze.transformations_floor.size();
+			std::vector<InstanceMatrix> matrices(total);
+
+			auto start = bench_clock::now();
+			storeCuboidMatrices(maze.transformations_cuboid, matrices.data());
+			storeTranslationMatrices(maze.transformations_hexprism, matrices.data() + cuboids);
+			storeTranslationMatrices(maze.transformations_floor, matrices.data() + cuboids + hexprisms);
+			report.add({"instance_matrices", side_edges, 1, total, secondsSince(start)});
+		}
+	}
+
+	// Linear scan and hex-grid index over the same objects, which must agree on every query.
+	void benchCollidesWith(const BenchOptions& options, BenchReport& report) {
+		for (int side_edges : options.sizes) {
+			Maze maze = getMaze(BENCH_LENGTH, BENCH_WIDTH, BENCH_HEIGHT, side_edges, options.seed);
+			std::vector<RectangleObj> walls;
+			std::vector<HexObj> pillars;
+			std::vector<Object*> objects;
+			ObjectHandler handler, indexed;
+			for (auto& t : maze.transformations_cuboid) {
+				walls.emplace_back(t, BENCH_LENGTH, BENCH_WIDTH);
+			}
+			for (auto& t : maze.transformations_hexprism) {
+				pillars.emplace_back(t, BENCH_WIDTH);
+			}
+			for (auto& w : walls) {
+				objects.push_back(&w);
+			}
+			for (auto& p : pillars) {
+				objects.push_back(&p);
+			}
+			for (Object* o : objects) {
+				handler.addObject(o);
+				indexed.addObject(o);
+			}
+			auto start = bench_clock::now();
+			indexed.buildIndex(BENCH_LENGTH, BENCH_WIDTH);
+			report.add({"collides_with_index_build", side_edges, 1, objects.size(), secondsSince(start)});
+
+			auto points = randomMazePoints(side_edges, 1 << 16, options.seed);
+			std::vector<uint8_t> expected(points.size());
+			double seconds;
+			size_t queries = timedLoop(points.size(), options.min_time, seconds, [&](size_t i) {
+				expected[i] = handler.collidesWith(HexObj({points[i]}, 0.1));
+			});
+			report.add({"collides_with", side_edges, 1, queries, seconds});
+
+			size_t mismatches = 0;
+			size_t indexed_queries = timedLoop(points.size(), options.min_time, seconds, [&](size_t i) {
+				bool hit = indexed.collidesWith(HexObj({points[i]}, 0.1));
+				mismatches += i < queries && hit != bool(expected[i]);
+			});
+			report.add({"collides_with_indexed", side_edges, 1, indexed_queries, seconds});
+
+			// Same queries against the SoA world, without and with its index.
+			CollisionWorld world = mazeCollisionWorld(maze.transformations_cuboid, maze.transformations_hexprism, false);
+			size_t world_queries = timedLoop(points.size(), options.min_time, seconds, [&](size_t i) {
+				bool hit = world.collidesWithCircle(points[i], 0.1f);
+				mismatches += i < queries && hit != bool(expected[i]);
+			});
+			report.add({"collides_with_world_scan", side_edges, 1, world_queries, seconds});
+			world.buildIndex(BENCH_LENGTH, BENCH_WIDTH);
+			world_queries = timedLoop(points.size(), options.min_time, seconds, [&](size_t i) {
+				bool hit = world.collidesWithCircle(points[i], 0.1f);
+				mismatches += i < queries && hit != bool(expected[i]);
+			});
+			report.add({"collides_with_world", side_edges, 1, world_queries, seconds});
+
+			// Half the walls and all pillars added after the index was built,
+			// queries have to scan those.
+			CollisionWorld partial;
+			const size_t indexed_walls = maze.transformations_cuboid.size() / 2;
+			for (size_t i = 0; i < indexed_walls; i++) {
+				partial.addRectangle(maze.transformations_cuboid[i], BENCH_LENGTH, BENCH_WIDTH);
+			}
+			partial.buildIndex(BENCH_LENGTH, BENCH_WIDTH);
+			for (size_t i = indexed_walls; i < maze.transformations_cuboid.size(); i++) {
+				partial.addRectangle(maze.transformations_cuboid[i], BENCH_LENGTH, BENCH_WIDTH);
+			}
+			for (auto& t : maze.transformations_hexprism) {
+				partial.addCircle(t.translation, BENCH_WIDTH);
+			}
+			for (size_t i = 0; i < std::min<size_t>(queries, 4096); i++) {
+				mismatches += partial.collidesWithCircle(points[i], 0.1f) != bool(expected[i]);
+			}
+
+			fprintf(stderr, "  %zu hits\n", size_t(std::count(expected.begin(), expected.begin() + queries, 1)));
+			if (mismatches) {
+				report.fail("collision queries disagree with the linear scan on " + std::to_string(mismatches) + " queries");
+			}
+		}
+	}
+
+	void benchMergeWalls(const BenchOptions& options, BenchReport& report) {
+		for (int side_edges : options.sizes) {
+			Maze maze = getMaze(BENCH_LENGTH, BENCH_WIDTH, BENCH_HEIGHT, side_edges, options.seed);
+			auto start = bench_clock::now();
+			WallMergeStats stats = mergeCollinearWalls(maze.transformations_cuboid, BENCH_LENGTH, BENCH_WIDTH);
+			report.add({"merge_walls", side_edges, 1, stats.cuboids_before, secondsSince(start)});
+			fprintf(stderr, "  cuboid instances %zu -> %zu, triangles %zu -> %zu\n",
+				stats.cuboids_before, stats.cuboids_after,
+				stats.cuboids_before * CUBOID_VERTEX_COUNT / 3, stats.cuboids_after * CUBOID_VERTEX_COUNT / 3);
+		}
+	}
+
+	bool sameMaze(const MazeView& a, const MazeView& b) {
+		auto same = [](auto x, auto y) {
+			return x.size() == y.size() && memcmp(x.data(), y.data(), x.size_bytes()) == 0;
+		};
+		return same(a.cuboid, b.cuboid) && same(a.hexprism, b.hexprism) && same(a.floor, b.floor)
+			&& same(a.transformations_cuboid, b.transformations_cuboid)
+			&& same(a.transformations_hexprism, b.transformations_hexprism)
+			&& same(a.transformations_floor, b.transformations_floor)
+			&& a.player_coordinates.x == b.player_coordinates.x && a.player_coordinates.y == b.player_coordinates.y;
+	}
+
+	// Writes the maze cache, maps it back and compares it with getMaze. Then
+	// truncated files and corrupt counts have to be rejected, and a file for
+	// another key has to be regenerated.
+	void benchMazeFile(const BenchOptions& options, BenchReport& report) {
+		const std::string path = (std::filesystem::temp_directory_path() / "maze_bench_cache.bin").string();
+		for (int side_edges : options.sizes) {
+			Maze maze = getMaze(BENCH_LENGTH, BENCH_WIDTH, BENCH_HEIGHT, side_edges, options.seed);
+			MazeFileKey key = {BENCH_LENGTH, BENCH_WIDTH, BENCH_HEIGHT, side_edges, options.seed, uint32_t(MazeGenerator::Kruskal), 0};
+			std::filesystem::remove(path);
+			MazeFile file;
+			auto start = bench_clock::now();
+			if (!openOrCreateMazeFile(file, path.c_str(), key)) {
+				report.fail("cannot write the maze file " + path);
+				continue;
+			}
+			report.add({"maze_file_create", side_edges, 1, maze.transformations_hexprism.size(), secondsSince(start)});
+			start = bench_clock::now();
+			bool opened = file.open(path.c_str(), key);
+			report.add({"maze_file_open", side_edges, 1, maze.transformations_hexprism.size(), secondsSince(start)});
+			if (!opened || !sameMaze(file.view(), viewOf(maze))) {
+				report.fail("reopened maze file differs from getMaze");
+			}
+			else if (wallGraph(file.view().transformations_cuboid, side_edges, BENCH_LENGTH, BENCH_WIDTH).walls != maze.graph.walls) {
+				report.fail("walls of the maze file give another graph than getMaze");
+			}
+			file.close();
+
+			std::vector<char> bytes;
+			{
+				std::ifstream in(path, std::ios::binary);
+				bytes.assign(std::istreambuf_iterator<char>(in), {});
+			}
+			MazeFileHeader header;
+			memcpy(&header, bytes.data(), sizeof(header));
+			const size_t padding = offsetof(MazeFileHeader, player_coordinates) + sizeof(Vector2);
+			if (std::any_of(bytes.begin() + padding, bytes.begin() + offsetof(MazeFileHeader, cuboid_count), [](char c) { return c != 0; })) {
+				report.fail("maze file header padding is not zeroed");
+			}
+			auto opens = [&](const std::vector<char>& contents) {
+				std::ofstream(path, std::ios::binary | std::ios::trunc).write(contents.data(), contents.size());
+				bool res = file.open(path.c_str(), key);
+				file.close();
+				return res;
+			};
+			auto withCuboidCount = [&](uint64_t count) {
+				std::vector<char> res = bytes;
+				MazeFileHeader changed = header;
+				changed.cuboid_count = count;
+				memcpy(res.data(), &changed, sizeof(changed));
+				return res;
+			};
+			// The last count wraps around to the right file size if multiplied by the item size.
+			size_t accepted = opens(std::vector<char>(bytes.begin(), bytes.end() - 1))
+				+ opens(std::vector<char>(bytes.begin(), bytes.begin() + sizeof(MazeFileHeader) + 100))
+				+ opens(withCuboidCount(header.cuboid_count + 1))
+				+ opens(withCuboidCount(header.cuboid_count + (UINT64_MAX / sizeof(CuboidTransformation) + 1)));
+			if (accepted) {
+				report.fail(std::to_string(accepted) + " damaged maze files were accepted");
+			}
+			if (!opens(bytes)) {
+				report.fail("maze file is rejected after restoring it");
+			}
+
+			MazeFileKey other = key;
+			other.seed++;
+			if (file.open(path.c_str(), other)) {
+				report.fail("maze file opened with another key");
+			}
+			Maze other_maze = getMaze(BENCH_LENGTH, BENCH_WIDTH, BENCH_HEIGHT, side_edges, other.seed);
+			if (!openOrCreateMazeFile(file, path.c_str(), other) || !sameMaze(file.view(), viewOf(other_maze))) {
+				report.fail("maze file for another key was not regenerated");
+			}
+			file.close();
+		}
+		std::filesystem::remove(path);
+	}
+
+	// Larger chunks only make the flood fill slower.
+	constexpr int CHUNK_BENCH_MAX_EDGES = 64;
+
+	// Generates a 3x3 block of chunks and floods the triangular cells of the
+	// block from the middle, moving between neighbouring cells where the
+	// segment between their centers is free. Every cell has to be reached,
+	// through the doors between the chunks.
+	void benchChunks(const BenchOptions& options, BenchReport& report) {
+		for (int side_edges : options.sizes) {
+			const int edges = std::min(side_edges, CHUNK_BENCH_MAX_EDGES);
+			std::vector<std::shared_ptr<MazeChunk>> chunks;
+			auto start = bench_clock::now();
+			for (int cy = -1; cy <= 1; cy++) {
+				for (int cx = -1; cx <= 1; cx++) {
+					chunks.push_back(makeMazeChunk({cx, cy}, BENCH_LENGTH, BENCH_WIDTH, edges, options.seed));
+				}
+			}
+			report.add({"chunk_build", side_edges, 1, chunks.size(), secondsSince(start)});
+
+			// Up (down = 0) and down cell of every node (x, y) of the block.
+			const int side = 3 * edges;
+			auto center = [&](int x, int y, int down) {
+				x -= edges, y -= edges;
+				Vector2 sum = coordsToHexOffset(x + 1, y, BENCH_LENGTH, BENCH_WIDTH) + coordsToHexOffset(x, y + 1, BENCH_LENGTH, BENCH_WIDTH);
+				return (sum + coordsToHexOffset(x + down, y + down, BENCH_LENGTH, BENCH_WIDTH)) / 3;
+			};
+			auto free = [&](Vector2 a, Vector2 b) {
+				return std::all_of(chunks.begin(), chunks.end(), [&](auto& chunk) { return chunk->collision.lineOfSight(a, b); });
+			};
+			std::vector<uint8_t> reached(size_t(side) * side * 2, 0);
+			std::vector<int> stack = {((side / 2) * side + side / 2) * 2};
+			reached[stack[0]] = 1;
+			size_t reached_count = 1;
+			while (!stack.empty()) {
+				int cell = stack.back();
+				stack.pop_back();
+				int x = cell / 2 % side, y = cell / 2 / side, down = cell % 2;
+				// Down cells border the up cells of (x, y), (x + 1, y) and (x, y + 1).
+				const int neighbours[3][3] = {
+					{x, y, 1 - down},
+					{down ? x + 1 : x - 1, y, 1 - down},
+					{x, down ? y + 1 : y - 1, 1 - down},
+				};
+				for (auto& n : neighbours) {
+					if (n[0] < 0 || n[1] < 0 || n[0] >= side || n[1] >= side) {
+						continue;
+					}
+					int next = (n[1] * side + n[0]) * 2 + n[2];
+					if (!reached[next] && free(center(x, y, down), center(n[0], n[1], n[2]))) {
+						reached[next] = 1;
+						reached_count++;
+						stack.push_back(next);
+					}
+				}
+			}
+			fprintf(stderr, "  %zu of %zu cells of 3x3 chunks of %d edges reached\n", reached_count, reached.size(), edges);
+			if (reached_count != reached.size()) {
+				report.fail(std::to_string(reached.size() - reached_count) + " cells of 3x3 chunks cannot be reached");
+			}
+		}
+	}
+
+	// Every kernel the CPU supports, over contiguous and listed batches. The
+	// masks have to match collides() on RectangleObj/HexObj bit for bit.
+	void benchCollisionKernels(const BenchOptions& options, BenchReport& report) {
+		for (int side_edges : options.sizes) {
+			Maze maze = getMaze(BENCH_LENGTH, BENCH_WIDTH, BENCH_HEIGHT, side_edges, options.seed);
+			RectangleSoA rectangles;
+			CircleSoA circles;
+			std::vector<RectangleObj> walls;
+			std::vector<HexObj> pillars;
+			for (auto& t : maze.transformations_cuboid) {
+				rectangles.add(t, BENCH_LENGTH, BENCH_WIDTH);
+				walls.emplace_back(t, BENCH_LENGTH, BENCH_WIDTH);
+			}
+			for (auto& t : maze.transformations_hexprism) {
+				circles.add(t.translation, BENCH_WIDTH);
+				pillars.emplace_back(t, BENCH_WIDTH);
+			}
+			// Listed batches visit the shapes in reverse.
+			std::vector<uint32_t> rectangle_order(walls.size()), circle_order(pillars.size());
+			for (size_t i = 0; i < walls.size(); i++) {
+				rectangle_order[i] = uint32_t(walls.size() - 1 - i);
+			}
+			for (size_t i = 0; i < pillars.size(); i++) {
+				circle_order[i] = uint32_t(pillars.size() - 1 - i);
+			}
+
+			// Large circles around the walls, so the masks are not all zero.
+			auto points = randomMazePoints(side_edges, 64, options.seed);
+			const float radius = BENCH_LENGTH;
+			for (auto& kernels : supportedCollisionKernels()) {
+				size_t mismatches = 0;
+				for (auto& p : points) {
+					HexObj query({p}, radius);
+					for (size_t b = 0; b < walls.size(); b += KERNEL_BATCH) {
+						size_t count = std::min(KERNEL_BATCH, walls.size() - b);
+						uint32_t expected = 0, expected_listed = 0;
+						for (size_t i = 0; i < count; i++) {
+							expected |= uint32_t(collides(walls[b + i], query)) << i;
+							expected_listed |= uint32_t(collides(walls[rectangle_order[b + i]], query)) << i;
+						}
+						mismatches += kernels.rectangles(rectangles, b, count, p, radius) != expected;
+						mismatches += kernels.rectanglesAt(rectangles, rectangle_order.data() + b, count, p, radius) != expected_listed;
+					}
+					for (size_t b = 0; b < pillars.size(); b += KERNEL_BATCH) {
+						size_t count = std::min(KERNEL_BATCH, pillars.size() - b);
+						uint32_t expected = 0, expected_listed = 0;
+						for (size_t i = 0; i < count; i++) {
+							expected |= uint32_t(collides(pillars[b + i], query)) << i;
+							expected_listed |= uint32_t(collides(pillars[circle_order[b + i]], query)) << i;
+						}
+						mismatches += kernels.circles(circles, b, count, p, radius) != expected;
+						mismatches += kernels.circlesAt(circles, circle_order.data() + b, count, p, radius) != expected_listed;
+					}
+				}
+				if (mismatches) {
+					report.fail(std::string(kernels.name) + " kernels disagree with collides() on " + std::to_string(mismatches) + " batches");
+				}
+
+				// Throughput of the contiguous rectangle kernel, items are shape tests.
+				size_t hits = 0;
+				double seconds;
+				size_t batches = (walls.size() + KERNEL_BATCH - 1) / KERNEL_BATCH;
+				size_t calls = timedLoop(size_t(1) << 30, options.min_time, seconds, [&](size_t i) {
+					size_t b = i % batches * KERNEL_BATCH;
+					hits += kernels.rectangles(rectangles, b, std::min(KERNEL_BATCH, walls.size() - b), points[i % points.size()], radius) != 0;
+				});
+				report.add({std::string("collision_kernels_") + kernels.name, side_edges, 1, calls * KERNEL_BATCH, seconds});
+				fprintf(stderr, "  %zu batches with hits\n", hits);
+			}
+		}
+	}
+
+	// A true hexagon drifting across every wall over a number of frames, with a
+	// fresh simplex per query and with one simplex per pair kept between frames.
+	void benchGjk(const BenchOptions& options, BenchReport& report) {
+		constexpr int frames = 16;
+		for (int side_edges : options.sizes) {
+			Maze maze = getMaze(BENCH_LENGTH, BENCH_WIDTH, BENCH_HEIGHT, side_edges, options.seed);
+			std::vector<RectangleObj> walls;
+			for (auto& t : maze.transformations_cuboid) {
+				walls.emplace_back(t, BENCH_LENGTH, BENCH_WIDTH);
+			}
+			auto hexAt = [&](size_t wall, int frame) {
+				return HexObj({walls[wall].t.translation + Vector2{0.02f * frame, 0.6f - 0.04f * frame}}, 0.2f);
+			};
+
+			std::vector<GjkSimplex> simplices(walls.size());
+			for (int warm = 0; warm < 2; warm++) {
+				size_t iterations = 0, hits = 0;
+				float depth = 0;
+				auto start = bench_clock::now();
+				for (int frame = 0; frame < frames; frame++) {
+					for (size_t i = 0; i < walls.size(); i++) {
+						GjkSimplex cold;
+						GjkSimplex& simplex = warm ? simplices[i] : cold;
+						HexObj hex = hexAt(i, frame);
+						if (gjkIntersects(walls[i], hex, simplex)) {
+							hits++;
+							depth += epaPenetration(walls[i], hex, simplex).depth;
+						}
+						iterations += simplex.iterations;
+					}
+				}
+				size_t queries = walls.size() * frames;
+				report.add({warm ? "gjk_epa_warm" : "gjk_epa_cold", side_edges, 1, queries, secondsSince(start)});
+				fprintf(stderr, "  %.2f GJK iterations per query, %zu hits, mean depth %.4f\n",
+					double(iterations) / queries, hits, hits ? depth / hits : 0.f);
+			}
+
+			// Walls that turn and hexes that jump and change size between frames,
+			// so the kept simplices go stale. Every other hex is a point on the
+			// line of the wall, which flattens the re-evaluated triangle. Warm
+			// queries have to match cold ones, and both have to match SAT wherever
+			// the gap or overlap is not a rounding error.
+			std::mt19937 gen(options.seed);
+			std::uniform_real_distribution<float> angles(0, float(2 * PI)), offsets(-2.5f, 2.5f), sizes(0.02f, 0.5f);
+			const Vector2 hex_normals[3] = {{1, 0}, {0.5f, sqrtf(3) / 2}, {-0.5f, sqrtf(3) / 2}};
+			size_t warm_mismatches = 0, sat_mismatches = 0;
+			for (auto& simplex : simplices) {
+				simplex = {};
+			}
+			for (int frame = 0; frame < frames; frame++) {
+				for (size_t i = 0; i < walls.size(); i++) {
+					RectangleObj wall({walls[i].t.translation, angles(gen)}, BENCH_LENGTH, BENCH_WIDTH);
+					Vector2 along = wall.half_axis.normUnit() * offsets(gen);
+					HexObj hex = frame % 2
+						? HexObj({wall.t.translation + along + wall.half_side.normUnit() * offsets(gen)}, sizes(gen))
+						: HexObj({wall.t.translation + along}, 0);
+					GjkSimplex cold;
+					bool hit = gjkIntersects(wall, hex, cold);
+					warm_mismatches += gjkIntersects(wall, hex, simplices[i]) != hit;
+
+					const Vector2 axes[5] = {wall.half_axis, wall.half_side, hex_normals[0], hex_normals[1], hex_normals[2]};
+					float separation = -INFINITY;
+					for (Vector2 n : axes) {
+						separation = std::max({separation,
+							dot(hex.support(-n), n) - dot(wall.support(n), n),
+							dot(wall.support(-n), n) - dot(hex.support(n), n)});
+					}
+					sat_mismatches += std::abs(separation) > 1e-4f && hit != (separation < 0);
+				}
+			}
+			if (warm_mismatches) {
+				report.fail("warm-started GJK disagrees with cold GJK on " + std::to_string(warm_mismatches) + " queries");
+			}
+			if (sat_mismatches) {
+				report.fail("GJK disagrees with SAT on " + std::to_string(sat_mismatches) + " queries");
+			}
+		}
+	}
+
+	constexpr size_t DYNAMIC_BENCH_AGENTS = 10000;
+	constexpr int DYNAMIC_BENCH_FRAMES = 16;
+	constexpr size_t DYNAMIC_BENCH_CHECKS = 16;
+
+	// Pool-allocated walls and pillars plus moving hex agents in an indexed
+	// ObjectHandler. Every frame moves all agents, opens or closes a door by
+	// removing or re-adding a wall, and queries each agent against the rest.
+	// The queries are checked against a handler without an index.
+	void benchDynamicObjects(const BenchOptions& options, BenchReport& report) {
+		for (int side_edges : options.sizes) {
+			Maze maze = getMaze(BENCH_LENGTH, BENCH_WIDTH, BENCH_HEIGHT, side_edges, options.seed);
+			ObjectPool<RectangleObj> wall_pool;
+			ObjectPool<HexObj> hex_pool;
+			ObjectHandler handler, scan;
+			auto start = bench_clock::now();
+			std::vector<ObjectHandle> walls;
+			for (auto& t : maze.transformations_cuboid) {
+				walls.push_back(handler.addObject(wall_pool.create(t, BENCH_LENGTH, BENCH_WIDTH)));
+			}
+			for (auto& t : maze.transformations_hexprism) {
+				handler.addObject(hex_pool.create(t, BENCH_WIDTH));
+			}
+			handler.buildIndex(BENCH_LENGTH, BENCH_WIDTH);
+			report.add({"dynamic_objects_build", side_edges, 1, handler.size(), secondsSince(start)});
+
+			auto points = randomMazePoints(side_edges, DYNAMIC_BENCH_AGENTS, options.seed);
+			std::vector<HexObj*> agents;
+			std::vector<ObjectHandle> agent_handles;
+			for (Vector2 p : points) {
+				agents.push_back(hex_pool.create(TranslationTransformation{p}, 0.1f));
+				agent_handles.push_back(handler.addObject(agents.back()));
+			}
+			// The scan handler sees the same objects, so both answer the same queries.
+			for (uint32_t i = 0; i < uint32_t(handler.size()); i++) {
+				scan.addObject(handler.get({i, 0}));
+			}
+
+			std::vector<ObjectHandle> scan_walls = walls;
+			std::vector<size_t> open_doors;
+			double update_seconds = 0, query_seconds = 0;
+			size_t hits = 0, mismatches = 0;
+			std::vector<uint8_t> frame_hits(agents.size());
+			for (int frame = 0; frame < DYNAMIC_BENCH_FRAMES; frame++) {
+				start = bench_clock::now();
+				for (size_t i = 0; i < agents.size(); i++) {
+					agents[i]->t.translation += Vector2{0.3f, 0.2f} * (i % 2 ? 1.f : -1.f);
+					handler.updateObject(agent_handles[i]);
+				}
+				// Doors: remove a wall, or put back the one removed two frames ago.
+				size_t door = size_t(frame) * 7919 % walls.size();
+				if (frame % 2 == 0) {
+					Object* wall = handler.get(walls[door]);
+					handler.removeObject(walls[door]);
+					scan.removeObject(scan_walls[door]);
+					wall_pool.destroy(static_cast<RectangleObj*>(wall));
+					open_doors.push_back(door);
+				}
+				else {
+					size_t closed = open_doors.back();
+					open_doors.pop_back();
+					RectangleObj* wall = wall_pool.create(maze.transformations_cuboid[closed], BENCH_LENGTH, BENCH_WIDTH);
+					walls[closed] = handler.addObject(wall);
+					scan_walls[closed] = scan.addObject(wall);
+				}
+				update_seconds += secondsSince(start);
+
+				// Beside the agent, so it does not hit itself.
+				auto probe = [&](size_t i) {
+					return HexObj({agents[i]->t.translation + Vector2{0.25f, 0}}, 0.1f);
+				};
+				start = bench_clock::now();
+				for (size_t i = 0; i < agents.size(); i++) {
+					bool hit = handler.collidesWith(probe(i));
+					hits += hit;
+					frame_hits[i] = hit;
+				}
+				query_seconds += secondsSince(start);
+				for (size_t i = 0; i < DYNAMIC_BENCH_CHECKS; i++) {
+					mismatches += bool(frame_hits[i]) != scan.collidesWith(probe(i));
+				}
+			}
+			report.add({"dynamic_objects_update", side_edges, 1, DYNAMIC_BENCH_FRAMES * agents.size(), update_seconds});
+			report.add({"dynamic_objects_query", side_edges, 1, DYNAMIC_BENCH_FRAMES * agents.size(), query_seconds});
+			fprintf(stderr, "  %zu objects, %zu pooled, %zu hits\n", handler.size(), wall_pool.size() + hex_pool.size(), hits);
+			if (mismatches || handler.size() != scan.size()) {
+				report.fail("dynamic ObjectHandler disagrees with the linear scan on " + std::to_string(mismatches) + " queries");
+			}
+		}
+	}
+
+	constexpr size_t AGENT_BENCH_AGENTS = 20000;
+	constexpr int AGENT_BENCH_TICKS = 32;
+
+	// Agents crowded around random points of the maze walk in random
+	// directions for a number of ticks, for every thread count. The final
+	// positions have to be bit for bit the same for all of them.
+	void benchAgents(const BenchOptions& options, BenchReport& report) {
+		for (int side_edges : options.sizes) {
+			Maze maze = getMaze(BENCH_LENGTH, BENCH_WIDTH, BENCH_HEIGHT, side_edges, options.seed);
+			ObjectPool<RectangleObj> wall_pool;
+			ObjectPool<HexObj> pillar_pool;
+			ObjectHandler walls;
+			for (auto& t : maze.transformations_cuboid) {
+				walls.addObject(wall_pool.create(t, BENCH_LENGTH, BENCH_WIDTH));
+			}
+			for (auto& t : maze.transformations_hexprism) {
+				walls.addObject(pillar_pool.create(t, BENCH_WIDTH));
+			}
+			walls.buildIndex(BENCH_LENGTH, BENCH_WIDTH);
+
+			// Groups of eight, so agents also run into each other.
+			AgentSoA start;
+			auto points = randomMazePoints(side_edges, AGENT_BENCH_AGENTS, options.seed);
+			for (size_t i = 0; start.size() < AGENT_BENCH_AGENTS && i < points.size(); i++) {
+				if (walls.collidesWith(HexObj({points[i]}, 0.4f))) {
+					continue;
+				}
+				for (int k = 0; k < 8; k++) {
+					float angle = float(2 * PI * k / 8);
+					Vector2 direction = {std::cos(angle + i), std::sin(angle + i)};
+					start.add(points[i] + direction * 0.15f, direction, 0.1f);
+				}
+			}
+
+			std::vector<Vector2> expected;
+			for (int threads : options.threads) {
+				AgentSoA agents = start;
+				AgentStepper stepper(walls, threads);
+				AgentStepStats stats;
+				auto begin = bench_clock::now();
+				for (int tick = 0; tick < AGENT_BENCH_TICKS; tick++) {
+					stats = stepper.step(agents, 1.f / 60);
+				}
+				double seconds = secondsSince(begin);
+				report.add({"agents_step", side_edges, threads, agents.size() * AGENT_BENCH_TICKS, seconds});
+				fprintf(stderr, "  %.0f agents per ms, last tick %zu contacts, %zu blocked\n",
+					agents.size() * AGENT_BENCH_TICKS / seconds / 1000, stats.contacts, stats.blocked);
+				if (expected.empty()) {
+					expected = agents.position;
+				}
+				else if (!std::equal(expected.begin(), expected.end(), agents.position.begin(),
+					[](Vector2 a, Vector2 b) { return a.x == b.x && a.y == b.y; })) {
+					report.fail("agent positions with " + std::to_string(threads) + " threads differ from the first run");
+				}
+			}
+		}
+	}
+
+	constexpr size_t BVH_BENCH_RAYS = 1 << 14;
+	constexpr size_t BVH_BENCH_FRUSTUMS = 256;
+	constexpr size_t BVH_BENCH_BOXES = 1 << 12;
+	constexpr size_t BVH_BENCH_CHECKS = 16;
+
+	// Frustum of a camera at eye height looking along yaw, 90 degrees wide, 60
+	// high and 30 deep, with the normals pointing inside.
+	std::vector<Plane> benchFrustum(Vector2 position, float yaw) {
+		const Vector3 eye = {position.x, 0.25f, position.y};
+		const Vector3 forward = {std::cos(yaw), 0, std::sin(yaw)};
+		const Vector3 right = {-forward.z, 0, forward.x};
+		auto plane = [&](Vector3 n, float offset) {
+			return Plane{n.x, n.y, n.z, -(n.x * eye.x + n.y * eye.y + n.z * eye.z) + offset};
+		};
+		auto mix = [](Vector3 a, float ka, Vector3 b, float kb) {
+			return Vector3{a.x * ka + b.x * kb, a.y * ka + b.y * kb, a.z * ka + b.z * kb};
+		};
+		const float h = float(PI / 4), v = float(PI / 6);
+		return {
+			plane(mix(forward, std::sin(h), right, std::cos(h)), 0),
+			plane(mix(forward, std::sin(h), right, -std::cos(h)), 0),
+			plane(mix(forward, std::sin(v), {0, 1, 0}, std::cos(v)), 0),
+			plane(mix(forward, std::sin(v), {0, 1, 0}, -std::cos(v)), 0),
+			plane(forward, -0.1f),
+			plane(mix(forward, -1, {0, 0, 0}, 0), 30),
+		};
+	}
+
+	// Builds the BVH for every thread count, then runs ray, frustum and box
+	// queries on the binary and the wide nodes. A few queries of each kind are
+	// also answered by testing every item, the answers have to be the same.
+	void benchBvh(const BenchOptions& options, BenchReport& report) {
+		for (int side_edges : options.sizes) {
+			Maze maze = getMaze(BENCH_LENGTH, BENCH_WIDTH, BENCH_HEIGHT, side_edges, options.seed);
+			MazeBvh bvh;
+			for (int threads : options.threads) {
+				auto start = bench_clock::now();
+				bvh.build(maze.transformations_cuboid, maze.transformations_hexprism, BENCH_LENGTH, BENCH_WIDTH, BENCH_HEIGHT, threads);
+				report.add({"bvh_build", side_edges, threads, bvh.itemCount(), secondsSince(start)});
+			}
+			fprintf(stderr, "  %zu items, %zu nodes, %zu wide nodes\n", bvh.itemCount(), bvh.nodeCount(), bvh.wideNodeCount());
+
+			auto points = randomMazePoints(side_edges, BVH_BENCH_RAYS + 1, options.seed);
+			std::vector<Vector3> origins(BVH_BENCH_RAYS), directions(BVH_BENCH_RAYS);
+			for (size_t i = 0; i < BVH_BENCH_RAYS; i++) {
+				Vector2 d = (points[i + 1] - points[i]).normUnit();
+				float up = 0.2f * float(i % 11) / 10 - 0.1f;
+				float k = 1 / std::sqrt(1 + up * up);
+				origins[i] = {points[i].x, 0.25f, points[i].y};
+				directions[i] = {d.x * k, up * k, d.y * k};
+			}
+			size_t mismatches = 0;
+			std::vector<BvhHit> hits(BVH_BENCH_RAYS);
+			double seconds;
+			size_t rays = timedLoop(BVH_BENCH_RAYS, options.min_time, seconds, [&](size_t i) {
+				hits[i] = bvh.raycast(origins[i], directions[i], 50);
+			});
+			report.add({"bvh_ray", side_edges, 1, rays, seconds});
+			std::vector<BvhHit> wide_hits(BVH_BENCH_RAYS);
+			size_t wide_rays = timedLoop(BVH_BENCH_RAYS, options.min_time, seconds, [&](size_t i) {
+				wide_hits[i] = bvh.raycastWide(origins[i], directions[i], 50);
+			});
+			report.add({"bvh_ray_wide", side_edges, 1, wide_rays, seconds});
+			for (size_t i = 0; i < std::min(rays, wide_rays); i++) {
+				mismatches += wide_hits[i].item != hits[i].item || wide_hits[i].distance != hits[i].distance;
+			}
+			auto start = bench_clock::now();
+			for (size_t i = 0; i < std::min(rays, BVH_BENCH_CHECKS); i++) {
+				BvhHit best;
+				best.distance = 50;
+				for (uint32_t item = 0; item < bvh.itemCount(); item++) {
+					float t = bvh.rayItem(item, origins[i], directions[i], best.distance);
+					if (t < best.distance || (t == best.distance && item < best.item)) {
+						best = {item, t};
+					}
+				}
+				mismatches += best.item != hits[i].item || best.distance != hits[i].distance;
+			}
+			report.add({"bvh_ray_brute", side_edges, 1, std::min(rays, BVH_BENCH_CHECKS), secondsSince(start)});
+
+			// Frustums and boxes: every variant has to return the same item set.
+			auto same = [](std::vector<uint32_t> a, std::vector<uint32_t> b) {
+				std::sort(a.begin(), a.end());
+				std::sort(b.begin(), b.end());
+				return a == b;
+			};
+			std::vector<std::vector<uint32_t>> found(BVH_BENCH_FRUSTUMS);
+			size_t visible = 0;
+			size_t frustums = timedLoop(BVH_BENCH_FRUSTUMS, options.min_time, seconds, [&](size_t i) {
+				bvh.frustum(benchFrustum(points[i], float(i)), found[i]);
+				visible += found[i].size();
+			});
+			report.add({"bvh_frustum", side_edges, 1, frustums, seconds});
+			std::vector<std::vector<uint32_t>> found_wide(BVH_BENCH_FRUSTUMS);
+			size_t wide_frustums = timedLoop(BVH_BENCH_FRUSTUMS, options.min_time, seconds, [&](size_t i) {
+				bvh.frustumWide(benchFrustum(points[i], float(i)), found_wide[i]);
+			});
+			report.add({"bvh_frustum_wide", side_edges, 1, wide_frustums, seconds});
+			for (size_t i = 0; i < std::min(frustums, wide_frustums); i++) {
+				mismatches += !same(found[i], found_wide[i]);
+			}
+			start = bench_clock::now();
+			for (size_t i = 0; i < std::min(frustums, BVH_BENCH_CHECKS); i++) {
+				std::vector<Plane> planes = benchFrustum(points[i], float(i));
+				std::vector<uint32_t> out;
+				for (uint32_t item = 0; item < bvh.itemCount(); item++) {
+					const Aabb& b = bvh.itemBounds(item);
+					bool outside = false;
+					for (const Plane& p : planes) {
+						outside = outside || p.a * (p.a >= 0 ? b.max.x : b.min.x) + p.b * (p.b >= 0 ? b.max.y : b.min.y) + p.c * (p.c >= 0 ? b.max.z : b.min.z) + p.d < 0;
+					}
+					if (!outside) {
+						out.push_back(item);
+					}
+				}
+				mismatches += !same(out, found[i]);
+			}
+			report.add({"bvh_frustum_brute", side_edges, 1, std::min(frustums, BVH_BENCH_CHECKS), secondsSince(start)});
+
+			auto boxAt = [&](size_t i) {
+				Vector2 p = points[i];
+				return Aabb{{p.x - 2.5f, 0, p.y - 2.5f}, {p.x + 2.5f, 1, p.y + 2.5f}};
+			};
+			found.assign(BVH_BENCH_BOXES, {});
+			size_t boxes = timedLoop(BVH_BENCH_BOXES, options.min_time, seconds, [&](size_t i) {
+				bvh.overlap(boxAt(i), found[i]);
+			});
+			report.add({"bvh_overlap", side_edges, 1, boxes, seconds});
+			found_wide.assign(BVH_BENCH_BOXES, {});
+			size_t wide_boxes = timedLoop(BVH_BENCH_BOXES, options.min_time, seconds, [&](size_t i) {
+				bvh.overlapWide(boxAt(i), found_wide[i]);
+			});
+			report.add({"bvh_overlap_wide", side_edges, 1, wide_boxes, seconds});
+			for (size_t i = 0; i < std::min(boxes, wide_boxes); i++) {
+				mismatches += !same(found[i], found_wide[i]);
+			}
+			start = bench_clock::now();
+			for (size_t i = 0; i < std::min(boxes, BVH_BENCH_CHECKS); i++) {
+				Aabb box = boxAt(i);
+				std::vector<uint32_t> out;
+				for (uint32_t item = 0; item < bvh.itemCount(); item++) {
+					const Aabb& b = bvh.itemBounds(item);
+					if (b.min.x <= box.max.x && b.max.x >= box.min.x && b.min.y <= box.max.y && b.max.y >= box.min.y && b.min.z <= box.max.z && b.max.z >= box.min.z) {
+						out.push_back(item);
+					}
+				}
+				mismatches += !same(out, found[i]);
+			}
+			report.add({"bvh_overlap_brute", side_edges, 1, std::min(boxes, BVH_BENCH_CHECKS), secondsSince(start)});
+
+			fprintf(stderr, "  %zu of %zu rays hit, %.0f items per frustum\n",
+				size_t(std::count_if(hits.begin(), hits.begin() + rays, [](const BvhHit& h) { return h.hit(); })), rays, double(visible) / frustums);
+			if (mismatches) {
+				report.fail("BVH queries disagree with each other or brute force on " + std::to_string(mismatches) + " queries");
+			}
+		}
+	}
+
+	// Support queries over every wall and pillar: by angle, by direction one at
+	// a time, and batched per object.
+	void benchSupport(const BenchOptions& options, BenchReport& report) {
+		constexpr size_t direction_count = 64;
+		for (int side_edges : options.sizes) {
+			Maze maze = getMaze(BENCH_LENGTH, BENCH_WIDTH, BENCH_HEIGHT, side_edges, options.seed);
+			// Called through the base class, as the physics code does.
+			std::vector<RectangleObj> walls;
+			std::vector<HexObj> pillars;
+			std::vector<const Object*> objects;
+			for (auto& t : maze.transformations_cuboid) {
+				walls.emplace_back(t, BENCH_LENGTH, BENCH_WIDTH);
+			}
+			for (auto& t : maze.transformations_hexprism) {
+				pillars.emplace_back(t, BENCH_WIDTH);
+			}
+			for (auto& w : walls) {
+				objects.push_back(&w);
+			}
+			for (auto& p : pillars) {
+				objects.push_back(&p);
+			}
+			std::vector<float> angles(direction_count);
+			std::vector<Vector2> directions(direction_count), out(direction_count);
+			for (size_t i = 0; i < direction_count; i++) {
+				angles[i] = float(2 * PI * i / direction_count) + 0.01f;
+				directions[i] = {std::cos(angles[i]), std::sin(angles[i])};
+			}
+
+			Vector2 sum = {0, 0};
+			double seconds;
+			size_t calls = timedLoop(objects.size(), options.min_time, seconds, [&](size_t i) {
+				for (float angle : angles) {
+					sum += objects[i]->supportFunction(angle);
+				}
+			});
+			report.add({"support_angle", side_edges, 1, calls * direction_count, seconds});
+			calls = timedLoop(objects.size(), options.min_time, seconds, [&](size_t i) {
+				for (Vector2 d : directions) {
+					sum += objects[i]->support(d);
+				}
+			});
+			report.add({"support_direction", side_edges, 1, calls * direction_count, seconds});
+			calls = timedLoop(objects.size(), options.min_time, seconds, [&](size_t i) {
+				objects[i]->supportBatch(directions, out.data());
+				sum += out[i % direction_count];
+			});
+			report.add({"support_batch", side_edges, 1, calls * direction_count, seconds});
+			fprintf(stderr, "  checksum %f\n", sum.x + sum.y);
+
+			// The batches have to give support() bit for bit, also for the
+			// directions left over after the blocks of four.
+			size_t mismatches = 0;
+			for (auto& o : objects) {
+				o->supportBatch(std::span(directions).first(direction_count - 1), out.data());
+				for (size_t i = 0; i + 1 < direction_count; i++) {
+					Vector2 expected = o->support(directions[i]);
+					mismatches += memcmp(&out[i], &expected, sizeof(Vector2)) != 0;
+				}
+			}
+			if (mismatches) {
+				report.fail("supportBatch disagrees with support() on " + std::to_string(mismatches) + " directions");
+			}
+		}
+	}
+
+	constexpr size_t RAY_BENCH_RAYS = 1 << 16;
+	constexpr size_t RAY_BENCH_CHECKS = 64;
+
+	// Rays from random points, short ones of ten lattice steps and segments
+	// between two random points, single and batched over threads. The first
+	// rays are checked against a world without an index.
+	void benchRaycast(const BenchOptions& options, BenchReport& report) {
+		const float step = BENCH_LENGTH + BENCH_WIDTH * sqrtf(3);
+		for (int side_edges : options.sizes) {
+			Maze maze = getMaze(BENCH_LENGTH, BENCH_WIDTH, BENCH_HEIGHT, side_edges, options.seed);
+			CollisionWorld world = mazeCollisionWorld(maze.transformations_cuboid, maze.transformations_hexprism);
+			CollisionWorld scan = mazeCollisionWorld(maze.transformations_cuboid, maze.transformations_hexprism, false);
+
+			auto points = randomMazePoints(side_edges, RAY_BENCH_RAYS + 1, options.seed);
+			std::vector<Ray> short_rays(RAY_BENCH_RAYS), segments(RAY_BENCH_RAYS);
+			for (size_t i = 0; i < RAY_BENCH_RAYS; i++) {
+				Vector2 d = points[i + 1] - points[i];
+				float length = d.abs();
+				short_rays[i] = {points[i], d / length, 10 * step};
+				segments[i] = {points[i], d / length, length};
+			}
+
+			std::vector<RayHit> hits(RAY_BENCH_RAYS);
+			size_t mismatches = 0;
+			for (auto* rays : {&short_rays, &segments}) {
+				const char* name = rays == &short_rays ? "raycast_short" : "raycast_segment";
+				double seconds;
+				size_t count = timedLoop(rays->size(), options.min_time, seconds, [&](size_t i) {
+					hits[i] = world.raycast((*rays)[i]);
+				});
+				report.add({name, side_edges, 1, count, seconds});
+				for (size_t i = 0; i < std::min(count, RAY_BENCH_CHECKS); i++) {
+					RayHit expected = scan.raycast((*rays)[i]);
+					mismatches += hits[i].hit() != expected.hit() || std::abs(hits[i].distance - expected.distance) > 1e-4f;
+				}
+				size_t hit_count = size_t(std::count_if(hits.begin(), hits.begin() + count, [](const RayHit& h) { return h.hit(); }));
+				fprintf(stderr, "  %s: %zu of %zu rays hit\n", name, hit_count, count);
+
+				for (int threads : options.threads) {
+					std::vector<RayHit> batch(rays->size());
+					auto start = bench_clock::now();
+					world.raycast(*rays, batch.data(), threads);
+					report.add({std::string(name) + "_batch", side_edges, threads, rays->size(), secondsSince(start)});
+					for (size_t i = 0; i < count; i++) {
+						mismatches += batch[i].distance != hits[i].distance;
+					}
+				}
+			}
+			if (mismatches) {
+				report.fail("raycasts disagree with the linear scan on " + std::to_string(mismatches) + " rays");
+			}
+		}
+	}
+
+	constexpr size_t SWEPT_BENCH_WALKERS = 256;
+	constexpr size_t SWEPT_BENCH_CHECKS = 64;
+	constexpr int SWEPT_BENCH_SECONDS = 10;
+	constexpr float SWEPT_BENCH_RADIUS = 0.1f;
+
+	struct SweptVariant {
+		const char* name;
+		int ticks_per_second;
+		float speed;
+		bool slide;
+	};
+
+	// Walkers heading in a new random direction every simulated second, moved
+	// like the player was before, one collision query per pressed key at 100 Hz
+	// rejecting moves into walls, and with one swept slide per tick at lower
+	// rates. Each result item is one simulated walker second. The first walkers
+	// are stepped again with a check that slides never end inside a wall.
+	void benchSwept(const BenchOptions& options, BenchReport& report) {
+		const SweptVariant variants[] = {
+			{"swept_reject_keys_100hz", 100, 1.5f, false},
+			{"swept_slide_100hz", 100, 1.5f, true},
+			{"swept_slide_30hz", 30, 1.5f, true},
+			{"swept_slide_10hz", 10, 1.5f, true},
+			{"swept_reject_keys_10hz_fast", 10, 6, false},
+			{"swept_slide_10hz_fast", 10, 6, true},
+		};
+		for (int side_edges : options.sizes) {
+			Maze maze = getMaze(BENCH_LENGTH, BENCH_WIDTH, BENCH_HEIGHT, side_edges, options.seed);
+			CollisionWorld world = mazeCollisionWorld(maze.transformations_cuboid, maze.transformations_hexprism);
+
+			std::vector<Vector2> starts;
+			for (auto& p : randomMazePoints(side_edges, SWEPT_BENCH_WALKERS * 4, options.seed)) {
+				if (starts.size() < SWEPT_BENCH_WALKERS && !world.collidesWithCircle(p, SWEPT_BENCH_RADIUS)) {
+					starts.push_back(p);
+				}
+			}
+			std::mt19937 gen(options.seed);
+			std::uniform_real_distribution<float> angle(0, float(2 * PI));
+			std::vector<Vector2> headings(starts.size() * SWEPT_BENCH_SECONDS);
+			for (auto& h : headings) {
+				float a = angle(gen);
+				h = {std::cos(a), std::sin(a)};
+			}
+
+			for (auto& variant : variants) {
+				size_t queries = 0, tunnels = 0, penetrations = 0;
+				float travelled = 0;
+				const int ticks = variant.ticks_per_second * SWEPT_BENCH_SECONDS;
+				const float dt = 1.f / variant.ticks_per_second;
+				auto walk = [&](size_t walkers, bool check) {
+					for (size_t w = 0; w < walkers; w++) {
+						Vector2 p = starts[w];
+						for (int tick = 0; tick < ticks; tick++) {
+							Vector2 delta = headings[w * SWEPT_BENCH_SECONDS + tick / variant.ticks_per_second] * (variant.speed * dt);
+							Vector2 before = p;
+							if (variant.slide) {
+								SlideResult slide = world.slideCircle(p, SWEPT_BENCH_RADIUS, delta);
+								queries += slide.sweeps;
+								p = slide.position;
+								penetrations += check && world.collidesWithCircle(p, SWEPT_BENCH_RADIUS - 1e-3f);
+							}
+							else {
+								for (Vector2 key : {Vector2{delta.x, 0}, Vector2{0, delta.y}}) {
+									queries++;
+									if (!world.collidesWithCircle(p + key, SWEPT_BENCH_RADIUS)) {
+										tunnels += check && !world.lineOfSight(p, p + key);
+										p += key;
+									}
+								}
+							}
+							travelled += (p - before).abs();
+						}
+					}
+				};
+				auto start = bench_clock::now();
+				walk(starts.size(), false);
+				double seconds = secondsSince(start);
+				report.add({variant.name, side_edges, 1, starts.size() * SWEPT_BENCH_SECONDS, seconds});
+				const double walker_seconds = double(starts.size() * SWEPT_BENCH_SECONDS);
+				fprintf(stderr, "  %s: %.1f queries and %.2f units per walker second\n",
+					variant.name, queries / walker_seconds, travelled / walker_seconds);
+
+				walk(std::min(starts.size(), SWEPT_BENCH_CHECKS), true);
+				if (tunnels) {
+					fprintf(stderr, "  %s: %zu key moves went through a wall\n", variant.name, tunnels);
+				}
+				if (penetrations) {
+					report.fail(std::string(variant.name) + " left walkers inside walls after " + std::to_string(penetrations) + " ticks");
+				}
+			}
+		}
+	}
+
+	constexpr size_t CULL_BENCH_POSES = 256;
+	constexpr float CULL_BENCH_FOG = 30;
+
+	// Culls every wall, pillar and floor instance for cameras at random points
+	// and headings, with the fog cutoff and with the far plane only. The SIMD
+	// and scalar culls must keep the same instances in the same order.
+	void benchCulling(const BenchOptions& options, BenchReport& report) {
+		static constexpr MazeMeshes meshes = makeMazeMeshes(BENCH_LENGTH, BENCH_WIDTH, BENCH_HEIGHT);
+		for (int side_edges : options.sizes) {
+			Maze maze = getMaze(BENCH_LENGTH, BENCH_WIDTH, BENCH_HEIGHT, side_edges, options.seed);
+			const MazeInstances instances = mazeInstances(maze, meshes);
+			const std::vector<InstanceMatrix>& matrices = instances.matrices;
+			const InstanceBounds& bounds = instances.bounds;
+
+			auto points = randomMazePoints(side_edges, CULL_BENCH_POSES, options.seed);
+			std::vector<std::array<Plane, CULL_PLANES>> fogged(points.size()), unfogged(points.size());
+			for (size_t i = 0; i < points.size(); i++) {
+				InstanceMatrix view_projection = playerViewProjection(points[i], 0.1f, float(i) * 2.4f, 0, 16.f / 9);
+				fogged[i] = cullPlanes(view_projection, CULL_BENCH_FOG);
+				unfogged[i] = cullPlanes(view_projection, 0);
+			}
+
+			std::vector<InstanceMatrix> out(matrices.size()), expected(matrices.size());
+			size_t mismatches = 0;
+			for (auto* planes : {&fogged, &unfogged}) {
+				const std::string suffix = planes == &fogged ? "" : "_no_fog";
+				size_t visible = 0;
+				double seconds;
+				size_t calls = timedLoop(points.size(), options.min_time, seconds, [&](size_t i) {
+					visible += cullInstances(bounds, (*planes)[i], 0, matrices.size(), matrices.data(), out.data());
+				});
+				report.add({"cull" + suffix, side_edges, 1, calls * matrices.size(), seconds});
+				fprintf(stderr, "  cull%s: %.0f instances per us, %.2f%% of %zu visible\n", suffix.c_str(),
+					calls * matrices.size() / (seconds * 1e6), 100.0 * visible / (calls * matrices.size()), matrices.size());
+
+				calls = timedLoop(points.size(), options.min_time, seconds, [&](size_t i) {
+					visible += cullInstancesScalar(bounds, (*planes)[i], 0, matrices.size(), matrices.data(), out.data());
+				});
+				report.add({"cull_scalar" + suffix, side_edges, 1, calls * matrices.size(), seconds});
+
+				for (size_t i = 0; i < std::min<size_t>(points.size(), 16); i++) {
+					size_t count = cullInstances(bounds, (*planes)[i], 0, matrices.size(), matrices.data(), out.data());
+					size_t expected_count = cullInstancesScalar(bounds, (*planes)[i], 0, matrices.size(), matrices.data(), expected.data());
+					mismatches += count != expected_count || memcmp(out.data(), expected.data(), count * sizeof(InstanceMatrix)) != 0;
+				}
+			}
+			if (mismatches) {
+				report.fail("SIMD and scalar culling disagree for " + std::to_string(mismatches) + " cameras");
+			}
+		}
+	}
+
+	constexpr size_t OCCLUSION_BENCH_POSES = 64;
+	constexpr float OCCLUSION_BENCH_DISTANCE = 12;
+
+	// A wall straight ahead of the camera and a pillar behind it whose side
+	// shows past the wall's edge by a fraction of a buffer pixel, for a range
+	// of sub-pixel wall positions. Occluders only cover pixels whose center
+	// they contain, so the pillar must still be visible, while one hidden
+	// well behind the wall must be occluded.
+	void checkOcclusionEdges(const Aabb& wall_bounds, const Aabb& pillar_bounds, BenchReport& report) {
+		constexpr float aspect = 16.f / 9, wall_z = 4, pillar_z = 8;
+		const InstanceMatrix view_projection = playerViewProjection({0, 0}, 0.1f, 0, 0, aspect);
+		auto translation = [](float x, float z) {
+			return InstanceMatrix{{{1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0}, {x, 0, z, 1}}};
+		};
+		// Buffer pixels from the left at world x, y = 0 and depth z.
+		auto screenX = [&](float x, float z) {
+			float clip_x = x * view_projection.m[0][0] + z * view_projection.m[2][0] + view_projection.m[3][0];
+			float clip_w = x * view_projection.m[0][3] + z * view_projection.m[2][3] + view_projection.m[3][3];
+			return (clip_x / clip_w + 1) * OCCLUSION_WIDTH * 0.5f;
+		};
+		OcclusionBuffer buffer;
+		size_t shown = 0, culled = 0, hidden = 0;
+		for (int shift = 0; shift < 16; shift++) {
+			const float wall_x = shift * 0.004f;
+			const InstanceMatrix wall = translation(wall_x, wall_z);
+			buffer.render(view_projection, wall_bounds, std::span(&wall, 1));
+			// The right end of the wall's front face and of the pillar's, at its near side.
+			const float edge = screenX(wall_x + wall_bounds.max.x, wall_z + wall_bounds.min.z);
+			const float pillar_near = pillar_z + pillar_bounds.min.z;
+			const float per_unit = screenX(1, pillar_near) - screenX(0, pillar_near);
+			for (float past : {-3.0f, 0.1f, 0.2f, 0.3f, 0.4f}) {
+				const float center_x = (edge + past - screenX(0, pillar_near)) / per_unit - pillar_bounds.max.x;
+				const InstanceMatrix pillar = translation(center_x, pillar_z);
+				const bool occluded = buffer.occluded(pillar_bounds, pillar) || buffer.occludedReference(pillar_bounds, pillar);
+				if (past < 0) {
+					hidden += occluded;
+				}
+				else {
+					shown++;
+					culled += occluded;
+				}
+			}
+		}
+		if (culled) {
+			report.fail("occlusion culls " + std::to_string(culled) + " of " + std::to_string(shown) + " pillars showing past a wall by less than a pixel");
+		}
+		if (hidden != 16) {
+			report.fail("occlusion keeps " + std::to_string(16 - hidden) + " of 16 pillars hidden behind a wall");
+		}
+	}
+
+	// Rasterizes the walls near random cameras as occluders and tests what
+	// the frustum keeps against them. The threaded SIMD buffer must be the
+	// same as the scalar one, the tiled test must drop the same instances as
+	// the per-pixel one, and along rays through pixel centers the buffer must
+	// hold the depth of the first wall a raycast hits, never a nearer one.
+	void benchOcclusion(const BenchOptions& options, BenchReport& report) {
+		static constexpr MazeMeshes meshes = makeMazeMeshes(BENCH_LENGTH, BENCH_WIDTH, BENCH_HEIGHT);
+		const Aabb kind_bounds[3] = {meshBounds(meshes.cuboid), meshBounds(meshes.hexprism), meshBounds(meshes.floor)};
+		constexpr float aspect = 16.f / 9, eye_height = 0.1f;
+		checkOcclusionEdges(kind_bounds[0], kind_bounds[1], report);
+		for (int side_edges : options.sizes) {
+			Maze maze = getMaze(BENCH_LENGTH, BENCH_WIDTH, BENCH_HEIGHT, side_edges, options.seed);
+			const MazeInstances instances = mazeInstances(maze, meshes);
+			const size_t kind_start[4] = {0, instances.cuboids, instances.cuboids + instances.hexprisms, instances.matrices.size()};
+			CollisionWorld world = mazeCollisionWorld(maze.transformations_cuboid, maze.transformations_hexprism);
+
+			// What the frustum keeps from every camera, and the walls near it as occluders.
+			struct Pose {
+				Vector2 eye;
+				float rot_y;
+				InstanceMatrix view_projection;
+				std::vector<InstanceMatrix> visible[3];
+				std::vector<InstanceMatrix> occluders;
+			};
+			std::vector<Pose> poses;
+			size_t frustum_visible = 0;
+			for (auto& p : randomMazePoints(side_edges, OCCLUSION_BENCH_POSES * 2, options.seed)) {
+				if (poses.size() == OCCLUSION_BENCH_POSES || world.collidesWithCircle(p, 0.05f)) {
+					continue;
+				}
+				Pose pose = {p, float(poses.size()) * 2.4f, {}, {}, {}};
+				pose.view_projection = playerViewProjection(p, eye_height, pose.rot_y, 0, aspect);
+				auto planes = cullPlanes(pose.view_projection, CULL_BENCH_FOG);
+				for (int k = 0; k < 3; k++) {
+					pose.visible[k].resize(kind_start[k + 1] - kind_start[k]);
+					pose.visible[k].resize(cullInstances(instances.bounds, planes, kind_start[k], kind_start[k + 1],
+						instances.matrices.data(), pose.visible[k].data()));
+					frustum_visible += pose.visible[k].size();
+				}
+				for (auto& m : pose.visible[0]) {
+					if ((Vector2{m.m[3][0], m.m[3][2]} - p).abs() < OCCLUSION_BENCH_DISTANCE) {
+						pose.occluders.push_back(m);
+					}
+				}
+				poses.push_back(std::move(pose));
+			}
+
+			for (int threads : options.threads) {
+				OcclusionBuffer buffer(OCCLUSION_WIDTH, OCCLUSION_HEIGHT, threads);
+				double seconds;
+				size_t frames = timedLoop(poses.size(), options.min_time, seconds, [&](size_t i) {
+					buffer.render(poses[i].view_projection, kind_bounds[0], poses[i].occluders);
+				});
+				report.add({"occlusion_render", side_edges, threads, frames, seconds});
+			}
+
+			OcclusionBuffer buffer(OCCLUSION_WIDTH, OCCLUSION_HEIGHT, options.threads.empty() ? 1 : options.threads.back());
+			OcclusionBuffer reference(OCCLUSION_WIDTH, OCCLUSION_HEIGHT, 1);
+			std::vector<InstanceMatrix> out;
+			size_t tested = 0, kept = 0;
+			double test_seconds = 0;
+			size_t buffer_mismatches = 0, set_mismatches = 0, nearer = 0, missing = 0, rays = 0;
+			const float tan_y = std::tan(PLAYER_FOV_Y / 2);
+			for (auto& pose : poses) {
+				buffer.render(pose.view_projection, kind_bounds[0], pose.occluders);
+				reference.renderScalar(pose.view_projection, kind_bounds[0], pose.occluders);
+				for (int y = 0; y < OCCLUSION_HEIGHT; y++) {
+					for (int x = 0; x < OCCLUSION_WIDTH; x++) {
+						buffer_mismatches += buffer.depthAt(x, y) != reference.depthAt(x, y);
+					}
+				}
+
+				auto start = bench_clock::now();
+				for (int k = 0; k < 3; k++) {
+					out.resize(pose.visible[k].size());
+					kept += buffer.cull(kind_bounds[k], pose.visible[k], out.data());
+					tested += pose.visible[k].size();
+				}
+				test_seconds += secondsSince(start);
+				for (int k = 0; k < 3; k++) {
+					for (auto& m : pose.visible[k]) {
+						set_mismatches += buffer.occluded(kind_bounds[k], m) != reference.occludedReference(kind_bounds[k], m);
+					}
+				}
+
+				// Rays through the centers of the two rows at the horizon stay below the wall tops for a while.
+				const float cy = std::cos(pose.rot_y), sy = std::sin(pose.rot_y);
+				for (int y = OCCLUSION_HEIGHT / 2 - 1; y <= OCCLUSION_HEIGHT / 2; y++) {
+					for (int x = 0; x < OCCLUSION_WIDTH; x++) {
+						float vx = ((x + 0.5f) / OCCLUSION_WIDTH * 2 - 1) * tan_y * aspect;
+						float vy = (1 - (y + 0.5f) / OCCLUSION_HEIGHT * 2) * tan_y;
+						Vector2 d = {cy * vx - sy, sy * vx + cy};
+						RayHit hit = world.raycast({pose.eye, d.normUnit(), OCCLUSION_BENCH_DISTANCE * 2});
+						float view_depth = hit.distance / d.abs();
+						float height = eye_height + view_depth * vy;
+						if (!hit.hit() || height <= 0 || height >= BENCH_HEIGHT) {
+							continue;
+						}
+						rays++;
+						float expected = 1 / view_depth, got = buffer.depthAt(x, y);
+						nearer += got > expected * 1.001f;
+						missing += hit.shape == RayShape::Rectangle && hit.distance < OCCLUSION_BENCH_DISTANCE - BENCH_LENGTH && got < expected * 0.999f;
+					}
+				}
+			}
+			report.add({"occlusion_test", side_edges, 1, tested, test_seconds});
+			fprintf(stderr, "  %.1f instances in the frustum per frame, %.1f after occlusion, %zu rays checked\n",
+				double(frustum_visible) / poses.size(), double(kept) / poses.size(), rays);
+			if (buffer_mismatches) {
+				report.fail("SIMD and scalar occlusion buffers differ in " + std::to_string(buffer_mismatches) + " pixels");
+			}
+			if (set_mismatches) {
+				report.fail("tiled and per-pixel occlusion tests disagree on " + std::to_string(set_mismatches) + " instances");
+			}
+			if (nearer || missing) {
+				report.fail("occlusion depth is nearer than the first wall on " + std::to_string(nearer) + " rays and misses a near wall on "
+					+ std::to_string(missing));
+			}
+		}
+	}
+
+	constexpr size_t PVS_BENCH_LOOKUPS = 1 << 14;
+	constexpr size_t PVS_BENCH_RAYS = 4096;
+
+	// Builds the sets of every cell, then looks up and decodes the set under
+	// random points. Rays from random points must only hit walls and pillars
+	// in the set of the cell they start in.
+	void benchPvs(const BenchOptions& options, BenchReport& report) {
+		static constexpr MazeMeshes meshes = makeMazeMeshes(BENCH_LENGTH, BENCH_WIDTH, BENCH_HEIGHT);
+		const Aabb floor_bounds = meshBounds(meshes.floor);
+		for (int side_edges : options.sizes) {
+			Maze maze = getMaze(BENCH_LENGTH, BENCH_WIDTH, BENCH_HEIGHT, side_edges, options.seed);
+			auto build = [&](int threads) {
+				return std::make_unique<MazePvs>(maze.graph, maze.transformations_cuboid, maze.transformations_hexprism,
+					maze.transformations_floor, floor_bounds, BENCH_LENGTH, BENCH_WIDTH, threads);
+			};
+			std::unique_ptr<MazePvs> pvs;
+			for (int threads : options.threads) {
+				auto start = bench_clock::now();
+				pvs = build(threads);
+				report.add({"pvs_build", side_edges, threads, size_t(pvs->cellCount()), secondsSince(start)});
+			}
+			if (!pvs) {
+				pvs = build(1);
+			}
+			PvsStats stats = pvs->stats();
+			fprintf(stderr, "  %zu cells see %.1f of %zu instances on average (%.3f%%), at most %zu\n",
+				stats.cells, stats.mean_visible, stats.instances, 100 * stats.mean_visible / stats.instances, stats.max_visible);
+			fprintf(stderr, "  %.2f MB encoded, %.2f MB as lists, %.2f MB as bitsets\n",
+				stats.bytes / 1e6, stats.list_bytes / 1e6, stats.bitset_bytes / 1e6);
+
+			auto points = randomMazePoints(side_edges, PVS_BENCH_LOOKUPS, options.seed);
+			PvsSets sets;
+			size_t decoded = 0;
+			double seconds;
+			size_t lookups = timedLoop(points.size(), options.min_time, seconds, [&](size_t i) {
+				int cell = pvs->cellAt(points[i]);
+				if (cell != NAV_NO_CELL) {
+					pvs->visible(cell, sets);
+					decoded += sets.walls.size() + sets.pillars.size() + sets.floors.size();
+				}
+			});
+			report.add({"pvs_lookup", side_edges, 1, lookups, seconds});
+			fprintf(stderr, "  %zu instances decoded\n", decoded);
+
+			CollisionWorld world = mazeCollisionWorld(maze.transformations_cuboid, maze.transformations_hexprism);
+			auto origins = randomMazePoints(side_edges, PVS_BENCH_RAYS + 1, options.seed + 1);
+			size_t misses = 0;
+			for (size_t i = 0; i < PVS_BENCH_RAYS; i++) {
+				int cell = pvs->cellAt(origins[i]);
+				Vector2 d = origins[i + 1] - origins[i];
+				if (cell == NAV_NO_CELL || world.collidesWithCircle(origins[i], 0) || d.abs() == 0) {
+					continue;
+				}
+				RayHit hit = world.raycast({origins[i], d.normUnit(), 1e6f});
+				if (!hit.hit()) {
+					continue;
+				}
+				pvs->visible(cell, sets);
+				auto& kind = hit.shape == RayShape::Rectangle ? sets.walls : sets.pillars;
+				misses += std::find(kind.begin(), kind.end(), hit.index) == kind.end();
+			}
+			if (misses) {
+				report.fail("rays hit " + std::to_string(misses) + " instances outside the PVS of their cell");
+			}
+		}
+	}
+
+	constexpr size_t PORTAL_BENCH_POSES = 256;
+	constexpr size_t PORTAL_BENCH_RAYS = 4096;
+	constexpr size_t PORTAL_BENCH_EDITS = 256;
+
+	bool inWedge(const ViewWedge& wedge, Vector2 d) {
+		d = d.normUnit();
+		return wedge.full || (cross(wedge.from, d) >= -1e-4f && cross(d, wedge.to) >= -1e-4f);
+	}
+
+	// Per frame cost of portal culling, the traversal plus the frustum cull of
+	// what it reaches, against culling every instance. Rays from random
+	// cameras inside their view wedge must only hit walls and pillars the
+	// traversal reaches, also after opening walls and closing open edges.
+	void benchPortals(const BenchOptions& options, BenchReport& report) {
+		static constexpr MazeMeshes meshes = makeMazeMeshes(BENCH_LENGTH, BENCH_WIDTH, BENCH_HEIGHT);
+		const Aabb floor_bounds = meshBounds(meshes.floor);
+		constexpr float aspect = 16.f / 9;
+		for (int side_edges : options.sizes) {
+			Maze maze = getMaze(BENCH_LENGTH, BENCH_WIDTH, BENCH_HEIGHT, side_edges, options.seed);
+			auto start = bench_clock::now();
+			MazePortals portals(maze.graph, maze.transformations_cuboid, maze.transformations_hexprism,
+				maze.transformations_floor, floor_bounds, BENCH_LENGTH, BENCH_WIDTH);
+			report.add({"portals_build", side_edges, 1, size_t(portals.cellCount()), secondsSince(start)});
+
+			const MazeInstances instances = mazeInstances(maze, meshes);
+			const std::vector<InstanceMatrix>& matrices = instances.matrices;
+			const InstanceBounds& bounds = instances.bounds;
+
+			auto points = randomMazePoints(side_edges, PORTAL_BENCH_POSES, options.seed);
+			std::vector<std::array<Plane, CULL_PLANES>> planes(points.size());
+			std::vector<ViewWedge> wedges(points.size());
+			for (size_t i = 0; i < points.size(); i++) {
+				const float rot_y = float(i) * 2.4f, rot_up_down = float(i % 7) * 0.1f - 0.3f;
+				planes[i] = cullPlanes(playerViewProjection(points[i], 0.1f, rot_y, rot_up_down, aspect), CULL_BENCH_FOG);
+				wedges[i] = playerViewWedge(rot_y, rot_up_down, aspect);
+			}
+
+			std::vector<InstanceMatrix> out(matrices.size());
+			size_t visible = 0;
+			double seconds;
+			size_t frames = timedLoop(points.size(), options.min_time, seconds, [&](size_t i) {
+				visible += cullInstances(bounds, planes[i], 0, matrices.size(), matrices.data(), out.data());
+			});
+			report.add({"frustum_frame", side_edges, 1, frames, seconds});
+			fprintf(stderr, "  frustum: %.1f instances drawn per frame\n", double(visible) / frames);
+
+			PvsSets sets;
+			PortalStats totals;
+			visible = 0;
+			frames = timedLoop(points.size(), options.min_time, seconds, [&](size_t i) {
+				PortalStats stats = portals.visible(points[i], wedges[i], CULL_BENCH_FOG, sets);
+				totals.cells += stats.cells;
+				totals.visits += stats.visits;
+				totals.portals += stats.portals;
+				for (auto& p : sets.pillars) {
+					p += uint32_t(instances.cuboids);
+				}
+				for (auto& f : sets.floors) {
+					f += uint32_t(instances.cuboids + instances.hexprisms);
+				}
+				size_t drawn = cullInstancesAt(bounds, planes[i], sets.walls, matrices.data(), out.data());
+				drawn += cullInstancesAt(bounds, planes[i], sets.pillars, matrices.data(), out.data() + drawn);
+				visible += drawn + cullInstancesAt(bounds, planes[i], sets.floors, matrices.data(), out.data() + drawn);
+			});
+			report.add({"portal_frame", side_edges, 1, frames, seconds});
+			fprintf(stderr, "  portals: %.1f cells reached through %.1f portals, %.1f instances drawn per frame\n",
+				double(totals.cells) / frames, double(totals.portals) / frames, double(visible) / frames);
+
+			// The wedge has to hold every point the frustum keeps, checked at wall height.
+			std::mt19937 rng(options.seed);
+			std::uniform_real_distribution<float> unit(0, 1);
+			size_t outside = 0;
+			for (size_t i = 0; i < PORTAL_BENCH_POSES; i++) {
+				const float rot_y = unit(rng) * 6.3f, rot_up_down = unit(rng) * 3.0f - 1.5f;
+				InstanceMatrix view_projection = playerViewProjection({0, 0}, 0, rot_y, rot_up_down, aspect);
+				ViewWedge wedge = playerViewWedge(rot_y, rot_up_down, aspect);
+				for (int j = 0; j < 256; j++) {
+					float p[4] = {unit(rng) * 20 - 10, unit(rng) - 0.5f, unit(rng) * 20 - 10, 1}, clip[4] = {};
+					for (int c = 0; c < 4; c++) {
+						for (int r = 0; r < 4; r++) {
+							clip[c] += p[r] * view_projection.m[r][c];
+						}
+					}
+					bool in_frustum = std::abs(clip[0]) <= clip[3] && std::abs(clip[1]) <= clip[3] && clip[2] >= 0 && clip[2] <= clip[3];
+					outside += in_frustum && !inWedge(wedge, {p[0], p[2]});
+				}
+			}
+			if (outside) {
+				report.fail(std::to_string(outside) + " points in the frustum are outside the view wedge");
+			}
+
+			// Walls of the collision world, with the index of the instance each one is.
+			std::vector<CuboidTransformation> walls = maze.transformations_cuboid;
+			std::vector<uint8_t> open(walls.size());
+			auto checkRays = [&](const char* when) {
+				std::vector<CuboidTransformation> closed;
+				std::vector<uint32_t> world_walls;
+				for (uint32_t i = 0; i < walls.size(); i++) {
+					if (!open[i]) {
+						closed.push_back(walls[i]);
+						world_walls.push_back(i);
+					}
+				}
+				CollisionWorld world = mazeCollisionWorld(closed, maze.transformations_hexprism);
+				auto origins = randomMazePoints(side_edges, PORTAL_BENCH_RAYS, options.seed + 1);
+				size_t misses = 0;
+				for (auto& origin : origins) {
+					if (portals.cellAt(origin) == NAV_NO_CELL || world.collidesWithCircle(origin, 0)) {
+						continue;
+					}
+					ViewWedge wedge = playerViewWedge(unit(rng) * 6.3f, unit(rng) * 2.0f - 1.0f, aspect);
+					float t = unit(rng), angle = unit(rng) * 6.3f;
+					Vector2 d = wedge.full ? Vector2{std::cos(angle), std::sin(angle)} : (wedge.from * (1 - t) + wedge.to * t).normUnit();
+					RayHit hit = world.raycast({origin, d, 1e6f});
+					if (!hit.hit()) {
+						continue;
+					}
+					portals.visible(origin, wedge, 1e6f, sets);
+					uint32_t index = hit.shape == RayShape::Rectangle ? world_walls[hit.index] : hit.index;
+					auto& kind = hit.shape == RayShape::Rectangle ? sets.walls : sets.pillars;
+					misses += std::find(kind.begin(), kind.end(), index) == kind.end();
+				}
+				if (misses) {
+					report.fail(std::string("rays ") + when + " hit " + std::to_string(misses) + " instances the portals do not reach");
+				}
+			};
+			checkRays("before edits");
+
+			// Opens random inner walls and closes as many open edges with new walls.
+			std::vector<edge> open_edges;
+			const int side = maze.graph.side();
+			const node directions[3] = {{1, 0}, {0, 1}, {-1, 1}};
+			for (int y = 0; y < side; y++) {
+				for (int x = 0; x < side; x++) {
+					for (int dir = 0; dir < 3; dir++) {
+						edge e = {{x, y}, {x + directions[dir].x, y + directions[dir].y}};
+						if (isPartOfHex(x, y, side_edges) && isPartOfHex(e.n2.x, e.n2.y, side_edges) && !maze.graph.hasWall(x, y, dir)) {
+							open_edges.push_back(e);
+						}
+					}
+				}
+			}
+			std::shuffle(open_edges.begin(), open_edges.end(), rng);
+			open_edges.resize(std::min(open_edges.size(), PORTAL_BENCH_EDITS));
+			size_t opened = 0;
+			for (size_t tries = 0; opened < PORTAL_BENCH_EDITS && tries < walls.size(); tries++) {
+				uint32_t i = uint32_t(rng() % walls.size());
+				edge e = cuboidToEdge(walls[i], BENCH_LENGTH, BENCH_WIDTH);
+				if (!open[i] && !isBorderEdge(e, side_edges)) {
+					open[i] = 1;
+					portals.setWall(e.n1, e.n2, PORTAL_NO_WALL);
+					opened++;
+				}
+			}
+			for (auto& e : open_edges) {
+				portals.setWall(e.n1, e.n2, uint32_t(walls.size()));
+				walls.push_back(edgeToCuboid(e, BENCH_LENGTH, BENCH_WIDTH));
+				open.push_back(0);
+			}
+			checkRays("after edits");
+
+			size_t toggles = timedLoop(open_edges.size(), options.min_time, seconds, [&](size_t i) {
+				portals.setWall(open_edges[i].n1, open_edges[i].n2, i % 2 ? uint32_t(instances.cuboids + i) : PORTAL_NO_WALL);
+			});
+			report.add({"portal_edit", side_edges, 1, toggles, seconds});
+		}
+	}
+
+	constexpr size_t NAV_BENCH_AGENTS = 10000;
+	constexpr size_t NAV_BENCH_TARGETS = 16;
+
+	// Builds the fields for a set of targets, then moves 10k agents along them
+	// by looking up their cell and reading the next step. Try --sizes 500.
+	void benchFlowField(const BenchOptions& options, BenchReport& report) {
+		for (int side_edges : options.sizes) {
+			Maze maze = getMaze(BENCH_LENGTH, BENCH_WIDTH, BENCH_HEIGHT, side_edges, options.seed);
+			MazeNav nav(maze.graph, BENCH_LENGTH, BENCH_WIDTH);
+
+			std::vector<int> targets, agents;
+			for (auto& p : randomMazePoints(side_edges, NAV_BENCH_AGENTS * 2, options.seed)) {
+				int cell = nav.cellAt(p);
+				if (cell == NAV_NO_CELL) {
+					continue;
+				}
+				if (targets.size() < NAV_BENCH_TARGETS) {
+					targets.push_back(cell);
+				}
+				else if (agents.size() < NAV_BENCH_AGENTS) {
+					agents.push_back(cell);
+				}
+			}
+
+			FlowFieldCache cache(nav, NAV_BENCH_TARGETS);
+			for (int threads : options.threads) {
+				FlowFieldCache cold(nav, NAV_BENCH_TARGETS);
+				auto start = bench_clock::now();
+				cold.build(targets, threads);
+				report.add({"flow_field_build", side_edges, threads, targets.size(), secondsSince(start)});
+			}
+			cache.build(targets);
+			std::vector<std::shared_ptr<const FlowField>> fields;
+			for (int target : targets) {
+				fields.push_back(cache.get(target));
+			}
+
+			std::vector<Vector2> positions(agents.size());
+			for (size_t i = 0; i < agents.size(); i++) {
+				positions[i] = nav.cellCenter(agents[i]);
+			}
+			size_t arrived = 0;
+			double seconds;
+			size_t steps = timedLoop(1 << 20, options.min_time, seconds, [&](size_t) {
+				for (size_t i = 0; i < positions.size(); i++) {
+					const FlowField& field = *fields[i % fields.size()];
+					int cell = nav.cellAt(positions[i]);
+					int next = nav.nextCell(field, cell);
+					arrived += next == cell;
+					positions[i] = nav.cellCenter(next);
+				}
+			});
+			report.add({"flow_field_agents", side_edges, 1, steps * positions.size(), seconds});
+			fprintf(stderr, "  %zu agents, %zu steps, %zu agent steps at the target\n", positions.size(), steps, arrived);
+		}
+	}
+
+	// 255 quads a side is the largest grid 16-bit indices can address.
+	constexpr int MESH_BENCH_MAX_GRID = 255;
+
+	// Triangles of an indexed mesh, each starting at its smallest vertex and
+	// sorted, so meshes with the same triangles in any order compare equal.
+	std::vector<std::array<vertex_t, 3>> sortedTriangles(const IndexedMesh& mesh) {
+		auto less = [](const vertex_t& a, const vertex_t& b) { return memcmp(&a, &b, sizeof(vertex_t)) < 0; };
+		std::vector<std::array<vertex_t, 3>> res;
+		for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+			std::array<vertex_t, 3> t = {mesh.vertices[mesh.indices[i]], mesh.vertices[mesh.indices[i + 1]], mesh.vertices[mesh.indices[i + 2]]};
+			std::rotate(t.begin(), std::min_element(t.begin(), t.end(), less), t.end());
+			res.push_back(t);
+		}
+		std::sort(res.begin(), res.end(), [](const auto& a, const auto& b) { return memcmp(a.data(), b.data(), sizeof(a)) < 0; });
+		return res;
+	}
+
+	bool sameTriangles(const IndexedMesh& a, const IndexedMesh& b) {
+		auto ta = sortedTriangles(a), tb = sortedTriangles(b);
+		return ta.size() == tb.size() && memcmp(ta.data(), tb.data(), ta.size() * sizeof(ta[0])) == 0;
+	}
+
+	// Builds the indexed maze meshes and a grid of side_edges quads with its
+	// triangles shuffled, and reports the ACMR of the unindexed list, the
+	// welded mesh and the optimized one. The optimized mesh has to draw the
+	// same triangles, with the same winding, and miss the cache no more often.
+	void benchMeshOptimize(const BenchOptions& options, BenchReport& report) {
+		static constexpr MazeMeshes meshes = makeMazeMeshes(BENCH_LENGTH, BENCH_WIDTH, BENCH_HEIGHT);
+		auto check = [&](const char* name, std::span<const vertex_t> triangles) {
+			IndexedMesh welded = weldVertices(triangles);
+			IndexedMesh optimized = buildIndexedMesh(triangles);
+			float welded_acmr = averageCacheMissRatio(welded.indices, welded.vertices.size());
+			float optimized_acmr = averageCacheMissRatio(optimized.indices, optimized.vertices.size());
+			fprintf(stderr, "  %s: %zu -> %zu vertices, ACMR 3.00 unindexed, %.3f welded, %.3f optimized\n",
+				name, triangles.size(), optimized.vertices.size(), welded_acmr, optimized_acmr);
+			bool in_range = std::all_of(optimized.indices.begin(), optimized.indices.end(), [&](uint16_t i) { return i < optimized.vertices.size(); });
+			if (!in_range || welded.indices.size() != triangles.size() || !sameTriangles(welded, optimized)) {
+				report.fail(std::string(name) + " indexed mesh draws different triangles");
+			}
+			if (optimized_acmr > welded_acmr) {
+				report.fail(std::string(name) + " ACMR got worse with the optimized order");
+			}
+		};
+		check("cuboid", meshes.cuboid);
+		check("hexprism", meshes.hexprism);
+		check("floor", meshes.floor);
+
+		for (int side_edges : options.sizes) {
+			const int side = std::min(side_edges, MESH_BENCH_MAX_GRID);
+			std::vector<std::array<vertex_t, 3>> quads;
+			auto corner = [&](int x, int y) {
+				return vertex_t{{float(x), 0, float(y)}, {0, 1, 0}, {1, 1, 1, 1}, {float(x) / side, float(y) / side}};
+			};
+			for (int y = 0; y < side; y++) {
+				for (int x = 0; x < side; x++) {
+					quads.push_back({corner(x, y), corner(x, y + 1), corner(x + 1, y + 1)});
+					quads.push_back({corner(x, y), corner(x + 1, y + 1), corner(x + 1, y)});
+				}
+			}
+			std::mt19937 rng(options.seed);
+			std::shuffle(quads.begin(), quads.end(), rng);
+			std::span<const vertex_t> triangles(quads.front().data(), quads.size() * 3);
+
+			auto start = bench_clock::now();
+			buildIndexedMesh(triangles);
+			report.add({"mesh_optimize", side_edges, 1, quads.size(), secondsSince(start)});
+			check(("grid " + std::to_string(side) + "x" + std::to_string(side)).c_str(), triangles);
+		}
+	}
+
+	struct Benchmark {
+		const char* name;
+		void (*run)(const BenchOptions&, BenchReport&);
+	};
+
+	const Benchmark benchmarks[] = {
+		{"generate", benchGenerate},
+		{"generate_parallel", benchGenerateParallel},
+		{"generate_eller", benchGenerateEller},
+		{"instance_matrices", benchInstanceMatrices},
+		{"collides_with", benchCollidesWith},
+		{"collision_kernels", benchCollisionKernels},
+		{"support", benchSupport},
+		{"dynamic_objects", benchDynamicObjects},
+		{"agents", benchAgents},
+		{"bvh", benchBvh},
+		{"gjk", benchGjk},
+		{"merge_walls", benchMergeWalls},
+		{"maze_file", benchMazeFile},
+		{"chunks", benchChunks},
+		{"flow_field", benchFlowField},
+		{"raycast", benchRaycast},
+		{"swept", benchSwept},
+		{"culling", benchCulling},
+		{"occlusion", benchOcclusion},
+		{"pvs", benchPvs},
+		{"portals", benchPortals},
+		{"mesh_optimize", benchMeshOptimize},
+	};
+
+	std::vector<std::string> splitList(const char* arg) {
+		std::vector<std::string> res;
+		std::stringstream ss(arg);
+		std::string item;
+		while (std::getline(ss, item, ',')) {
+			res.push_back(item);
+		}
+		return res;
+	}
+
+	std::vector<int> splitInts(const char* arg) {
+		std::vector<int> res;
+		for (auto& item : splitList(arg)) {
+			res.push_back(std::atoi(item.c_str()));
+		}
+		return res;
+	}
+}
+
+int main(int argc, char** argv) {
+	BenchOptions options;
+	for (int i = 1; i < argc; i++) {
+		const char* arg = argv[i];
+		const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+		if (value == nullptr) {
+			fprintf(stderr, "Missing value for %s\n", arg);
+			return 1;
+		}
+		if (!strcmp(arg, "--sizes")) {
+			options.sizes = splitInts(value);
+		}
+		else if (!strcmp(arg, "--threads")) {
+			options.threads = splitInts(value);
+		}
+		else if (!strcmp(arg, "--seed")) {
+			options.seed = std::atoi(value);
+		}
+		else if (!strcmp(arg, "--time")) {
+			options.min_time = std::atof(value);
+		}
+		else if (!strcmp(arg, "--format")) {
+			options.format = value;
+		}
+		else if (!strcmp(arg, "--only")) {
+			options.only = splitList(value);
+		}
+		else {
+			fprintf(stderr, "Unknown option %s\n", arg);
+			return 1;
+		}
+		i++;
+	}
+
+	BenchReport report;
+	for (auto& benchmark : benchmarks) {
+		if (!options.only.empty() && std::find(options.only.begin(), options.only.end(), benchmark.name) == options.only.end()) {
+			continue;
+		}
+		benchmark.run(options, report);
+	}
+	report.print(options.format);
+	return report.failed() ? 1 : 0;
+}
@@ -4,6 +4,9 @@
 #include <wincodec.h>
 #include <wrl.h>
 #include <utility>
+#include <memory>
+#include <span>
+#include <algorithm>
 #include <cmath>
 #include <exception>
 #include <stdexcept>
@@ -13,6 +16,15 @@
 #include "base.hpp"
 #include "maze.hpp"
 #include "mazephysics.hpp"
+#include "collisionworld.hpp"
+#include "mazechunks.hpp"
+#include "mazefile.hpp"
+#include "instances.hpp"
+#include "culling.hpp"
+#include "indexedmesh.hpp"
+#include "mazeportals.hpp"
+#include "mazepvs.hpp"
+#include "occlusion.hpp"
 #include "global_state.hpp"
 #include "bitmap.hpp"
 
@@ -35,6 +47,7 @@ struct vs_const_buffer_t {
 	XMFLOAT4 padding;
 };
 static_assert(sizeof(vs_const_buffer_t) == 256);
+static_assert(sizeof(InstanceMatrix) == sizeof(XMFLOAT4X4));
 
 inline void ThrowIfFailed(HRESULT hr) {
 	if (FAILED(hr)) {
@@ -72,6 +85,8 @@ namespace {
 
 	ComPtr<ID3D12Resource> vertexBuffer;
 	D3D12_VERTEX_BUFFER_VIEW vertexBufferView;
+	ComPtr<ID3D12Resource> indexBuffer;
+	D3D12_INDEX_BUFFER_VIEW indexBufferView;
 
 	ComPtr<ID3D12Resource> vsConstBuffer;
 	ComPtr<ID3D12Resource> texture_resource;
@@ -96,11 +111,12 @@ namespace {
 	constexpr size_t FLOOR_START_POSITION = CUBOID_VERTEX_COUNT + HEXPRISM_VERTEX_COUNT;
 	static_assert(VERTEX_COUNT % 3 == 0);
 
-	constexpr size_t NUM_TRIANGLES = VERTEX_COUNT / 3;
-
 	vertex_t triangle_data[VERTEX_COUNT];
 
-	constexpr size_t VERTEX_BUFFER_SIZE = sizeof(triangle_data);
+	// triangle_data welded and reordered for the vertex cache, what the
+	// vertex and index buffers hold.
+	IndexedMesh mesh_data;
+	MeshRange cuboid_range, hexprism_range, floor_range;
 
 
 	size_t NUM_HEXPRISM_INSTANCES;
@@ -112,16 +128,90 @@ namespace {
 	size_t FLOOR_INSTANCE_DATA_START;
 
 	constinit size_t const MAX_NUM_INSTANCES = 65536;
-	XMFLOAT4X4 instance_matrices[MAX_NUM_INSTANCES];
+	InstanceMatrix instance_matrices[MAX_NUM_INSTANCES];
 	
 	constinit const size_t INSTANCE_BUFFER_SIZE = sizeof(instance_matrices);
 
 	ComPtr<ID3D12Resource> instance_buffer = nullptr;
 	D3D12_VERTEX_BUFFER_VIEW instance_buffer_view = {};
 
+	// Bounds of the instances in instance_matrices. Every frame the visible
+	// ones are copied to the same ranges of the instance buffer, compacted.
+	InstanceBounds instance_bounds;
+	Aabb cuboid_bounds, hexprism_bounds, floor_bounds;
+	InstanceMatrix view_projection;
+	// Distance at which PixelShader.hlsl fogs everything to the clear color.
+	constexpr float FOG_DISTANCE = 30;
+
+	// Instances visible from each cell of the maze, valid below the top of the
+	// walls. The set of the player's cell is decoded when the cell changes.
+	std::unique_ptr<MazePvs> pvs;
+	float wall_top = 0;
+	int pvs_cell = NAV_NO_CELL;
+	// Clips the view through the open edges of the maze every frame instead of
+	// using the precomputed sets, for when walls are opened or closed at runtime.
+	constexpr bool PORTAL_CULLING = false;
+	std::unique_ptr<MazePortals> portals;
+	// Set of the player's cell or what the portals reach, as indices of instance_matrices.
+	PvsSets visible_sets;
+
+	// Instances that passed the frustum, compacted per kind within the range
+	// they came from, before the occlusion test copies them to the instance buffer.
+	InstanceMatrix frustum_visible[MAX_NUM_INSTANCES];
+	struct VisibleRange {
+		size_t start, cuboids, hexprisms, floors;
+	};
+	// Walls nearer than OCCLUDER_DISTANCE are drawn into a CPU depth buffer
+	// every frame, and instances behind it are not drawn.
+	constexpr bool OCCLUSION_CULLING = true;
+	constexpr float OCCLUDER_DISTANCE = 12;
+	std::unique_ptr<OcclusionBuffer> occlusion;
+	std::vector<InstanceMatrix> occluders;
+
+
+	CollisionWorld collision_world;
+
+	// Unbounded maze streamed in chunks around the player instead of a single getMaze maze.
+	constexpr bool CHUNKED_WORLD = false;
+	constexpr int CHUNK_EDGES = 32;
+	constexpr size_t CHUNK_SLOTS = 9;
+	constexpr size_t CHUNK_SLOT_SIZE = MAX_NUM_INSTANCES / CHUNK_SLOTS;
+
+	// Resident chunk and its fixed range in the instance buffer.
+	struct ChunkSlot {
+		std::shared_ptr<const MazeChunk> chunk;
+		size_t start;
+	};
+
+	std::unique_ptr<ChunkWorld> chunk_world;
+	ChunkSlot chunk_slots[CHUNK_SLOTS];
+	UINT8* instance_buffer_pointer;
 
-	ObjectHandler obj_handler;
+	bool chunkLoaded(Vector2 position) {
+		ChunkCoords coords = chunk_world->chunkAt(position);
+		for (auto& slot : chunk_slots) {
+			if (slot.chunk && slot.chunk->coords == coords) {
+				return true;
+			}
+		}
+		return false;
+	}
 
+	// Nearest hit over the loaded chunks.
+	RayHit chunksSweepCircle(const Ray& ray, float radius) {
+		RayHit nearest;
+		nearest.distance = ray.max_distance;
+		for (auto& slot : chunk_slots) {
+			if (!slot.chunk) {
+				continue;
+			}
+			RayHit hit = slot.chunk->collision.sweepCircle(ray, radius);
+			if (hit.hit() && (!nearest.hit() || hit.distance < nearest.distance)) {
+				nearest = hit;
+			}
+		}
+		return nearest;
+	}
 }
 
 namespace player_state {
@@ -142,19 +232,24 @@ namespace player_state {
 		rotY = fmodf(rotY, 3.14 * 2);
 	}
 
+	// One swept move per tick, sliding along the walls instead of stopping at them.
 	void move(float dx, float dy) {
-		auto new_position = position + 
-			Vector2{
-				cos(rotY) * dx - sin(rotY) * dy, 
-				sin(rotY) * dx + cos(rotY) * dy
-			};
-		
-		HexObj player = {{new_position}, 0.1};
-		if (obj_handler.collidesWith(player)) {
-			return;
-		}
+		constexpr float radius = 0.1;
+		Vector2 delta = {
+			cos(rotY) * dx - sin(rotY) * dy,
+			sin(rotY) * dx + cos(rotY) * dy
+		};
 
-		position = new_position;
+		if constexpr (CHUNKED_WORLD) {
+			SlideResult slide = slideWithSweeps(position, radius, delta, chunksSweepCircle);
+			// Chunks that are not generated yet are solid.
+			if (chunkLoaded(slide.position)) {
+				position = slide.position;
+			}
+		}
+		else {
+			position = collision_world.slideCircle(position, radius, delta).position;
+		}
 	}
 
 	void moveUp(float dz) {
@@ -170,7 +265,34 @@ void initTriangleAndInstanceData() {
 	constexpr float height = .5;
 	constexpr int side_edges = 30;
 
-	auto maze = getMaze(length, width, height, side_edges, 1);
+	Maze generated;
+	MazeFile maze_file;
+	MazeView maze;
+	if constexpr (CHUNKED_WORLD) {
+		chunk_world = std::make_unique<ChunkWorld>(length, width, height, CHUNK_EDGES, 1);
+		generated = chunk_world->base();
+		maze = viewOf(generated);
+	}
+	else {
+		// Unit walls are drawn, the collision world merges its own copy below.
+		MazeFileKey key = {length, width, height, side_edges, 1, uint32_t(MazeGenerator::Kruskal), 0};
+		if (openOrCreateMazeFile(maze_file, "maze_cache.bin", key)) {
+			maze = maze_file.view();
+		}
+		else {
+			// Cache is not writable, generate on every launch.
+			generated = getMaze(length, width, height, side_edges, 1);
+			maze = viewOf(generated);
+		}
+	}
+
+	player_state::position = maze.player_coordinates;
+
+	// Built at compile time, the maze's own copies of the templates are not needed.
+	static constexpr MazeMeshes meshes = makeMazeMeshes(length, width, height);
+	std::copy(std::begin(meshes.cuboid), std::end(meshes.cuboid), triangle_data + CUBOID_START_POSITION);
+	std::copy(std::begin(meshes.hexprism), std::end(meshes.hexprism), triangle_data + HEXPRISM_START_POSITION);
+	std::copy(std::begin(meshes.floor), std::end(meshes.floor), triangle_data + FLOOR_START_POSITION);
 
 	// recalculate tex coords:
 	double brick_d = 640;
@@ -178,7 +300,7 @@ void initTriangleAndInstanceData() {
 	double full_d = brick_d + grass_d;
 	double full_h = 640;
 	
-	for (auto& floor_vertex : maze.floor) {
+	for (auto& floor_vertex : std::span(triangle_data + FLOOR_START_POSITION, FLOOR_VERTEX_COUNT)) {
 		assert(floor_vertex.tex_coord[0] >= 0 && floor_vertex.tex_coord[0] <= 1);
 		assert(floor_vertex.tex_coord[1] >= 0 && floor_vertex.tex_coord[1] <= 1);
 		
@@ -189,7 +311,7 @@ void initTriangleAndInstanceData() {
 		if (floor_vertex.tex_coord[0] < val_s) floor_vertex.tex_coord[0] = val_s;
 	}
 
-	for (auto& maze_vertex : maze.cuboid) {
+	for (auto& maze_vertex : std::span(triangle_data + CUBOID_START_POSITION, CUBOID_VERTEX_COUNT)) {
 		assert(maze_vertex.tex_coord[0] >= 0 && maze_vertex.tex_coord[0] <= 1);
 		assert(maze_vertex.tex_coord[1] >= 0 && maze_vertex.tex_coord[1] <= 1);
 		maze_vertex.tex_coord[0] *= brick_d / full_d;
@@ -200,7 +322,7 @@ void initTriangleAndInstanceData() {
 		assert(maze_vertex.tex_coord[0] >= 0 && maze_vertex.tex_coord[0] <= 1);
 		assert(maze_vertex.tex_coord[1] >= 0 && maze_vertex.tex_coord[1] <= 1);
 	}
-	for (auto& maze_vertex : maze.hexprism) {
+	for (auto& maze_vertex : std::span(triangle_data + HEXPRISM_START_POSITION, HEXPRISM_VERTEX_COUNT)) {
 //		assert(maze_vertex.tex_coord[0] >= 0 && maze_vertex.tex_coord[0] <= 1);
 		assert(maze_vertex.tex_coord[1] >= 0 && maze_vertex.tex_coord[1] <= 1);
 		maze_vertex.tex_coord[0] *= brick_d / full_d;
@@ -208,17 +330,26 @@ void initTriangleAndInstanceData() {
 		assert(maze_vertex.tex_coord[1] >= 0 && maze_vertex.tex_coord[1] <= 1);
 	}
 
+	cuboid_range = appendIndexedMesh(mesh_data, buildIndexedMesh(std::span(triangle_data + CUBOID_START_POSITION, CUBOID_VERTEX_COUNT)));
+	hexprism_range = appendIndexedMesh(mesh_data, buildIndexedMesh(std::span(triangle_data + HEXPRISM_START_POSITION, HEXPRISM_VERTEX_COUNT)));
+	floor_range = appendIndexedMesh(mesh_data, buildIndexedMesh(std::span(triangle_data + FLOOR_START_POSITION, FLOOR_VERTEX_COUNT)));
+
+	cuboid_bounds = meshBounds(meshes.cuboid);
+	hexprism_bounds = meshBounds(meshes.hexprism);
+	floor_bounds = meshBounds(meshes.floor);
+	instance_bounds.resize(MAX_NUM_INSTANCES);
+	// drawVisible renders and tests against it in chunked mode as well.
+	if constexpr (OCCLUSION_CULLING) {
+		occlusion = std::make_unique<OcclusionBuffer>(OCCLUSION_WIDTH, OCCLUSION_HEIGHT, 0);
+	}
 
-	player_state::position = maze.player_coordinates;
-
-	for(int i = 0; i < CUBOID_VERTEX_COUNT; i++)
-		triangle_data[i + CUBOID_START_POSITION] = maze.cuboid[i];
-
-	for(int i = 0; i < HEXPRISM_VERTEX_COUNT; i++)
-		triangle_data[i + HEXPRISM_START_POSITION] = maze.hexprism[i];
-
-	for(int i = 0; i < FLOOR_VERTEX_COUNT; i++)
-		triangle_data[i + FLOOR_START_POSITION] = maze.floor[i];
+	if constexpr (CHUNKED_WORLD) {
+		// Instances are written per chunk by updateChunks.
+		for (size_t i = 0; i < CHUNK_SLOTS; i++) {
+			chunk_slots[i].start = i * CHUNK_SLOT_SIZE;
+		}
+		return;
+	}
 
 	NUM_CUBOID_INSTANCES = maze.transformations_cuboid.size();
 	NUM_HEXPRISM_INSTANCES = maze.transformations_hexprism.size();
@@ -230,51 +361,94 @@ void initTriangleAndInstanceData() {
 
 	assert(NUM_CUBOID_INSTANCES + NUM_HEXPRISM_INSTANCES + NUM_FLOOR_INSTANCES < MAX_NUM_INSTANCES);
 
-	for (size_t k = 0;
-			k < NUM_CUBOID_INSTANCES;
-			++k) {
-		auto& trn = maze.transformations_cuboid[k];
-
-		XMStoreFloat4x4(
-			&instance_matrices[k + CUBOID_INSTANCE_DATA_START],
-			XMMatrixMultiply( 
-				XMMatrixRotationY(trn.rotation),
-				XMMatrixTranslation(trn.translation.x, 0, trn.translation.y)
-			)
+	storeCuboidMatrices(maze.transformations_cuboid, &instance_matrices[CUBOID_INSTANCE_DATA_START]);
+	storeTranslationMatrices(maze.transformations_hexprism, &instance_matrices[HEXPRISM_INSTANCE_DATA_START]);
+	storeTranslationMatrices(maze.transformations_floor, &instance_matrices[FLOOR_INSTANCE_DATA_START]);
+	instance_bounds.set(CUBOID_INSTANCE_DATA_START, cuboid_bounds, std::span(&instance_matrices[CUBOID_INSTANCE_DATA_START], NUM_CUBOID_INSTANCES));
+	instance_bounds.set(HEXPRISM_INSTANCE_DATA_START, hexprism_bounds, std::span(&instance_matrices[HEXPRISM_INSTANCE_DATA_START], NUM_HEXPRISM_INSTANCES));
+	instance_bounds.set(FLOOR_INSTANCE_DATA_START, floor_bounds, std::span(&instance_matrices[FLOOR_INSTANCE_DATA_START], NUM_FLOOR_INSTANCES));
+
+	wall_top = height;
+	if constexpr (PORTAL_CULLING) {
+		portals = std::make_unique<MazePortals>(
+			wallGraph(maze.transformations_cuboid, side_edges, length, width),
+			maze.transformations_cuboid, maze.transformations_hexprism, maze.transformations_floor,
+			floor_bounds, length, width
 		);
 	}
-
-	for (size_t k = 0;
-			k < NUM_HEXPRISM_INSTANCES;
-			++k) {
-		auto& trn = maze.transformations_hexprism[k];
-
-		XMStoreFloat4x4(
-			&instance_matrices[k + HEXPRISM_INSTANCE_DATA_START],
-			XMMatrixTranslation(trn.translation.x, 0, trn.translation.y)
+	else {
+		pvs = std::make_unique<MazePvs>(
+			wallGraph(maze.transformations_cuboid, side_edges, length, width),
+			maze.transformations_cuboid, maze.transformations_hexprism, maze.transformations_floor,
+			floor_bounds, length, width
 		);
 	}
 
-	for (size_t k = 0;
-			k < NUM_FLOOR_INSTANCES;
-			++k) {
-		auto& trn = maze.transformations_floor[k];
-		XMStoreFloat4x4(
-			&instance_matrices[k + FLOOR_INSTANCE_DATA_START],
-			XMMatrixTranslation(trn.translation.x, 0, trn.translation.y)
-		);
+	// Making objects, merged walls would stretch the bricks so only collision uses them:
+	std::vector<CuboidTransformation> collision_walls(maze.transformations_cuboid.begin(), maze.transformations_cuboid.end());
+	mergeCollinearWalls(collision_walls, length, width);
+	for (auto& t : collision_walls) {
+		collision_world.addRectangle(t, length, width);
+	}
+	for (auto& t : maze.transformations_hexprism) {
+		collision_world.addCircle(t.translation, width);
 	}
+	collision_world.buildIndex(length, width);
+}
 
+// Keeps the 3x3 chunks around the player resident in the instance buffer.
+// Missing chunks are only requested, unless blocking is set.
+void updateChunks(bool blocking) {
+	ChunkCoords center = chunk_world->chunkAt(player_state::position);
+	ChunkCoords needed[CHUNK_SLOTS];
+	size_t count = 0;
+	needed[count++] = center;
+	for (int dy = -1; dy <= 1; dy++) {
+		for (int dx = -1; dx <= 1; dx++) {
+			if (dx != 0 || dy != 0) {
+				needed[count++] = {center.x + dx, center.y + dy};
+			}
+		}
+	}
 
-	// Making objects:
-	for(int i = 0; i < maze.transformations_cuboid.size(); i++) {
-		auto obj = new RectangleObj{maze.transformations_cuboid[i], length, width};
-		obj_handler.addObject(obj);
+	for (auto& slot : chunk_slots) {
+		if (slot.chunk && std::find(std::begin(needed), std::end(needed), slot.chunk->coords) == std::end(needed)) {
+			chunk_world->release(std::move(slot.chunk));
+			slot.chunk = nullptr;
+		}
 	}
 
-	for(int i = 0; i < maze.transformations_hexprism.size(); i++) {
-		auto obj = new HexObj(maze.transformations_hexprism[i], width);
-		obj_handler.addObject(obj);
+	for (auto coords : needed) {
+		bool resident = std::any_of(std::begin(chunk_slots), std::end(chunk_slots), [&](auto& slot) {
+			return slot.chunk && slot.chunk->coords == coords;
+		});
+		if (resident) {
+			continue;
+		}
+
+		auto chunk = blocking ? chunk_world->get(coords) : chunk_world->tryGet(coords);
+		if (!chunk) {
+			continue;
+		}
+
+		auto slot = std::find_if(std::begin(chunk_slots), std::end(chunk_slots), [](auto& slot) {
+			return !slot.chunk;
+		});
+		slot->chunk = chunk;
+
+		size_t cuboids = chunk->transformations_cuboid.size();
+		size_t hexprisms = chunk->transformations_hexprism.size();
+		size_t total = cuboids + hexprisms + chunk->transformations_floor.size();
+		assert(total <= CHUNK_SLOT_SIZE);
+
+		storeCuboidMatrices(chunk->transformations_cuboid, &instance_matrices[slot->start]);
+		storeTranslationMatrices(chunk->transformations_hexprism, &instance_matrices[slot->start + cuboids]);
+		storeTranslationMatrices(chunk->transformations_floor, &instance_matrices[slot->start + cuboids + hexprisms]);
+		// The instance buffer gets the visible ones when drawing.
+		instance_bounds.set(slot->start, cuboid_bounds, std::span(&instance_matrices[slot->start], cuboids));
+		instance_bounds.set(slot->start + cuboids, hexprism_bounds, std::span(&instance_matrices[slot->start + cuboids], hexprisms));
+		instance_bounds.set(slot->start + cuboids + hexprisms, floor_bounds,
+			std::span(&instance_matrices[slot->start + cuboids + hexprisms], total - cuboids - hexprisms));
 	}
 }
 
@@ -290,10 +464,18 @@ void copyTriangleDataToVertexBuffer() {
 	UINT8* pVertexDataBegin;
 	D3D12_RANGE readRange(0, 0);        // We do not intend to read from this resource on the CPU.
 	ThrowIfFailed(vertexBuffer->Map(0, &readRange, reinterpret_cast<void**>(&pVertexDataBegin)));
-	memcpy(pVertexDataBegin, triangle_data, sizeof(triangle_data));
+	memcpy(pVertexDataBegin, mesh_data.vertices.data(), mesh_data.vertices.size() * sizeof(vertex_t));
 	vertexBuffer->Unmap(0, nullptr);
 }
 
+void copyIndexDataToIndexBuffer() {
+	UINT8* pIndexDataBegin;
+	D3D12_RANGE readRange(0, 0);
+	ThrowIfFailed(indexBuffer->Map(0, &readRange, reinterpret_cast<void**>(&pIndexDataBegin)));
+	memcpy(pIndexDataBegin, mesh_data.indices.data(), mesh_data.indices.size() * sizeof(uint16_t));
+	indexBuffer->Unmap(0, nullptr);
+}
+
 void calcNewMatrix() {
 
 	XMStoreFloat4x4(
@@ -328,9 +510,12 @@ void calcNewMatrix() {
 	wvp_matrix = XMMatrixMultiply(
 		wvp_matrix, 
 		XMMatrixPerspectiveFovLH(
-			45.0f, viewport.Width / viewport.Height, 0.03f, 100.0f
+			PLAYER_FOV_Y, viewport.Width / viewport.Height, PLAYER_NEAR_Z, PLAYER_FAR_Z
 		)
 	);
+	XMFLOAT4X4 culling_matrix;
+	XMStoreFloat4x4(&culling_matrix, wvp_matrix);
+	memcpy(view_projection.m, culling_matrix.m, sizeof(view_projection.m));
 	wvp_matrix = XMMatrixTranspose(wvp_matrix);
 	XMStoreFloat4x4(
 		&vsConstBufferData.matWorldViewProj, 	// zmienna typu vs_const_buffer_t z pkt. 2d
@@ -486,7 +671,7 @@ namespace DXInitAux {
 		D3D12_RESOURCE_DESC desc = {
 			.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER,
 			.Alignment = 0,
-			.Width = VERTEX_BUFFER_SIZE,
+			.Width = mesh_data.vertices.size() * sizeof(vertex_t),
 			.Height = 1,
 			.DepthOrArraySize = 1,
 			.MipLevels = 1,
@@ -502,7 +687,38 @@ namespace DXInitAux {
 		// Initialize the vertex buffer view.
 		vertexBufferView.BufferLocation = vertexBuffer->GetGPUVirtualAddress();
 		vertexBufferView.StrideInBytes = sizeof(vertex_t);
-		vertexBufferView.SizeInBytes = VERTEX_BUFFER_SIZE;
+		vertexBufferView.SizeInBytes = UINT(mesh_data.vertices.size() * sizeof(vertex_t));
+	}
+
+	void initIndexBuffer() {
+		// Upload heap like the vertex buffer, it is just as small.
+		D3D12_HEAP_PROPERTIES heapProps = {
+			.Type = D3D12_HEAP_TYPE_UPLOAD,
+			.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN,
+			.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN,
+			.CreationNodeMask = 1,
+			.VisibleNodeMask = 1,
+		};
+
+		D3D12_RESOURCE_DESC desc = {
+			.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER,
+			.Alignment = 0,
+			.Width = mesh_data.indices.size() * sizeof(uint16_t),
+			.Height = 1,
+			.DepthOrArraySize = 1,
+			.MipLevels = 1,
+			.Format = DXGI_FORMAT_UNKNOWN,
+			.SampleDesc = {.Count = 1, .Quality = 0 },
+			.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR,
+			.Flags = D3D12_RESOURCE_FLAG_NONE,
+		};
+
+		DXInitAux::createBasicCommittedResource(&heapProps, &desc, indexBuffer);
+		copyIndexDataToIndexBuffer();
+
+		indexBufferView.BufferLocation = indexBuffer->GetGPUVirtualAddress();
+		indexBufferView.SizeInBytes = UINT(mesh_data.indices.size() * sizeof(uint16_t));
+		indexBufferView.Format = DXGI_FORMAT_R16_UINT;
 	}
 
 	void initCommandQueue() {
@@ -850,18 +1066,17 @@ namespace DXInitAux {
 			IID_PPV_ARGS(&instance_buffer)
 		);
 
-		UINT8* dst_data = nullptr;
+		// Stays mapped, chunks are written into it while running.
 		D3D12_RANGE read_range = { 0, 0 };
 		instance_buffer->Map(
-			0, &read_range, reinterpret_cast<void**>(&dst_data)
+			0, &read_range, reinterpret_cast<void**>(&instance_buffer_pointer)
 		);
-		memcpy(dst_data, instance_matrices, INSTANCE_BUFFER_SIZE);
-		instance_buffer->Unmap(0, nullptr);
+		memcpy(instance_buffer_pointer, instance_matrices, INSTANCE_BUFFER_SIZE);
 
 		instance_buffer_view.BufferLocation = 
 			instance_buffer->GetGPUVirtualAddress();
 		instance_buffer_view.SizeInBytes = INSTANCE_BUFFER_SIZE;
-		instance_buffer_view.StrideInBytes = sizeof(XMFLOAT4X4);
+		instance_buffer_view.StrideInBytes = sizeof(InstanceMatrix);
 	}
 
 	void initTextureView(HWND hwnd) {
@@ -1055,6 +1270,131 @@ namespace DXInitAux {
 	}
 }
 
+void drawInstances(
+	size_t cuboid_start, size_t cuboid_count,
+	size_t hexprism_start, size_t hexprism_count,
+	size_t floor_start, size_t floor_count) {
+
+	commandList->DrawIndexedInstanced(
+		cuboid_range.index_count,
+		cuboid_count,
+		cuboid_range.start_index,
+		cuboid_range.base_vertex,
+		cuboid_start
+	);
+
+	commandList->DrawIndexedInstanced(
+		hexprism_range.index_count,
+		hexprism_count,
+		hexprism_range.start_index,
+		hexprism_range.base_vertex,
+		hexprism_start
+	);
+
+	commandList->DrawIndexedInstanced(
+		floor_range.index_count,
+		floor_count,
+		floor_range.start_index,
+		floor_range.base_vertex,
+		floor_start
+	);
+}
+
+// Culls the instances of one range of instance_matrices, cuboids, hexprisms
+// and floors in that order, and writes the visible ones of each kind
+// compacted to the same range of frustum_visible.
+VisibleRange cullRange(std::span<const Plane> planes, size_t start, size_t cuboids, size_t hexprisms, size_t floors) {
+	size_t hexprism_start = start + cuboids, floor_start = hexprism_start + hexprisms;
+	VisibleRange res = {start};
+	res.cuboids = cullInstances(instance_bounds, planes, start, hexprism_start, instance_matrices, frustum_visible + start);
+	res.hexprisms = cullInstances(instance_bounds, planes, hexprism_start, floor_start, instance_matrices,
+		frustum_visible + start + res.cuboids);
+	res.floors = cullInstances(instance_bounds, planes, floor_start, floor_start + floors, instance_matrices,
+		frustum_visible + start + res.cuboids + res.hexprisms);
+	return res;
+}
+
+// Culls what can be seen from the player's cell, its potentially visible set
+// or what the portals reach, into frustum_visible from 0. False outside the maze.
+bool cullFromCell(std::span<const Plane> planes, VisibleRange& range) {
+	auto toInstanceIndices = [](PvsSets& sets) {
+		auto offset = [](std::vector<uint32_t>& kind, size_t start) {
+			for (auto& i : kind) {
+				i += uint32_t(start);
+			}
+		};
+		offset(sets.walls, CUBOID_INSTANCE_DATA_START);
+		offset(sets.pillars, HEXPRISM_INSTANCE_DATA_START);
+		offset(sets.floors, FLOOR_INSTANCE_DATA_START);
+	};
+	if constexpr (PORTAL_CULLING) {
+		if (portals->cellAt(player_state::position) == NAV_NO_CELL) {
+			return false;
+		}
+		ViewWedge view = playerViewWedge(player_state::rotY, player_state::rotUpDown, viewport.Width / viewport.Height);
+		portals->visible(player_state::position, view, FOG_DISTANCE, visible_sets);
+		toInstanceIndices(visible_sets);
+	}
+	else {
+		int cell = pvs->cellAt(player_state::position);
+		if (cell == NAV_NO_CELL) {
+			return false;
+		}
+		if (cell != pvs_cell) {
+			pvs->visible(cell, visible_sets);
+			toInstanceIndices(visible_sets);
+			pvs_cell = cell;
+		}
+	}
+	range = {0};
+	range.cuboids = cullInstancesAt(instance_bounds, planes, visible_sets.walls, instance_matrices, frustum_visible);
+	range.hexprisms = cullInstancesAt(instance_bounds, planes, visible_sets.pillars, instance_matrices, frustum_visible + range.cuboids);
+	range.floors = cullInstancesAt(instance_bounds, planes, visible_sets.floors, instance_matrices,
+		frustum_visible + range.cuboids + range.hexprisms);
+	return true;
+}
+
+// Copies the instances of the ranges that are not occluded by the nearby
+// walls to the same ranges of the instance buffer and draws them.
+void drawVisible(std::span<const VisibleRange> ranges) {
+	if constexpr (OCCLUSION_CULLING) {
+		occluders.clear();
+		for (auto& range : ranges) {
+			for (size_t i = range.start; i < range.start + range.cuboids; i++) {
+				const InstanceMatrix& m = frustum_visible[i];
+				if ((Vector2{m.m[3][0], m.m[3][2]} - player_state::position).abs() < OCCLUDER_DISTANCE) {
+					occluders.push_back(m);
+				}
+			}
+		}
+		occlusion->render(view_projection, cuboid_bounds, occluders);
+	}
+	auto* buffer = reinterpret_cast<InstanceMatrix*>(instance_buffer_pointer);
+	for (auto& range : ranges) {
+		const size_t counts[3] = {range.cuboids, range.hexprisms, range.floors};
+		const Aabb* kind_bounds[3] = {&cuboid_bounds, &hexprism_bounds, &floor_bounds};
+		size_t drawn[3];
+		const InstanceMatrix* src = frustum_visible + range.start;
+		InstanceMatrix* dst = buffer + range.start;
+		for (int k = 0; k < 3; k++) {
+			if constexpr (OCCLUSION_CULLING) {
+				drawn[k] = occlusion->cull(*kind_bounds[k], std::span(src, counts[k]), dst);
+			}
+			else {
+				memcpy(dst, src, counts[k] * sizeof(InstanceMatrix));
+				drawn[k] = counts[k];
+			}
+			src += counts[k];
+			dst += drawn[k];
+		}
+		drawInstances(
+			range.start, drawn[0],
+			range.start + drawn[0], drawn[1],
+			range.start + drawn[0] + drawn[1], drawn[2]
+		);
+	}
+}
+
 void PopulateCommandList(HWND hwnd) {
 	ThrowIfFailed(commandAllocator->Reset());
 	ThrowIfFailed(commandList->Reset(commandAllocator.Get(), pipelineState.Get()));
@@ -1125,26 +1465,33 @@ void PopulateCommandList(HWND hwnd) {
   		1, 1, &instance_buffer_view
 	);
 
-	commandList->DrawInstanced(
-		CUBOID_VERTEX_COUNT, 
-		NUM_CUBOID_INSTANCES, 
-		CUBOID_START_POSITION, 
-		CUBOID_INSTANCE_DATA_START
-	);
-
-	commandList->DrawInstanced(
-  		HEXPRISM_VERTEX_COUNT, 
-		NUM_HEXPRISM_INSTANCES, 
-		HEXPRISM_START_POSITION, 
-		HEXPRISM_INSTANCE_DATA_START
-	);
+	commandList->IASetIndexBuffer(&indexBufferView);
 
-	commandList->DrawInstanced(
-		FLOOR_VERTEX_COUNT,
-		NUM_FLOOR_INSTANCES,
-		FLOOR_START_POSITION,
-		FLOOR_INSTANCE_DATA_START
-	);
+	// The previous frame is done, so the instance buffer can be rewritten.
+	auto planes = cullPlanes(view_projection, FOG_DISTANCE);
+	VisibleRange ranges[CHUNK_SLOTS];
+	size_t range_count = 0;
+	if constexpr (CHUNKED_WORLD) {
+		for (auto& slot : chunk_slots) {
+			if (!slot.chunk) {
+				continue;
+			}
+			ranges[range_count++] = cullRange(
+				planes, slot.start,
+				slot.chunk->transformations_cuboid.size(),
+				slot.chunk->transformations_hexprism.size(),
+				slot.chunk->transformations_floor.size()
+			);
+		}
+	}
+	else {
+		if (player_state::height >= wall_top || !cullFromCell(planes, ranges[0])) {
+			// Above the walls everything in the frustum can be seen.
+			ranges[0] = cullRange(planes, CUBOID_INSTANCE_DATA_START, NUM_CUBOID_INSTANCES, NUM_HEXPRISM_INSTANCES, NUM_FLOOR_INSTANCES);
+		}
+		range_count = 1;
+	}
+	drawVisible(std::span(ranges, range_count));
 
 	D3D12_RESOURCE_BARRIER barrier2 = {
 		.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION,
@@ -1199,8 +1546,12 @@ void InitDirect3D(HWND hwnd) {
 	DXInitAux::initRootSignature();
 	DXInitAux::initPipelineState();
 	DXInitAux::initVertexBuffer();
+	DXInitAux::initIndexBuffer();
 
 	DXInitAux::initInstanceBuffer();
+	if constexpr (CHUNKED_WORLD) {
+		updateChunks(true);
+	}
 
 	ThrowIfFailed(device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&fence)));
 	fenceValue = 1;
@@ -1226,6 +1577,9 @@ void InitDirect3D(HWND hwnd) {
 }
 
 void OnUpdate(HWND hwnd) {
+	if constexpr (CHUNKED_WORLD) {
+		updateChunks(false);
+	}
 	calcNewMatrix();
 }
 
@@ -17,17 +17,24 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT Msg, WPARAM wParam, LPARAM lParam) {
 		case WM_TIMER:
 			OnUpdate(hwnd);
 			InvalidateRect(hwnd, nullptr, true);
-			if ((GetAsyncKeyState(0x57) & 0x8000) > 0) {
-				player_state::move(0,movespeed);
-			}
-			if ((GetAsyncKeyState(0x41) & 0x8000) > 0) {
-				player_state::move(-movespeed, 0);
-			}
-			if ((GetAsyncKeyState(0x53) & 0x8000) > 0) {
-				player_state::move(0, -movespeed);
-			}
-			if ((GetAsyncKeyState(0x44) & 0x8000) > 0) {
-				player_state::move(movespeed, 0);
+			{
+				// The keys add up to one move, which is one collision query per tick.
+				float dx = 0, dy = 0;
+				if ((GetAsyncKeyState(0x57) & 0x8000) > 0) {
+					dy += movespeed;
+				}
+				if ((GetAsyncKeyState(0x41) & 0x8000) > 0) {
+					dx -= movespeed;
+				}
+				if ((GetAsyncKeyState(0x53) & 0x8000) > 0) {
+					dy -= movespeed;
+				}
+				if ((GetAsyncKeyState(0x44) & 0x8000) > 0) {
+					dx += movespeed;
+				}
+				if (dx != 0 || dy != 0) {
+					player_state::move(dx, dy);
+				}
 			}
 			if ((GetAsyncKeyState(VK_SPACE) & 0x8000) > 0) {
 				player_state::moveUp(movespeed);
@@ -1,10 +1,16 @@
 #pragma once
 
 #include <cmath>
+#include <cstddef>
+
+#ifdef _WIN32
 #include <d3d12.h>
 
 #undef max
 #undef min
+#else
+typedef float FLOAT;
+#endif
 
 struct vertex_t {
 	FLOAT position[3];
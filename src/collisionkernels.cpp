@@ -0,0 +1,222 @@
+#include "collisionkernels.hpp"
+
+#include <cmath>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define MAZE_SIMD_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define MAZE_TARGET_AVX2
+#else
+// No "fma" here, contracted multiply-adds would round differently from the scalar code.
+#define MAZE_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace {
+	// Index of lane i of a batch, contiguous or through an index list.
+	struct Contiguous {
+		size_t begin;
+		size_t operator[](size_t i) const { return begin + i; }
+	};
+
+	struct Listed {
+		const uint32_t* indices;
+		size_t operator[](size_t i) const { return indices[i]; }
+	};
+
+	// Same math as collides() for a RectangleObj and a HexObj, without branches.
+	bool rectangleHit(const RectangleSoA& r, size_t i, Vector2 center, float radius) {
+		float dx = r.x[i] - center.x, dy = r.y[i] - center.y;
+		float distance_x = std::abs(r.cos[i] * dx - r.sin[i] * dy);
+		float distance_y = std::abs(r.sin[i] * dx + r.cos[i] * dy);
+		float corner_x = distance_x - r.half_length[i];
+		float corner_y = distance_y - r.half_width[i];
+		bool outside = (distance_x > r.half_length[i] + radius) | (distance_y > r.half_width[i] + radius);
+		bool inside = (distance_x <= r.half_length[i]) | (distance_y <= r.half_width[i]);
+		bool corner = corner_x * corner_x + corner_y * corner_y <= radius * radius;
+		return !outside && (inside || corner);
+	}
+
+	bool circleHit(const CircleSoA& c, size_t i, Vector2 center, float radius) {
+		float dx = c.x[i] - center.x, dy = c.y[i] - center.y;
+		float r = c.radius[i] + radius;
+		return dx * dx + dy * dy <= r * r;
+	}
+
+	template<typename Lanes>
+	uint32_t rectanglesScalar(const RectangleSoA& shapes, Lanes lanes, size_t first, size_t count, Vector2 center, float radius) {
+		uint32_t mask = 0;
+		for (size_t i = first; i < count; i++) {
+			mask |= uint32_t(rectangleHit(shapes, lanes[i], center, radius)) << i;
+		}
+		return mask;
+	}
+
+	template<typename Lanes>
+	uint32_t circlesScalar(const CircleSoA& shapes, Lanes lanes, size_t first, size_t count, Vector2 center, float radius) {
+		uint32_t mask = 0;
+		for (size_t i = first; i < count; i++) {
+			mask |= uint32_t(circleHit(shapes, lanes[i], center, radius)) << i;
+		}
+		return mask;
+	}
+
+	template<typename Shapes, uint32_t (*Batch)(const Shapes&, Contiguous, size_t, size_t, Vector2, float)>
+	uint32_t contiguous(const Shapes& shapes, size_t begin, size_t count, Vector2 center, float radius) {
+		return Batch(shapes, {begin}, 0, count, center, radius);
+	}
+
+	template<typename Shapes, uint32_t (*Batch)(const Shapes&, Listed, size_t, size_t, Vector2, float)>
+	uint32_t listed(const Shapes& shapes, const uint32_t* indices, size_t count, Vector2 center, float radius) {
+		return Batch(shapes, {indices}, 0, count, center, radius);
+	}
+
+#ifdef MAZE_SIMD_X86
+	__m128 load4(const std::vector<float>& v, Contiguous lanes, size_t i) {
+		return _mm_loadu_ps(v.data() + lanes.begin + i);
+	}
+
+	__m128 load4(const std::vector<float>& v, Listed lanes, size_t i) {
+		const uint32_t* k = lanes.indices + i;
+		return _mm_setr_ps(v[k[0]], v[k[1]], v[k[2]], v[k[3]]);
+	}
+
+	template<typename Lanes>
+	uint32_t rectanglesSse2(const RectangleSoA& shapes, Lanes lanes, size_t first, size_t count, Vector2 center, float radius) {
+		const __m128 sign = _mm_set1_ps(-0.f);
+		const __m128 cx = _mm_set1_ps(center.x), cy = _mm_set1_ps(center.y);
+		const __m128 r = _mm_set1_ps(radius), r2 = _mm_set1_ps(radius * radius);
+		uint32_t mask = 0;
+		size_t i = first;
+		for (; i + 4 <= count; i += 4) {
+			__m128 dx = _mm_sub_ps(load4(shapes.x, lanes, i), cx);
+			__m128 dy = _mm_sub_ps(load4(shapes.y, lanes, i), cy);
+			__m128 c = load4(shapes.cos, lanes, i), s = load4(shapes.sin, lanes, i);
+			__m128 hl = load4(shapes.half_length, lanes, i), hw = load4(shapes.half_width, lanes, i);
+			__m128 ax = _mm_andnot_ps(sign, _mm_sub_ps(_mm_mul_ps(c, dx), _mm_mul_ps(s, dy)));
+			__m128 ay = _mm_andnot_ps(sign, _mm_add_ps(_mm_mul_ps(s, dx), _mm_mul_ps(c, dy)));
+			__m128 kx = _mm_sub_ps(ax, hl), ky = _mm_sub_ps(ay, hw);
+			__m128 outside = _mm_or_ps(_mm_cmpgt_ps(ax, _mm_add_ps(hl, r)), _mm_cmpgt_ps(ay, _mm_add_ps(hw, r)));
+			__m128 inside = _mm_or_ps(_mm_cmple_ps(ax, hl), _mm_cmple_ps(ay, hw));
+			__m128 corner = _mm_cmple_ps(_mm_add_ps(_mm_mul_ps(kx, kx), _mm_mul_ps(ky, ky)), r2);
+			__m128 hit = _mm_andnot_ps(outside, _mm_or_ps(inside, corner));
+			mask |= uint32_t(_mm_movemask_ps(hit)) << i;
+		}
+		return mask | rectanglesScalar(shapes, lanes, i, count, center, radius);
+	}
+
+	template<typename Lanes>
+	uint32_t circlesSse2(const CircleSoA& shapes, Lanes lanes, size_t first, size_t count, Vector2 center, float radius) {
+		const __m128 cx = _mm_set1_ps(center.x), cy = _mm_set1_ps(center.y), r = _mm_set1_ps(radius);
+		uint32_t mask = 0;
+		size_t i = first;
+		for (; i + 4 <= count; i += 4) {
+			__m128 dx = _mm_sub_ps(load4(shapes.x, lanes, i), cx);
+			__m128 dy = _mm_sub_ps(load4(shapes.y, lanes, i), cy);
+			__m128 rr = _mm_add_ps(load4(shapes.radius, lanes, i), r);
+			__m128 hit = _mm_cmple_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(rr, rr));
+			mask |= uint32_t(_mm_movemask_ps(hit)) << i;
+		}
+		return mask | circlesScalar(shapes, lanes, i, count, center, radius);
+	}
+
+	MAZE_TARGET_AVX2 __m256 load8(const std::vector<float>& v, Contiguous lanes, size_t i) {
+		return _mm256_loadu_ps(v.data() + lanes.begin + i);
+	}
+
+	MAZE_TARGET_AVX2 __m256 load8(const std::vector<float>& v, Listed lanes, size_t i) {
+		__m256i k = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(lanes.indices + i));
+		return _mm256_i32gather_ps(v.data(), k, 4);
+	}
+
+	template<typename Lanes>
+	MAZE_TARGET_AVX2 uint32_t rectanglesAvx2(const RectangleSoA& shapes, Lanes lanes, size_t first, size_t count, Vector2 center, float radius) {
+		const __m256 sign = _mm256_set1_ps(-0.f);
+		const __m256 cx = _mm256_set1_ps(center.x), cy = _mm256_set1_ps(center.y);
+		const __m256 r = _mm256_set1_ps(radius), r2 = _mm256_set1_ps(radius * radius);
+		uint32_t mask = 0;
+		size_t i = first;
+		for (; i + 8 <= count; i += 8) {
+			__m256 dx = _mm256_sub_ps(load8(shapes.x, lanes, i), cx);
+			__m256 dy = _mm256_sub_ps(load8(shapes.y, lanes, i), cy);
+			__m256 c = load8(shapes.cos, lanes, i), s = load8(shapes.sin, lanes, i);
+			__m256 hl = load8(shapes.half_length, lanes, i), hw = load8(shapes.half_width, lanes, i);
+			__m256 ax = _mm256_andnot_ps(sign, _mm256_sub_ps(_mm256_mul_ps(c, dx), _mm256_mul_ps(s, dy)));
+			__m256 ay = _mm256_andnot_ps(sign, _mm256_add_ps(_mm256_mul_ps(s, dx), _mm256_mul_ps(c, dy)));
+			__m256 kx = _mm256_sub_ps(ax, hl), ky = _mm256_sub_ps(ay, hw);
+			__m256 outside = _mm256_or_ps(_mm256_cmp_ps(ax, _mm256_add_ps(hl, r), _CMP_GT_OQ), _mm256_cmp_ps(ay, _mm256_add_ps(hw, r), _CMP_GT_OQ));
+			__m256 inside = _mm256_or_ps(_mm256_cmp_ps(ax, hl, _CMP_LE_OQ), _mm256_cmp_ps(ay, hw, _CMP_LE_OQ));
+			__m256 corner = _mm256_cmp_ps(_mm256_add_ps(_mm256_mul_ps(kx, kx), _mm256_mul_ps(ky, ky)), r2, _CMP_LE_OQ);
+			__m256 hit = _mm256_andnot_ps(outside, _mm256_or_ps(inside, corner));
+			mask |= uint32_t(_mm256_movemask_ps(hit)) << i;
+		}
+		// The tail runs SSE code, leaving the upper halves dirty would slow it down.
+		_mm256_zeroupper();
+		return mask | rectanglesSse2(shapes, lanes, i, count, center, radius);
+	}
+
+	template<typename Lanes>
+	MAZE_TARGET_AVX2 uint32_t circlesAvx2(const CircleSoA& shapes, Lanes lanes, size_t first, size_t count, Vector2 center, float radius) {
+		const __m256 cx = _mm256_set1_ps(center.x), cy = _mm256_set1_ps(center.y), r = _mm256_set1_ps(radius);
+		uint32_t mask = 0;
+		size_t i = first;
+		for (; i + 8 <= count; i += 8) {
+			__m256 dx = _mm256_sub_ps(load8(shapes.x, lanes, i), cx);
+			__m256 dy = _mm256_sub_ps(load8(shapes.y, lanes, i), cy);
+			__m256 rr = _mm256_add_ps(load8(shapes.radius, lanes, i), r);
+			__m256 hit = _mm256_cmp_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(rr, rr), _CMP_LE_OQ);
+			mask |= uint32_t(_mm256_movemask_ps(hit)) << i;
+		}
+		_mm256_zeroupper();
+		return mask | circlesSse2(shapes, lanes, i, count, center, radius);
+	}
+
+	bool cpuHasAvx2() {
+#ifdef _MSC_VER
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7) {
+			return false;
+		}
+		__cpuid(info, 1);
+		// The OS has to save the ymm registers as well.
+		bool os_avx = (info[2] & (1 << 27)) && (_xgetbv(0) & 6) == 6;
+		__cpuidex(info, 7, 0);
+		return os_avx && (info[1] & (1 << 5));
+#else
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2");
+#endif
+	}
+#endif
+
+#define MAZE_KERNELS(name, rect, circle) CollisionKernels{name, \
+	contiguous<RectangleSoA, rect<Contiguous>>, listed<RectangleSoA, rect<Listed>>, \
+	contiguous<CircleSoA, circle<Contiguous>>, listed<CircleSoA, circle<Listed>>}
+
+	std::vector<CollisionKernels> detectKernels() {
+		std::vector<CollisionKernels> res = {MAZE_KERNELS("scalar", rectanglesScalar, circlesScalar)};
+#ifdef MAZE_SIMD_X86
+		res.push_back(MAZE_KERNELS("sse2", rectanglesSse2, circlesSse2));
+		if (cpuHasAvx2()) {
+			res.push_back(MAZE_KERNELS("avx2", rectanglesAvx2, circlesAvx2));
+		}
+#endif
+		return res;
+	}
+
+#undef MAZE_KERNELS
+}
+
+std::span<const CollisionKernels> supportedCollisionKernels() {
+	static const std::vector<CollisionKernels> kernels = detectKernels();
+	return kernels;
+}
+
+const CollisionKernels& collisionKernels() {
+	static const CollisionKernels& best = supportedCollisionKernels().back();
+	return best;
+}
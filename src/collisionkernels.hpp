@@ -0,0 +1,26 @@
+#pragma once
+
+#include "collisionworld.hpp"
+#include <cstdint>
+#include <span>
+
+// Batched tests of one circle against the shapes of a CollisionWorld. Bit i
+// of the result is set if the circle hits shape i of the batch. A batch is
+// either count shapes from begin, or the count shapes listed in indices.
+// Every variant does the same float operations in the same order as the
+// scalar collides(), so the masks agree bit for bit.
+
+constexpr size_t KERNEL_BATCH = 32;
+
+struct CollisionKernels {
+	const char* name;
+	uint32_t (*rectangles)(const RectangleSoA& shapes, size_t begin, size_t count, Vector2 center, float radius);
+	uint32_t (*rectanglesAt)(const RectangleSoA& shapes, const uint32_t* indices, size_t count, Vector2 center, float radius);
+	uint32_t (*circles)(const CircleSoA& shapes, size_t begin, size_t count, Vector2 center, float radius);
+	uint32_t (*circlesAt)(const CircleSoA& shapes, const uint32_t* indices, size_t count, Vector2 center, float radius);
+};
+
+// Kernels the CPU supports, from scalar to the widest.
+std::span<const CollisionKernels> supportedCollisionKernels();
+// The widest supported kernels, picked once at startup.
+const CollisionKernels& collisionKernels();
@@ -0,0 +1,368 @@
+#include "collisionworld.hpp"
+#include "collisionkernels.hpp"
+#include "mazegrid.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <thread>
+
+namespace {
+	// Tests the circle in batches with the widest kernels the CPU supports.
+	template<typename Shapes>
+	bool anyHit(const Shapes& shapes, const LatticeIndex& index, Vector2 center, float radius,
+		uint32_t (*batch)(const Shapes&, size_t, size_t, Vector2, float),
+		uint32_t (*batch_at)(const Shapes&, const uint32_t*, size_t, Vector2, float)) {
+		if (index.built()) {
+			bool hit = index.anyCell(center, radius, [&](const uint32_t* items, size_t count) {
+				for (size_t i = 0; i < count; i += KERNEL_BATCH) {
+					if (batch_at(shapes, items + i, std::min(KERNEL_BATCH, count - i), center, radius)) {
+						return true;
+					}
+				}
+				return false;
+			});
+			if (hit) {
+				return true;
+			}
+		}
+		// Shapes added after the index was built, or all of them without one.
+		for (size_t i = index.itemCount(); i < shapes.size(); i += KERNEL_BATCH) {
+			if (batch(shapes, i, std::min(KERNEL_BATCH, shapes.size() - i), center, radius)) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Slab test in the frame of the rectangle, with the same local axes as the
+	// collision kernels. Updates distance and normal if the hit is not further
+	// than distance.
+	bool rayRectangle(const RectangleSoA& r, size_t i, const Ray& ray, float& distance, Vector2& normal) {
+		float dx = ray.origin.x - r.x[i], dy = ray.origin.y - r.y[i];
+		float c = r.cos[i], s = r.sin[i];
+		const float origin[2] = {c * dx - s * dy, s * dx + c * dy};
+		const float direction[2] = {c * ray.direction.x - s * ray.direction.y, s * ray.direction.x + c * ray.direction.y};
+		const float half[2] = {r.half_length[i], r.half_width[i]};
+		float t_enter = -std::numeric_limits<float>::infinity(), t_leave = std::numeric_limits<float>::infinity();
+		int axis = 0;
+		for (int a = 0; a < 2; a++) {
+			if (direction[a] == 0) {
+				if (std::abs(origin[a]) > half[a]) {
+					return false;
+				}
+				continue;
+			}
+			float t0 = (-half[a] - origin[a]) / direction[a], t1 = (half[a] - origin[a]) / direction[a];
+			if (t0 > t1) {
+				std::swap(t0, t1);
+			}
+			if (t0 > t_enter) {
+				t_enter = t0;
+				axis = a;
+			}
+			t_leave = std::min(t_leave, t1);
+		}
+		if (t_enter > t_leave || t_leave < 0 || t_enter > distance) {
+			return false;
+		}
+		if (t_enter <= 0) {
+			distance = 0;
+			normal = -ray.direction;
+			return true;
+		}
+		float side = direction[axis] > 0 ? -1.f : 1.f;
+		distance = t_enter;
+		normal = (axis == 0 ? Vector2{c, -s} : Vector2{s, c}) * side;
+		return true;
+	}
+
+	bool rayCircle(const CircleSoA& circles, size_t i, const Ray& ray, float& distance, Vector2& normal) {
+		Vector2 m = ray.origin - Vector2{circles.x[i], circles.y[i]};
+		float r = circles.radius[i];
+		float b = dot(m, ray.direction), c = m.abs2() - r * r;
+		if (c <= 0) {
+			distance = 0;
+			normal = -ray.direction;
+			return true;
+		}
+		float discriminant = b * b - c;
+		if (b > 0 || discriminant < 0) {
+			return false;
+		}
+		float t = -b - std::sqrt(discriminant);
+		if (t > distance) {
+			return false;
+		}
+		distance = t;
+		normal = (m + ray.direction * t) / r;
+		return true;
+	}
+
+	// First time o + d * t enters the box |x| <= hx, |y| <= hy from outside, with
+	// the normal of the face it enters through. Rays that touch the box only
+	// at one point or started inside it do not count.
+	bool enterBox(Vector2 o, Vector2 d, float hx, float hy, float& t, Vector2& normal) {
+		const float o_axes[2] = {o.x, o.y}, d_axes[2] = {d.x, d.y}, half[2] = {hx, hy};
+		float t_enter = -std::numeric_limits<float>::infinity(), t_leave = std::numeric_limits<float>::infinity();
+		int axis = 0;
+		for (int a = 0; a < 2; a++) {
+			if (d_axes[a] == 0) {
+				if (std::abs(o_axes[a]) >= half[a]) {
+					return false;
+				}
+				continue;
+			}
+			float t0 = (-half[a] - o_axes[a]) / d_axes[a], t1 = (half[a] - o_axes[a]) / d_axes[a];
+			if (t0 > t1) {
+				std::swap(t0, t1);
+			}
+			if (t0 > t_enter) {
+				t_enter = t0;
+				axis = a;
+			}
+			t_leave = std::min(t_leave, t1);
+		}
+		if (t_enter < 0 || t_enter >= t_leave) {
+			return false;
+		}
+		t = t_enter;
+		float side = d_axes[axis] > 0 ? -1.f : 1.f;
+		normal = axis == 0 ? Vector2{side, 0} : Vector2{0, side};
+		return true;
+	}
+
+	// First time o + d * t comes within radius of center, for o at least radius away.
+	bool enterCircle(Vector2 o, Vector2 d, Vector2 center, float radius, float& t, Vector2& normal) {
+		Vector2 m = o - center;
+		float b = dot(m, d), c = m.abs2() - radius * radius;
+		float discriminant = b * b - c;
+		if (b >= 0 || discriminant < 0) {
+			return false;
+		}
+		t = -b - std::sqrt(discriminant);
+		normal = (m + d * t) / radius;
+		return true;
+	}
+
+	// A circle of the given radius moving along the ray against a wall, which is
+	// the ray against the wall grown by the radius: two boxes and four corner
+	// circles. Works in the local frame of rayRectangle.
+	bool sweepRectangle(const RectangleSoA& r, size_t i, const Ray& ray, float radius, float& distance, Vector2& normal) {
+		float dx = ray.origin.x - r.x[i], dy = ray.origin.y - r.y[i];
+		float c = r.cos[i], s = r.sin[i];
+		const Vector2 o = {c * dx - s * dy, s * dx + c * dy};
+		const Vector2 d = {c * ray.direction.x - s * ray.direction.y, s * ray.direction.x + c * ray.direction.y};
+		const float hl = r.half_length[i], hw = r.half_width[i];
+		auto toWorld = [&](Vector2 n) { return Vector2{c * n.x + s * n.y, -s * n.x + c * n.y}; };
+
+		// Already overlapping: a hit at 0 if moving further in, along the way out.
+		Vector2 closest = {std::clamp(o.x, -hl, hl), std::clamp(o.y, -hw, hw)};
+		Vector2 away = o - closest;
+		if (away.abs2() < radius * radius) {
+			Vector2 n;
+			if (away.abs2() > 0) {
+				n = away.normUnit();
+			}
+			else {
+				n = hl - std::abs(o.x) < hw - std::abs(o.y) ? Vector2{o.x < 0 ? -1.f : 1.f, 0} : Vector2{0, o.y < 0 ? -1.f : 1.f};
+			}
+			if (dot(n, d) >= 0) {
+				return false;
+			}
+			distance = 0;
+			normal = toWorld(n);
+			return true;
+		}
+
+		float best = distance;
+		Vector2 best_normal;
+		bool found = false;
+		float t;
+		Vector2 n;
+		auto keep = [&](bool entered) {
+			if (entered && t <= best) {
+				best = t;
+				best_normal = n;
+				found = true;
+			}
+		};
+		keep(enterBox(o, d, hl + radius, hw, t, n));
+		keep(enterBox(o, d, hl, hw + radius, t, n));
+		for (Vector2 corner : {Vector2{hl, hw}, Vector2{-hl, hw}, Vector2{hl, -hw}, Vector2{-hl, -hw}}) {
+			keep(enterCircle(o, d, corner, radius, t, n));
+		}
+		if (!found) {
+			return false;
+		}
+		distance = best;
+		normal = toWorld(best_normal);
+		return true;
+	}
+
+	bool sweepCircle(const CircleSoA& circles, size_t i, const Ray& ray, float radius, float& distance, Vector2& normal) {
+		Vector2 center = {circles.x[i], circles.y[i]};
+		float reach = circles.radius[i] + radius;
+		Vector2 m = ray.origin - center;
+		if (m.abs2() < reach * reach) {
+			Vector2 n = m.abs2() > 0 ? m.normUnit() : -ray.direction;
+			if (dot(n, ray.direction) >= 0) {
+				return false;
+			}
+			distance = 0;
+			normal = n;
+			return true;
+		}
+		float t;
+		Vector2 n;
+		if (!enterCircle(ray.origin, ray.direction, center, reach, t, n) || t > distance) {
+			return false;
+		}
+		distance = t;
+		normal = n;
+		return true;
+	}
+
+	// Tests the shapes listed in the cells under the disk around the whole sweep.
+	template<typename Shapes, typename Test>
+	void sweepShapes(const Shapes& shapes, const LatticeIndex& index, RayShape type, const Ray& ray, float radius, RayHit& hit, Test test) {
+		auto test_shape = [&](uint32_t i) {
+			if (test(shapes, i, ray, radius, hit.distance, hit.normal)) {
+				hit.shape = type;
+				hit.index = i;
+			}
+		};
+		for (size_t i = index.itemCount(); i < shapes.size(); i++) {
+			test_shape(uint32_t(i));
+		}
+		if (!index.built()) {
+			return;
+		}
+		const float half = ray.max_distance / 2;
+		index.anyCell(ray.origin + ray.direction * half, half + radius, [&](const uint32_t* items, size_t count) {
+			for (size_t i = 0; i < count; i++) {
+				test_shape(items[i]);
+			}
+			return false;
+		});
+	}
+
+	// Tests the shapes in the cells along the ray until the nearest hit so far
+	// is inside the current cell, later cells can only hold further hits.
+	template<typename Shapes, typename Test>
+	void raycastShapes(const Shapes& shapes, const LatticeIndex& index, RayShape type, const Ray& ray, RayHit& hit, Test test) {
+		auto test_shape = [&](uint32_t i) {
+			if (test(shapes, i, ray, hit.distance, hit.normal)) {
+				hit.shape = type;
+				hit.index = i;
+			}
+		};
+		// Shapes added after the index was built first, their hits shorten the walk.
+		for (size_t i = index.itemCount(); i < shapes.size(); i++) {
+			test_shape(uint32_t(i));
+		}
+		if (!index.built()) {
+			return;
+		}
+		index.alongRay(ray.origin, ray.direction, hit.distance, [&](const uint32_t* items, size_t count, float exit) {
+			for (size_t i = 0; i < count; i++) {
+				test_shape(items[i]);
+			}
+			return hit.hit() && hit.distance <= exit;
+		});
+	}
+
+	constexpr int RAYCAST_BLOCK = 256;
+}
+
+void RectangleSoA::add(const CuboidTransformation& t, float length, float width) {
+	float scaled_length = length * t.length_scale;
+	x.push_back(t.translation.x);
+	y.push_back(t.translation.y);
+	cos.push_back(std::cos(t.rotation));
+	sin.push_back(std::sin(t.rotation));
+	half_length.push_back(scaled_length / 2);
+	half_width.push_back(width / 2);
+}
+
+void CircleSoA::add(Vector2 center, float r) {
+	x.push_back(center.x);
+	y.push_back(center.y);
+	radius.push_back(r);
+}
+
+void CollisionWorld::addRectangle(const CuboidTransformation& t, float length, float width) {
+	rectangles.add(t, length, width);
+}
+
+void CollisionWorld::addCircle(Vector2 center, float radius) {
+	circles.add(center, radius);
+}
+
+void CollisionWorld::add(const Object& obj) {
+	if (obj.type() == ObjectType::Hex) {
+		const HexObj& h = dynamic_cast<const HexObj&>(obj);
+		addCircle(h.t.translation, h.width);
+		return;
+	}
+	// RectangleObj already has the length scale applied.
+	const RectangleObj& r = dynamic_cast<const RectangleObj&>(obj);
+	addRectangle({r.t.translation, r.t.rotation}, r.length, r.width);
+}
+
+void CollisionWorld::buildIndex(float length, float width) {
+	const float step = length + width * sqrtf(3);
+	rectangle_index.build(length, width, rectangles.size(), [&](size_t i, auto f) {
+		Vector2 half_axis = Vector2{rectangles.cos[i], -rectangles.sin[i]} * rectangles.half_length[i];
+		rectangleDisks({rectangles.x[i], rectangles.y[i]}, half_axis, 2 * rectangles.half_length[i], 2 * rectangles.half_width[i], step, f);
+	});
+	circle_index.build(length, width, circles.size(), [&](size_t i, auto f) {
+		f({circles.x[i], circles.y[i]}, circles.radius[i]);
+	});
+}
+
+bool CollisionWorld::collidesWithCircle(Vector2 center, float radius) const {
+	const CollisionKernels& kernels = collisionKernels();
+	return anyHit(rectangles, rectangle_index, center, radius, kernels.rectangles, kernels.rectanglesAt) ||
+		anyHit(circles, circle_index, center, radius, kernels.circles, kernels.circlesAt);
+}
+
+RayHit CollisionWorld::raycast(const Ray& ray) const {
+	RayHit hit;
+	hit.distance = ray.max_distance;
+	raycastShapes(rectangles, rectangle_index, RayShape::Rectangle, ray, hit, rayRectangle);
+	// Only circles in front of the nearest wall are left to find.
+	raycastShapes(circles, circle_index, RayShape::Circle, ray, hit, rayCircle);
+	return hit;
+}
+
+bool CollisionWorld::lineOfSight(Vector2 a, Vector2 b) const {
+	Vector2 d = b - a;
+	float length = d.abs();
+	if (length == 0) {
+		return !collidesWithCircle(a, 0);
+	}
+	return !raycast({a, d / length, length}).hit();
+}
+
+void CollisionWorld::raycast(std::span<const Ray> rays, RayHit* hits, int thread_count) const {
+	if (thread_count <= 0) {
+		thread_count = std::max(1u, std::thread::hardware_concurrency());
+	}
+	// Blocks of consecutive rays, so threads do not write to the same cache lines.
+	int blocks = int((rays.size() + RAYCAST_BLOCK - 1) / RAYCAST_BLOCK);
+	parallelFor(blocks, std::max(1, std::min(thread_count, blocks)), [&](int block) {
+		size_t end = std::min(rays.size(), size_t(block + 1) * RAYCAST_BLOCK);
+		for (size_t i = size_t(block) * RAYCAST_BLOCK; i < end; i++) {
+			hits[i] = raycast(rays[i]);
+		}
+	});
+}
+
+RayHit CollisionWorld::sweepCircle(const Ray& ray, float radius) const {
+	RayHit hit;
+	hit.distance = ray.max_distance;
+	sweepShapes(rectangles, rectangle_index, RayShape::Rectangle, ray, radius, hit, sweepRectangle);
+	sweepShapes(circles, circle_index, RayShape::Circle, ray, radius, hit, ::sweepCircle);
+	return hit;
+}
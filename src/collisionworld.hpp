@@ -0,0 +1,130 @@
+#pragma once
+
+#include "latticeindex.hpp"
+#include "mazephysics.hpp"
+#include <span>
+#include <vector>
+
+// Walls in structure-of-arrays form, with the sin/cos of the rotation stored
+// so a test is only multiplies and compares.
+struct RectangleSoA {
+	std::vector<float> x, y;
+	std::vector<float> cos, sin;
+	std::vector<float> half_length, half_width;
+
+	size_t size() const { return x.size(); }
+	void add(const CuboidTransformation& t, float length, float width);
+};
+
+// Pillars, which collide as circles.
+struct CircleSoA {
+	std::vector<float> x, y;
+	std::vector<float> radius;
+
+	size_t size() const { return x.size(); }
+	void add(Vector2 center, float radius);
+};
+
+// A ray or segment query, direction has unit length.
+struct Ray {
+	Vector2 origin;
+	Vector2 direction;
+	float max_distance;
+};
+
+enum class RayShape : uint8_t {
+	None, Rectangle, Circle
+};
+
+// Nearest wall or pillar along a ray. A ray that starts inside a shape hits it
+// at distance 0, a miss has distance max_distance.
+struct RayHit {
+	RayShape shape = RayShape::None;
+	uint32_t index = 0;
+	float distance = 0;
+	// Surface normal at the hit point, facing the ray.
+	Vector2 normal = {0, 0};
+
+	bool hit() const { return shape != RayShape::None; }
+};
+
+// Moves of a slide, each one a sweep up to the next hit and the rest of the
+// move projected onto the surface hit.
+constexpr int SLIDE_ITERATIONS = 4;
+// Distance a slide keeps from the surfaces it hits, so the next sweep does not start in contact.
+constexpr float SLIDE_SKIN = 1e-4f;
+
+struct SlideResult {
+	Vector2 position;
+	// Sweep queries the slide needed.
+	int sweeps = 0;
+	bool hit = false;
+};
+
+// Moves a circle by delta, sliding along whatever sweep(ray, radius) hits.
+// sweep has the semantics of CollisionWorld::sweepCircle.
+template<typename Sweep>
+SlideResult slideWithSweeps(Vector2 center, float radius, Vector2 delta, Sweep sweep) {
+	SlideResult res = {center};
+	for (int i = 0; i < SLIDE_ITERATIONS; i++) {
+		float length = delta.abs();
+		if (length == 0) {
+			break;
+		}
+		Vector2 direction = delta / length;
+		RayHit hit = sweep(Ray{res.position, direction, length}, radius);
+		res.sweeps++;
+		if (!hit.hit()) {
+			res.position += delta;
+			break;
+		}
+		res.hit = true;
+		res.position += direction * hit.distance + hit.normal * SLIDE_SKIN;
+		Vector2 rest = direction * (length - hit.distance);
+		delta = rest - hit.normal * dot(rest, hit.normal);
+	}
+	return res;
+}
+
+// Collision storage without virtual calls or RTTI: each shape type has its
+// own buffers and lattice index, and pair tests are picked by overloading.
+class CollisionWorld {
+	RectangleSoA rectangles;
+	CircleSoA circles;
+	LatticeIndex rectangle_index;
+	LatticeIndex circle_index;
+public:
+	void addRectangle(const CuboidTransformation& t, float length, float width);
+	void addCircle(Vector2 center, float radius);
+	// Adapter for the Object API, the type is only looked at once when adding.
+	void add(const Object& obj);
+
+	size_t rectangleCount() const { return rectangles.size(); }
+	size_t circleCount() const { return circles.size(); }
+
+	// Shapes added later are tested one by one by every query until it is
+	// called again.
+	void buildIndex(float length, float width);
+
+	// Same answers as ObjectHandler::collidesWith with a HexObj of this position and width.
+	bool collidesWithCircle(Vector2 center, float radius) const;
+	bool collidesWith(const HexObj& obj) const {
+		return collidesWithCircle(obj.t.translation, obj.width);
+	}
+
+	// Walks the lattice cells along the ray and only tests the shapes listed in
+	// them, without an index every shape is tested.
+	RayHit raycast(const Ray& ray) const;
+	// True if no wall or pillar is between a and b.
+	bool lineOfSight(Vector2 a, Vector2 b) const;
+	// raycast() for every ray, split over thread_count threads, 0 uses all hardware threads.
+	void raycast(std::span<const Ray> rays, RayHit* hits, int thread_count = 1) const;
+
+	// Time of impact of a circle moving along the ray: distance is how far its
+	// center gets before touching a shape, normal points away from that shape.
+	// A circle that already overlaps a shape only hits it when moving further in.
+	RayHit sweepCircle(const Ray& ray, float radius) const;
+	SlideResult slideCircle(Vector2 center, float radius, Vector2 delta) const {
+		return slideWithSweeps(center, radius, delta, [&](const Ray& ray, float r) { return sweepCircle(ray, r); });
+	}
+};
@@ -0,0 +1,218 @@
+#include "culling.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MAZE_CULL_SSE
+#include <emmintrin.h>
+#endif
+
+namespace {
+	Plane column(const InstanceMatrix& m, int j) {
+		return {m.m[0][j], m.m[1][j], m.m[2][j], m.m[3][j]};
+	}
+
+	Plane normalized(Plane p) {
+		float length = std::sqrt(p.a * p.a + p.b * p.b + p.c * p.c);
+		return {p.a / length, p.b / length, p.c / length, p.d / length};
+	}
+
+	// The bounds are outside when the center is further behind the plane than
+	// the smaller of the box's extent along the normal and the sphere's radius.
+	bool outside(const InstanceBounds& b, size_t i, const Plane& p) {
+		float distance = p.a * b.x[i] + p.b * b.y[i] + p.c * b.z[i] + p.d;
+		float box = std::abs(p.a) * b.extent_x[i] + std::abs(p.b) * b.extent_y[i] + std::abs(p.c) * b.extent_z[i];
+		return distance < -std::min(box, b.radius[i]);
+	}
+
+	bool visible(const InstanceBounds& b, size_t i, std::span<const Plane> planes) {
+		return std::none_of(planes.begin(), planes.end(), [&](const Plane& p) { return outside(b, i, p); });
+	}
+
+#ifdef MAZE_CULL_SSE
+	struct PlaneVectors {
+		__m128 a, b, c, d, abs_a, abs_b, abs_c;
+	};
+
+	void planeVectors(std::span<const Plane> planes, PlaneVectors* out) {
+		assert(planes.size() <= CULL_MAX_PLANES);
+		for (size_t k = 0; k < planes.size(); k++) {
+			const Plane& p = planes[k];
+			out[k] = {
+				_mm_set1_ps(p.a), _mm_set1_ps(p.b), _mm_set1_ps(p.c), _mm_set1_ps(p.d),
+				_mm_set1_ps(std::abs(p.a)), _mm_set1_ps(std::abs(p.b)), _mm_set1_ps(std::abs(p.c)),
+			};
+		}
+	}
+
+	// outside() for four instances, bit k is set if instance k passes every plane.
+	int visibleMask(const PlaneVectors* planes, size_t plane_count, __m128 x, __m128 y, __m128 z, __m128 ex, __m128 ey, __m128 ez, __m128 r) {
+		int mask = 0xf;
+		for (size_t k = 0; k < plane_count && mask; k++) {
+			const PlaneVectors& p = planes[k];
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(p.a, x), _mm_mul_ps(p.b, y)), _mm_mul_ps(p.c, z)), p.d);
+			__m128 box = _mm_add_ps(_mm_add_ps(_mm_mul_ps(p.abs_a, ex), _mm_mul_ps(p.abs_b, ey)), _mm_mul_ps(p.abs_c, ez));
+			__m128 reach = _mm_sub_ps(_mm_setzero_ps(), _mm_min_ps(box, r));
+			mask &= ~_mm_movemask_ps(_mm_cmplt_ps(distance, reach));
+		}
+		return mask;
+	}
+#endif
+}
+
+void InstanceBounds::resize(size_t count) {
+	for (auto* v : {&x, &y, &z, &extent_x, &extent_y, &extent_z, &radius}) {
+		v->resize(count);
+	}
+}
+
+void InstanceBounds::set(size_t i, const Aabb& local, const InstanceMatrix& m) {
+	const float c[3] = {(local.min.x + local.max.x) / 2, (local.min.y + local.max.y) / 2, (local.min.z + local.max.z) / 2};
+	const float e[3] = {(local.max.x - local.min.x) / 2, (local.max.y - local.min.y) / 2, (local.max.z - local.min.z) / 2};
+	float center[3], extent[3];
+	for (int j = 0; j < 3; j++) {
+		center[j] = c[0] * m.m[0][j] + c[1] * m.m[1][j] + c[2] * m.m[2][j] + m.m[3][j];
+		extent[j] = e[0] * std::abs(m.m[0][j]) + e[1] * std::abs(m.m[1][j]) + e[2] * std::abs(m.m[2][j]);
+	}
+	x[i] = center[0];
+	y[i] = center[1];
+	z[i] = center[2];
+	extent_x[i] = extent[0];
+	extent_y[i] = extent[1];
+	extent_z[i] = extent[2];
+
+	// The furthest corner of the box from its center, through the matrix.
+	float r2 = 0;
+	for (int corner = 0; corner < 8; corner++) {
+		float sx = corner & 1 ? e[0] : -e[0], sy = corner & 2 ? e[1] : -e[1], sz = corner & 4 ? e[2] : -e[2];
+		float d2 = 0;
+		for (int j = 0; j < 3; j++) {
+			float d = sx * m.m[0][j] + sy * m.m[1][j] + sz * m.m[2][j];
+			d2 += d * d;
+		}
+		r2 = std::max(r2, d2);
+	}
+	radius[i] = std::sqrt(r2);
+}
+
+void InstanceBounds::set(size_t begin, const Aabb& local, std::span<const InstanceMatrix> matrices) {
+	for (size_t k = 0; k < matrices.size(); k++) {
+		set(begin + k, local, matrices[k]);
+	}
+}
+
+Aabb meshBounds(std::span<const vertex_t> vertices) {
+	constexpr float INF = std::numeric_limits<float>::infinity();
+	Aabb res = {{INF, INF, INF}, {-INF, -INF, -INF}};
+	for (auto& v : vertices) {
+		res.min = {std::min(res.min.x, v.position[0]), std::min(res.min.y, v.position[1]), std::min(res.min.z, v.position[2])};
+		res.max = {std::max(res.max.x, v.position[0]), std::max(res.max.y, v.position[1]), std::max(res.max.z, v.position[2])};
+	}
+	return res;
+}
+
+InstanceMatrix playerViewProjection(Vector2 position, float height, float rot_y, float rot_up_down, float aspect) {
+	const float cy = std::cos(rot_y), sy = std::sin(rot_y);
+	const float cx = std::cos(rot_up_down), sx = std::sin(rot_up_down);
+	const InstanceMatrix translation = {{
+		{1, 0, 0, 0},
+		{0, 1, 0, 0},
+		{0, 0, 1, 0},
+		{-position.x, -height, -position.y, 1},
+	}};
+	const InstanceMatrix rotation_y = {{
+		{cy, 0, -sy, 0},
+		{0, 1, 0, 0},
+		{sy, 0, cy, 0},
+		{0, 0, 0, 1},
+	}};
+	const InstanceMatrix rotation_x = {{
+		{1, 0, 0, 0},
+		{0, cx, sx, 0},
+		{0, -sx, cx, 0},
+		{0, 0, 0, 1},
+	}};
+	const float y_scale = std::cos(PLAYER_FOV_Y / 2) / std::sin(PLAYER_FOV_Y / 2);
+	const float range = PLAYER_FAR_Z / (PLAYER_FAR_Z - PLAYER_NEAR_Z);
+	const InstanceMatrix projection = {{
+		{y_scale / aspect, 0, 0, 0},
+		{0, y_scale, 0, 0},
+		{0, 0, range, 1},
+		{0, 0, -range * PLAYER_NEAR_Z, 0},
+	}};
+	return multiply(multiply(multiply(translation, rotation_y), rotation_x), projection);
+}
+
+std::array<Plane, CULL_PLANES> cullPlanes(const InstanceMatrix& view_projection, float fog_distance) {
+	const Plane x = column(view_projection, 0), y = column(view_projection, 1);
+	const Plane z = column(view_projection, 2), w = column(view_projection, 3);
+	auto add = [](Plane p, Plane q) { return Plane{p.a + q.a, p.b + q.b, p.c + q.c, p.d + q.d}; };
+	auto sub = [](Plane p, Plane q) { return Plane{p.a - q.a, p.b - q.b, p.c - q.c, p.d - q.d}; };
+	// Clip depth at most fog_distance, for points with w = 1 before projection.
+	const Plane far_plane = fog_distance > 0 ? Plane{-z.a, -z.b, -z.c, fog_distance - z.d} : sub(w, z);
+	return {
+		normalized(add(w, x)), normalized(sub(w, x)),
+		normalized(add(w, y)), normalized(sub(w, y)),
+		normalized(z), normalized(far_plane),
+	};
+}
+
+size_t cullInstancesScalar(const InstanceBounds& bounds, std::span<const Plane> planes, size_t begin, size_t end,
+	const InstanceMatrix* matrices, InstanceMatrix* out) {
+	size_t count = 0;
+	for (size_t i = begin; i < end; i++) {
+		if (visible(bounds, i, planes)) {
+			out[count++] = matrices[i];
+		}
+	}
+	return count;
+}
+
+size_t cullInstances(const InstanceBounds& bounds, std::span<const Plane> planes, size_t begin, size_t end,
+	const InstanceMatrix* matrices, InstanceMatrix* out) {
+#ifdef MAZE_CULL_SSE
+	PlaneVectors vectors[CULL_MAX_PLANES];
+	planeVectors(planes, vectors);
+	size_t count = 0, i = begin;
+	for (; i + 4 <= end; i += 4) {
+		int mask = visibleMask(vectors, planes.size(),
+			_mm_loadu_ps(bounds.x.data() + i), _mm_loadu_ps(bounds.y.data() + i), _mm_loadu_ps(bounds.z.data() + i),
+			_mm_loadu_ps(bounds.extent_x.data() + i), _mm_loadu_ps(bounds.extent_y.data() + i), _mm_loadu_ps(bounds.extent_z.data() + i),
+			_mm_loadu_ps(bounds.radius.data() + i));
+		for (; mask; mask &= mask - 1) {
+			out[count++] = matrices[i + std::countr_zero(unsigned(mask))];
+		}
+	}
+	return count + cullInstancesScalar(bounds, planes, i, end, matrices, out + count);
+#else
+	return cullInstancesScalar(bounds, planes, begin, end, matrices, out);
+#endif
+}
+
+size_t cullInstancesAt(const InstanceBounds& bounds, std::span<const Plane> planes, std::span<const uint32_t> indices,
+	const InstanceMatrix* matrices, InstanceMatrix* out) {
+	size_t count = 0, k = 0;
+#ifdef MAZE_CULL_SSE
+	PlaneVectors vectors[CULL_MAX_PLANES];
+	planeVectors(planes, vectors);
+	for (; k + 4 <= indices.size(); k += 4) {
+		const uint32_t* i = indices.data() + k;
+		auto gather = [&](const std::vector<float>& v) { return _mm_setr_ps(v[i[0]], v[i[1]], v[i[2]], v[i[3]]); };
+		int mask = visibleMask(vectors, planes.size(), gather(bounds.x), gather(bounds.y), gather(bounds.z),
+			gather(bounds.extent_x), gather(bounds.extent_y), gather(bounds.extent_z), gather(bounds.radius));
+		for (; mask; mask &= mask - 1) {
+			out[count++] = matrices[i[std::countr_zero(unsigned(mask))]];
+		}
+	}
+#endif
+	for (; k < indices.size(); k++) {
+		if (visible(bounds, indices[k], planes)) {
+			out[count++] = matrices[indices[k]];
+		}
+	}
+	return count;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "instances.hpp"
+#include "mazebvh.hpp"
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <span>
+#include <vector>
+
+// CPU culling of instances against the view frustum and the fog distance,
+// run every frame before drawing. It only needs plain matrices, so it runs
+// without a device.
+
+// World bounds of instances in structure-of-arrays form: box center and half
+// extents, and the radius of the bounding sphere around the same center.
+// A test passes an instance if either one is not outside.
+struct InstanceBounds {
+	std::vector<float> x, y, z;
+	std::vector<float> extent_x, extent_y, extent_z;
+	std::vector<float> radius;
+
+	size_t size() const { return x.size(); }
+	void resize(size_t count);
+	// Bounds of a mesh with bounds local drawn with matrix m.
+	void set(size_t i, const Aabb& local, const InstanceMatrix& m);
+	void set(size_t begin, const Aabb& local, std::span<const InstanceMatrix> matrices);
+};
+
+Aabb meshBounds(std::span<const vertex_t> vertices);
+
+// Projection of the player's camera, the field of view is passed to
+// XMMatrixPerspectiveFovLH as is.
+constexpr float PLAYER_FOV_Y = 45.0f;
+constexpr float PLAYER_NEAR_Z = 0.03f;
+constexpr float PLAYER_FAR_Z = 100.0f;
+
+// Same as the matrix calcNewMatrix builds with DirectXMath, before it is
+// transposed for the shader: the player's view times XMMatrixPerspectiveFovLH.
+InstanceMatrix playerViewProjection(Vector2 position, float height, float rot_y, float rot_up_down, float aspect);
+
+constexpr size_t CULL_PLANES = 6;
+constexpr size_t CULL_MAX_PLANES = 8;
+
+// Normalized planes of the clip volume of a view-projection matrix in row
+// vector form, with depth from 0 to w as in D3D. A positive fog_distance
+// replaces the far plane by the clip depth at which the pixel shader fogs
+// everything to a flat color. The shader fogs by the length of the clip
+// position, which is never below its depth, so no visible instance is lost.
+std::array<Plane, CULL_PLANES> cullPlanes(const InstanceMatrix& view_projection, float fog_distance);
+
+// Copies the matrices of the instances in [begin, end) whose bounds are not
+// fully outside one of the planes to out, in order, and returns how many.
+// Four instances at a time with SSE2 where available, for at most
+// CULL_MAX_PLANES planes.
+size_t cullInstances(const InstanceBounds& bounds, std::span<const Plane> planes, size_t begin, size_t end,
+	const InstanceMatrix* matrices, InstanceMatrix* out);
+// Same for the instances listed in indices.
+size_t cullInstancesAt(const InstanceBounds& bounds, std::span<const Plane> planes, std::span<const uint32_t> indices,
+	const InstanceMatrix* matrices, InstanceMatrix* out);
+// One instance at a time with the same float operations, so both keep the same instances.
+size_t cullInstancesScalar(const InstanceBounds& bounds, std::span<const Plane> planes, size_t begin, size_t end,
+	const InstanceMatrix* matrices, InstanceMatrix* out);
@@ -0,0 +1,234 @@
+#include "indexedmesh.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+	// Scores from Forsyth's "Linear-Speed Vertex Cache Optimisation".
+	constexpr float CACHE_DECAY_POWER = 1.5f;
+	constexpr float LAST_TRIANGLE_SCORE = 0.75f;
+	constexpr float VALENCE_BOOST_SCALE = 2.0f;
+
+	constexpr uint32_t UNSET = UINT32_MAX;
+
+	// Adding 0 turns -0 into 0, so vertices equal in value are equal bitwise.
+	vertex_t canonical(vertex_t v) {
+		float length = std::sqrt(v.normal_vector[0] * v.normal_vector[0] + v.normal_vector[1] * v.normal_vector[1] + v.normal_vector[2] * v.normal_vector[2]);
+		if (length > 0) {
+			for (auto& c : v.normal_vector) {
+				c /= length;
+			}
+		}
+		for (auto& c : v.position) {
+			c += 0.0f;
+		}
+		for (auto& c : v.normal_vector) {
+			c += 0.0f;
+		}
+		for (auto& c : v.color) {
+			c += 0.0f;
+		}
+		for (auto& c : v.tex_coord) {
+			c += 0.0f;
+		}
+		return v;
+	}
+
+	float vertexScore(int cache_position, uint32_t remaining) {
+		if (remaining == 0) {
+			return -1;
+		}
+		float score = 0;
+		if (cache_position >= 0) {
+			// The last triangle's vertices score the same whatever order they were in.
+			score = cache_position < 3 ? LAST_TRIANGLE_SCORE
+				: std::pow(1 - float(cache_position - 3) / (VERTEX_CACHE_SCORING_SIZE - 3), CACHE_DECAY_POWER);
+		}
+		return score + VALENCE_BOOST_SCALE / std::sqrt(float(remaining));
+	}
+}
+
+IndexedMesh weldVertices(std::span<const vertex_t> triangles) {
+	assert(triangles.size() % 3 == 0);
+	std::vector<vertex_t> vertices(triangles.size());
+	std::transform(triangles.begin(), triangles.end(), vertices.begin(), canonical);
+
+	// Equal vertices end up next to each other, each one then maps to the
+	// first of its group in the original order.
+	std::vector<uint32_t> order(vertices.size());
+	for (uint32_t i = 0; i < order.size(); i++) {
+		order[i] = i;
+	}
+	std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+		int c = memcmp(&vertices[a], &vertices[b], sizeof(vertex_t));
+		return c != 0 ? c < 0 : a < b;
+	});
+	std::vector<uint32_t> first(vertices.size());
+	for (size_t i = 0; i < order.size(); i++) {
+		bool same = i > 0 && memcmp(&vertices[order[i]], &vertices[order[i - 1]], sizeof(vertex_t)) == 0;
+		first[order[i]] = same ? first[order[i - 1]] : order[i];
+	}
+
+	IndexedMesh mesh;
+	std::vector<uint32_t> welded(vertices.size());
+	mesh.indices.reserve(vertices.size());
+	for (uint32_t i = 0; i < vertices.size(); i++) {
+		if (first[i] == i) {
+			if (mesh.vertices.size() > UINT16_MAX) {
+				throw std::length_error("Mesh has more vertices than 16-bit indices can address");
+			}
+			welded[i] = uint32_t(mesh.vertices.size());
+			mesh.vertices.push_back(vertices[i]);
+		}
+		mesh.indices.push_back(uint16_t(welded[first[i]]));
+	}
+	return mesh;
+}
+
+void optimizeVertexCache(std::span<uint16_t> indices, size_t vertex_count) {
+	assert(indices.size() % 3 == 0);
+	const size_t triangle_count = indices.size() / 3;
+	if (triangle_count == 0) {
+		return;
+	}
+
+	// Triangles of every vertex, the first remaining[v] of them not emitted yet.
+	std::vector<uint32_t> offsets(vertex_count + 1, 0);
+	for (uint16_t v : indices) {
+		offsets[v + 1]++;
+	}
+	for (size_t v = 0; v < vertex_count; v++) {
+		offsets[v + 1] += offsets[v];
+	}
+	std::vector<uint32_t> remaining(vertex_count, 0);
+	std::vector<uint32_t> vertex_triangles(indices.size());
+	for (uint32_t t = 0; t < triangle_count; t++) {
+		for (int k = 0; k < 3; k++) {
+			uint16_t v = indices[t * 3 + k];
+			vertex_triangles[offsets[v] + remaining[v]++] = t;
+		}
+	}
+
+	std::vector<int> cache_position(vertex_count, -1);
+	std::vector<float> vertex_scores(vertex_count);
+	for (size_t v = 0; v < vertex_count; v++) {
+		vertex_scores[v] = vertexScore(-1, remaining[v]);
+	}
+	auto triangleScore = [&](size_t t) {
+		return vertex_scores[indices[t * 3]] + vertex_scores[indices[t * 3 + 1]] + vertex_scores[indices[t * 3 + 2]];
+	};
+	std::vector<uint8_t> emitted(triangle_count, 0);
+	size_t best = 0;
+	for (size_t t = 1; t < triangle_count; t++) {
+		if (triangleScore(t) > triangleScore(best)) {
+			best = t;
+		}
+	}
+
+	// Three more entries than the cache, for the vertices pushed out by the last triangle.
+	std::vector<uint16_t> cache, next_cache;
+	cache.reserve(VERTEX_CACHE_SCORING_SIZE + 3);
+	next_cache.reserve(VERTEX_CACHE_SCORING_SIZE + 3);
+	std::vector<uint16_t> out;
+	out.reserve(indices.size());
+	size_t cursor = 0;
+
+	for (size_t emitted_count = 0; emitted_count < triangle_count; emitted_count++) {
+		if (best == triangle_count) {
+			// Nothing in the cache has triangles left, start over at the next
+			// triangle in the input order.
+			while (emitted[cursor]) {
+				cursor++;
+			}
+			best = cursor;
+		}
+		emitted[best] = 1;
+		const uint16_t* triangle = &indices[best * 3];
+		out.insert(out.end(), triangle, triangle + 3);
+
+		next_cache.assign(triangle, triangle + 3);
+		for (int k = 0; k < 3; k++) {
+			uint16_t v = triangle[k];
+			uint32_t* list = &vertex_triangles[offsets[v]];
+			uint32_t* end = list + remaining[v];
+			std::iter_swap(std::find(list, end, uint32_t(best)), end - 1);
+			remaining[v]--;
+		}
+		for (uint16_t v : cache) {
+			if (v != triangle[0] && v != triangle[1] && v != triangle[2]) {
+				next_cache.push_back(v);
+			}
+		}
+
+		// Vertices pushed out of the cache lose their cache score, the rest
+		// get the score of their new position.
+		for (size_t i = 0; i < next_cache.size(); i++) {
+			uint16_t v = next_cache[i];
+			cache_position[v] = i < size_t(VERTEX_CACHE_SCORING_SIZE) ? int(i) : -1;
+			vertex_scores[v] = vertexScore(cache_position[v], remaining[v]);
+		}
+		best = triangle_count;
+		float best_score = -1;
+		for (uint16_t v : next_cache) {
+			for (uint32_t i = 0; i < remaining[v]; i++) {
+				uint32_t t = vertex_triangles[offsets[v] + i];
+				float score = triangleScore(t);
+				if (score > best_score) {
+					best_score = score;
+					best = t;
+				}
+			}
+		}
+		if (next_cache.size() > size_t(VERTEX_CACHE_SCORING_SIZE)) {
+			next_cache.resize(VERTEX_CACHE_SCORING_SIZE);
+		}
+		std::swap(cache, next_cache);
+	}
+	std::copy(out.begin(), out.end(), indices.begin());
+}
+
+void optimizeVertexFetch(IndexedMesh& mesh) {
+	std::vector<uint32_t> remap(mesh.vertices.size(), UNSET);
+	std::vector<vertex_t> vertices;
+	vertices.reserve(mesh.vertices.size());
+	for (auto& i : mesh.indices) {
+		if (remap[i] == UNSET) {
+			remap[i] = uint32_t(vertices.size());
+			vertices.push_back(mesh.vertices[i]);
+		}
+		i = uint16_t(remap[i]);
+	}
+	mesh.vertices = std::move(vertices);
+}
+
+float averageCacheMissRatio(std::span<const uint16_t> indices, size_t vertex_count, int cache_size) {
+	if (indices.empty()) {
+		return 0;
+	}
+	// A vertex is in the FIFO until cache_size misses after its own.
+	std::vector<uint32_t> missed_at(vertex_count, UNSET);
+	uint32_t misses = 0;
+	for (uint16_t v : indices) {
+		if (missed_at[v] == UNSET || misses - missed_at[v] >= uint32_t(cache_size)) {
+			missed_at[v] = misses++;
+		}
+	}
+	return float(misses) / float(indices.size() / 3);
+}
+
+IndexedMesh buildIndexedMesh(std::span<const vertex_t> triangles) {
+	IndexedMesh mesh = weldVertices(triangles);
+	optimizeVertexCache(mesh.indices, mesh.vertices.size());
+	optimizeVertexFetch(mesh);
+	return mesh;
+}
+
+MeshRange appendIndexedMesh(IndexedMesh& batch, const IndexedMesh& mesh) {
+	MeshRange range = {uint32_t(batch.indices.size()), uint32_t(mesh.indices.size()), int32_t(batch.vertices.size())};
+	batch.vertices.insert(batch.vertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+	batch.indices.insert(batch.indices.end(), mesh.indices.begin(), mesh.indices.end());
+	return range;
+}
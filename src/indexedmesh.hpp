@@ -0,0 +1,54 @@
+#pragma once
+
+#include "base.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Indexed meshes built from the triangle lists of mazemesh.hpp: identical
+// vertices are welded into one, triangles are ordered for the post-transform
+// vertex cache and vertices for fetch locality. Runs without a device.
+
+// Cache the ordering scores against, larger than most hardware has so the
+// order degrades gracefully on smaller caches.
+constexpr int VERTEX_CACHE_SCORING_SIZE = 32;
+// FIFO cache that the ACMR is measured with.
+constexpr int VERTEX_CACHE_SIZE = 16;
+
+struct IndexedMesh {
+	std::vector<vertex_t> vertices;
+	std::vector<uint16_t> indices;
+};
+
+// Part of a mesh appended to a shared buffer, as DrawIndexedInstanced takes it.
+struct MeshRange {
+	uint32_t start_index;
+	uint32_t index_count;
+	int32_t base_vertex;
+};
+
+// Welds bitwise identical vertices of a triangle list, keeping the triangle
+// order. Normals are normalized first, since the vertex shader normalizes
+// them anyway and fan triangles of different size then share vertices.
+// Throws std::length_error above 65536 vertices.
+IndexedMesh weldVertices(std::span<const vertex_t> triangles);
+
+// Reorders the triangles for the post-transform vertex cache, Tom Forsyth's
+// greedy scoring of recently used vertices and vertices with few triangles left.
+void optimizeVertexCache(std::span<uint16_t> indices, size_t vertex_count);
+
+// Reorders the vertices in the order the indices first use them and drops
+// vertices no triangle uses.
+void optimizeVertexFetch(IndexedMesh& mesh);
+
+// Average cache miss ratio, vertex shader runs per triangle with a FIFO cache
+// of cache_size. 3 for an unindexed list, at best about 0.5 for large grids.
+float averageCacheMissRatio(std::span<const uint16_t> indices, size_t vertex_count, int cache_size = VERTEX_CACHE_SIZE);
+
+// All three steps.
+IndexedMesh buildIndexedMesh(std::span<const vertex_t> triangles);
+
+// Appends mesh to the shared buffers of batch, the indices stay relative to
+// the base vertex of the returned range.
+MeshRange appendIndexedMesh(IndexedMesh& batch, const IndexedMesh& mesh);
@@ -0,0 +1,46 @@
+#include "instances.hpp"
+
+InstanceMatrix cuboidInstanceMatrix(const CuboidTransformation& t) {
+	float c = std::cos(t.rotation);
+	float s = std::sin(t.rotation);
+	float k = t.length_scale;
+	return {{
+		{k * c, 0, -k * s, 0},
+		{0, 1, 0, 0},
+		{s, 0, c, 0},
+		{t.translation.x, 0, t.translation.y, 1},
+	}};
+}
+
+InstanceMatrix translationInstanceMatrix(const TranslationTransformation& t) {
+	return {{
+		{1, 0, 0, 0},
+		{0, 1, 0, 0},
+		{0, 0, 1, 0},
+		{t.translation.x, 0, t.translation.y, 1},
+	}};
+}
+
+void storeCuboidMatrices(std::span<const CuboidTransformation> transformations, InstanceMatrix* dst) {
+	for (size_t k = 0; k < transformations.size(); ++k) {
+		dst[k] = cuboidInstanceMatrix(transformations[k]);
+	}
+}
+
+void storeTranslationMatrices(std::span<const TranslationTransformation> transformations, InstanceMatrix* dst) {
+	for (size_t k = 0; k < transformations.size(); ++k) {
+		dst[k] = translationInstanceMatrix(transformations[k]);
+	}
+}
+
+InstanceMatrix multiply(const InstanceMatrix& a, const InstanceMatrix& b) {
+	InstanceMatrix res = {};
+	for (int i = 0; i < 4; i++) {
+		for (int j = 0; j < 4; j++) {
+			for (int k = 0; k < 4; k++) {
+				res.m[i][j] += a.m[i][k] * b.m[k][j];
+			}
+		}
+	}
+	return res;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "maze.hpp"
+#include <span>
+
+// Per-instance world matrix, laid out like XMFLOAT4X4 (row vectors, translation
+// in the last row) so it can be copied into the instance buffer as is.
+struct InstanceMatrix {
+	float m[4][4];
+};
+
+// Same as XMMatrixScaling(length_scale, 1, 1) * XMMatrixRotationY(rotation) * XMMatrixTranslation(x, 0, y).
+InstanceMatrix cuboidInstanceMatrix(const CuboidTransformation& t);
+InstanceMatrix translationInstanceMatrix(const TranslationTransformation& t);
+
+void storeCuboidMatrices(std::span<const CuboidTransformation> transformations, InstanceMatrix* dst);
+void storeTranslationMatrices(std::span<const TranslationTransformation> transformations, InstanceMatrix* dst);
+
+// Same as XMMatrixMultiply(a, b), a row vector is transformed by a first.
+InstanceMatrix multiply(const InstanceMatrix& a, const InstanceMatrix& b);
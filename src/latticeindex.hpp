@@ -0,0 +1,184 @@
+#pragma once
+
+#include "base.hpp"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// Item indices bucketed by the parallelogram cells of the maze lattice from
+// coordsToHexOffset, cell (x, y) spans [x, x + 1) x [y, y + 1) in lattice
+// coordinates. Items are described by disks that together cover them.
+
+struct LatticeRange {
+	int x0, y0, x1, y1;
+};
+
+// Lattice cells overlapped by the square of side 2 * radius around center.
+inline LatticeRange latticeRange(Vector2 center, float radius, float step) {
+	const float row_height = step * sqrtf(3) / 2;
+	float fy0 = (center.y - radius) / row_height, fy1 = (center.y + radius) / row_height;
+	// x = X / step - y / 2 is smallest at the left edge and the top row.
+	float fx0 = (center.x - radius) / step - fy1 / 2, fx1 = (center.x + radius) / step - fy0 / 2;
+	return {int(std::floor(fx0)), int(std::floor(fy0)), int(std::floor(fx1)), int(std::floor(fy1))};
+}
+
+// Calls f(center, radius) for disks along the center line of a rectangle, at
+// most a lattice step apart. half_axis points along the length, its size is length / 2.
+template<typename F>
+void rectangleDisks(Vector2 center, Vector2 half_axis, float length, float width, float step, F f) {
+	int count = int(std::ceil(length / step)) + 1;
+	float radius = length / (2 * (count - 1)) + width / 2;
+	for (int i = 0; i < count; i++) {
+		f(center + half_axis * (2.f * i / (count - 1) - 1), radius);
+	}
+}
+
+class LatticeIndex {
+	float step = 0;
+	int x0 = 0, y0 = 0, columns = 0, rows = 0;
+	size_t item_count = 0;
+	std::vector<uint32_t> cell_begin;
+	std::vector<uint32_t> cell_items;
+
+	template<typename Disks, typename F>
+	void forEachCell(size_t item, Disks& disks, F f) const {
+		disks(item, [&](Vector2 center, float radius) {
+			LatticeRange r = latticeRange(center, radius, step);
+			for (int y = r.y0; y <= r.y1; y++) {
+				for (int x = r.x0; x <= r.x1; x++) {
+					f(size_t(y - y0) * columns + (x - x0));
+				}
+			}
+		});
+	}
+public:
+	bool built() const { return step != 0; }
+	// Items 0..itemCount() - 1 are in the cells, 0 before the first build.
+	size_t itemCount() const { return item_count; }
+
+	// disks(i, f) calls f(center, radius) for the covering disks of item i. Overlapping
+	// disks may add an item to a cell twice, which only costs a repeated test.
+	template<typename Disks>
+	void build(float length, float width, size_t count, Disks disks) {
+		step = length + width * sqrtf(3);
+		item_count = count;
+		LatticeRange bounds = {INT_MAX, INT_MAX, INT_MIN, INT_MIN};
+		for (size_t i = 0; i < count; i++) {
+			disks(i, [&](Vector2 center, float radius) {
+				LatticeRange r = latticeRange(center, radius, step);
+				bounds = {std::min(bounds.x0, r.x0), std::min(bounds.y0, r.y0), std::max(bounds.x1, r.x1), std::max(bounds.y1, r.y1)};
+			});
+		}
+		if (count == 0) {
+			bounds = {0, 0, -1, -1};
+		}
+		x0 = bounds.x0;
+		y0 = bounds.y0;
+		columns = bounds.x1 - bounds.x0 + 1;
+		rows = bounds.y1 - bounds.y0 + 1;
+
+		// Counting pass, then a fill pass into the prefix sums.
+		cell_begin.assign(size_t(columns) * rows + 1, 0);
+		for (size_t i = 0; i < count; i++) {
+			forEachCell(i, disks, [&](size_t cell) { cell_begin[cell + 1]++; });
+		}
+		for (size_t i = 1; i < cell_begin.size(); i++) {
+			cell_begin[i] += cell_begin[i - 1];
+		}
+		cell_items.resize(cell_begin.back());
+		std::vector<uint32_t> fill(cell_begin.begin(), cell_begin.end() - 1);
+		for (size_t i = 0; i < count; i++) {
+			forEachCell(i, disks, [&](size_t cell) { cell_items[fill[cell]++] = uint32_t(i); });
+		}
+	}
+
+	// Calls f(items, count) for the item lists of the cells under the square
+	// around center, stops and returns true as soon as f does.
+	template<typename F>
+	bool anyCell(Vector2 center, float radius, F f) const {
+		LatticeRange r = latticeRange(center, radius, step);
+		for (int y = std::max(r.y0, y0); y <= std::min(r.y1, y0 + rows - 1); y++) {
+			for (int x = std::max(r.x0, x0); x <= std::min(r.x1, x0 + columns - 1); x++) {
+				size_t cell = size_t(y - y0) * columns + (x - x0);
+				if (f(cell_items.data() + cell_begin[cell], size_t(cell_begin[cell + 1] - cell_begin[cell]))) {
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+
+	// Walks the cells the segment origin + direction * t, 0 <= t <= max_distance,
+	// passes through, in order, with a DDA over the lattice coordinates. Calls
+	// f(items, count, exit) where exit is the t at which the segment leaves the
+	// cell, stops and returns true as soon as f does.
+	template<typename F>
+	bool alongRay(Vector2 origin, Vector2 direction, float max_distance, F f) const {
+		if (columns <= 0 || rows <= 0) {
+			return false;
+		}
+		const float row_height = step * sqrtf(3) / 2;
+		float py = origin.y / row_height, dy = direction.y / row_height;
+		float px = origin.x / step - py / 2, dx = direction.x / step - dy / 2;
+
+		// Clip the segment to the bounds of the index.
+		float t0 = 0, t1 = max_distance;
+		auto clip = [&](float p, float d, float lo, float hi) {
+			if (d == 0) {
+				return p >= lo && p <= hi;
+			}
+			float a = (lo - p) / d, b = (hi - p) / d;
+			t0 = std::max(t0, std::min(a, b));
+			t1 = std::min(t1, std::max(a, b));
+			return t0 <= t1;
+		};
+		if (!clip(px, dx, float(x0), float(x0 + columns)) || !clip(py, dy, float(y0), float(y0 + rows))) {
+			return false;
+		}
+
+		int x = std::clamp(int(std::floor(px + dx * t0)), x0, x0 + columns - 1);
+		int y = std::clamp(int(std::floor(py + dy * t0)), y0, y0 + rows - 1);
+		const int step_x = dx > 0 ? 1 : -1, step_y = dy > 0 ? 1 : -1;
+		const float inf = std::numeric_limits<float>::infinity();
+		float delta_x = dx != 0 ? std::abs(1 / dx) : inf, delta_y = dy != 0 ? std::abs(1 / dy) : inf;
+		float next_x = dx != 0 ? (x + (dx > 0) - px) / dx : inf;
+		float next_y = dy != 0 ? (y + (dy > 0) - py) / dy : inf;
+		while (true) {
+			float exit = std::min({next_x, next_y, t1});
+			size_t cell = size_t(y - y0) * columns + (x - x0);
+			if (f(cell_items.data() + cell_begin[cell], size_t(cell_begin[cell + 1] - cell_begin[cell]), exit)) {
+				return true;
+			}
+			if (exit >= t1) {
+				return false;
+			}
+			if (next_x < next_y) {
+				x += step_x;
+				next_x += delta_x;
+			}
+			else {
+				y += step_y;
+				next_y += delta_y;
+			}
+			if (x < x0 || x >= x0 + columns || y < y0 || y >= y0 + rows) {
+				return false;
+			}
+		}
+	}
+
+	// Same as anyCell, but calls f(item) for every item.
+	template<typename F>
+	bool any(Vector2 center, float radius, F f) const {
+		return anyCell(center, radius, [&](const uint32_t* items, size_t count) {
+			for (size_t i = 0; i < count; i++) {
+				if (f(items[i])) {
+					return true;
+				}
+			}
+			return false;
+		});
+	}
+};
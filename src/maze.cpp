@@ -1,64 +1,42 @@
-#include "maze.hpp"
+#include "mazegrid.hpp"
+#include "mazestream.hpp"
 
 #include <random>
-#include <map>
+#include <algorithm>
+#include <unordered_set>
 
-struct SimpleColor {
-	float r, g, b;
+// Weighted sums of positions, normals and texture coordinates, the weights
+// make the sums sensitive to vertex order as well.
+struct MeshChecksum {
+	double position, normal, tex_coord;
 };
 
-struct Vector3 {
-	float x;
-	float y;
-	float z;
-};
-
-struct Triangle {
-	vertex_t t1[3];
-};
-
-SimpleColor color = {1.0f, 1.0f, 1.0f};
-
-constexpr float textureCoords(Vector3 v, Vector3 texture_offset, Vector3 base) {
-	return (v.x - texture_offset.x) * base.x + (v.y - texture_offset.y) * base.y + (v.z - texture_offset.z) * base.z;
-}
-
-constexpr Triangle makeSingleTriangle(Vector3 p1, Vector3 p2, Vector3 p3, Vector3 texture_offset, Vector3 basex, Vector3 basey) {
-	float Ax = p2.x - p1.x;
-	float Ay = p2.y - p1.y;
-	float Az = p2.z - p1.z;
-
-	float Bx = p3.x - p1.x;
-	float By = p3.y - p1.y;
-	float Bz = p3.z - p1.z;
-
-	float Nx = Ay * Bz - Az * By;
-	float Ny = Az * Bx - Ax * Bz;
-	float Nz = Ax * By - Ay * Bx;
-	
-	return { {
-		{p1.x, p1.y, p1.z,     Nx, Ny, Nz,    color.r, color.g, color.b, 1.0f,   textureCoords(p1, texture_offset, basex), textureCoords(p1, texture_offset, basey)},
-		{p2.x, p2.y, p2.z,     Nx, Ny, Nz,    color.r, color.g, color.b, 1.0f,   textureCoords(p2, texture_offset, basex), textureCoords(p2, texture_offset, basey)},
-		{p3.x, p3.y, p3.z,     Nx, Ny, Nz,    color.r, color.g, color.b, 1.0f,   textureCoords(p3, texture_offset, basex), textureCoords(p3, texture_offset, basey)},
-	} };
-}
-
-std::vector<Triangle> makeConvexShape(std::vector<Vector3> p, Vector3 texture_offset, Vector3 basex, Vector3 basey) {
-	std::vector<Triangle> res;
-	for (int i = 1; i < p.size() - 1; i++) {
-		res.push_back(makeSingleTriangle(p[0], p[i], p[i + 1], texture_offset, basex, basey));
+constexpr MeshChecksum meshChecksum(const vertex_t* v, int count) {
+	MeshChecksum res = {0, 0, 0};
+	for (int i = 0; i < count; i++) {
+		for (int k = 0; k < 3; k++) {
+			res.position += v[i].position[k] * (k + 1) * (i % 7 + 1);
+			res.normal += v[i].normal_vector[k] * (k + 1) * (i % 5 + 1);
+		}
+		for (int k = 0; k < 2; k++) {
+			res.tex_coord += v[i].tex_coord[k] * (k + 1) * (i % 3 + 1);
+		}
 	}
 	return res;
 }
 
-Vector3 rotateXZ(Vector3 v, float angle) {
-	Vector3 res;
-	res.y = v.y;
-	res.x = cos(angle) * v.x - sin(angle) * v.z;
-	res.z = sin(angle) * v.x + cos(angle) * v.z;
-	return res;
+constexpr bool matches(MeshChecksum a, MeshChecksum b) {
+	auto close = [](double x, double y) { return x - y < 1e-4 && y - x < 1e-4; };
+	return close(a.position, b.position) && close(a.normal, b.normal) && close(a.tex_coord, b.tex_coord);
 }
 
+// Checksums of the templates getMaze built at runtime (with std::vector
+// and trig) for the dimensions used by the app.
+constexpr MazeMeshes app_meshes = makeMazeMeshes(2, .2f, .5f);
+static_assert(matches(meshChecksum(app_meshes.cuboid, CUBOID_VERTEX_COUNT), {84.0999998, -8.7, 41.2000001}));
+static_assert(matches(meshChecksum(app_meshes.hexprism, HEXPRISM_VERTEX_COUNT), {121.4588461, 1.7183198, 36.6401928}));
+static_assert(matches(meshChecksum(app_meshes.floor, FLOOR_VERTEX_COUNT), {88, 128, 22}));
+
 bool isPartOfTriangle(int x, int y, int x_off, int y_off, int size) {
 	return x - x_off >= 0 && y - y_off >= 0 && x - x_off + y - y_off <= size;
 }
@@ -71,120 +49,103 @@ Vector2 coordsToHexOffset(int x, int y, float length, float width) {
 	return {float((2 * x + y) * (length + width * sqrt(3)) / 2), float(y * (length + width * sqrt(3)) / 2 * sqrt(3))};
 }
 
-struct node {
-	int x;
-	int y;
-};
+bool isBorderEdge(edge e, int side_edges) {
+	int x = e.n1.x, y = e.n1.y;
+	if (e.n2.y == y) {
+		return y == 0 || y == 2 * side_edges;
+	}
+	if (e.n2.x == x) {
+		return x == 0 || x == 2 * side_edges;
+	}
+	return x + y == 3 * side_edges || x + y == side_edges;
+}
 
-struct edge {
-	node n1;
-	node n2;
-};
+CuboidTransformation edgeToCuboid(edge e, float length, float width) {
+	Vector2 v1 = coordsToHexOffset(e.n1.x, e.n1.y, length, width), v2 = coordsToHexOffset(e.n2.x, e.n2.y, length, width);
+	return {
+		{(v1.x + v2.x) / 2, (v1.y + v2.y) / 2},
+		float((e.n1.x - e.n2.x == 0) ? 2 * PI / 3 :
+		((e.n1.y - e.n2.y == 0) ? 0 : -2 * PI / 3))
+	};
+}
 
-std::pair<int, int> Find(std::pair<int, int> p, std::map<std::pair<int, int>, std::pair<int, int>>& leaders) {
-	return (leaders[p] == p ? p : leaders[p] = Find(leaders[p], leaders));
+edge cuboidToEdge(const CuboidTransformation& t, float length, float width) {
+	const double step = length + width * sqrt(3);
+	// Lattice directions of walls with rotation 0, 2 * PI / 3 and -2 * PI / 3.
+	const node d = t.rotation == 0 ? node{1, 0} : (t.rotation > 0 ? node{0, 1} : node{-1, 1});
+	const int count = int(std::lround((t.length_scale * length + width * sqrt(3)) / step));
+	// Midpoint in doubled lattice coordinates, n1 + n2.
+	double y2 = 2 * t.translation.y / (step * sqrt(3) / 2);
+	double x2 = 2 * t.translation.x / step - y2 / 2;
+	node n1 = {int(std::lround(x2 - count * d.x) / 2), int(std::lround(y2 - count * d.y) / 2)};
+	return {n1, {n1.x + count * d.x, n1.y + count * d.y}};
 }
 
-void Union(std::pair<int, int> x, std::pair<int, int> y, std::map<std::pair<int, int>, std::pair<int, int>>& leaders) {
-	std::pair<int, int> leader_x = Find(x, leaders), leader_y = Find(y, leaders);
-	if (leader_x == leader_y) {
-		return;
+void addWall(MazeGraph& graph, edge e) {
+	if (e.n2.y < e.n1.y || (e.n2.y == e.n1.y && e.n2.x < e.n1.x)) {
+		std::swap(e.n1, e.n2);
 	}
-	leaders[leader_y] = leader_x;
+	int dir = e.n2.y == e.n1.y ? 0 : (e.n2.x == e.n1.x ? 1 : 2);
+	graph.walls[size_t(e.n1.y) * graph.side() + e.n1.x] |= uint8_t(1 << dir);
 }
 
-Maze getMaze(float length, float width, float height, int side_edges, int seed) {
-	float texturevec = 1 / std::max(std::max(height, length), 2 * width);
-	Maze res;
-	// Cuboid
-	std::vector<Triangle> cuboid;
-	Vector3 cuboid_verticies[8];
-	for (int h = 0; h <= 1; h++) {
-		for (int w = 0; w <= 1; w++) {
-			for (int l = 0; l <= 1; l++) {
-				cuboid_verticies[l * 1 + w * 2 + h * 4] = {l == 0 ? -length / 2 : length / 2, h == 0 ? 0 : height, w == 0 ? -width / 2 : width / 2};
-			}
-		}
-	}
-	std::vector<Triangle> temp;
-	// top
-	temp = makeConvexShape({cuboid_verticies[4], cuboid_verticies[6], cuboid_verticies[7], cuboid_verticies[5]}, cuboid_verticies[4], {texturevec, 0, 0}, {0, 0, texturevec});
-	cuboid.insert(cuboid.end(), temp.begin(), temp.end());
-	// right
-	temp = makeConvexShape({cuboid_verticies[5], cuboid_verticies[7], cuboid_verticies[3], cuboid_verticies[1]}, cuboid_verticies[1], {0, 0, texturevec}, {0, texturevec, 0});
-	cuboid.insert(cuboid.end(), temp.begin(), temp.end());
-	// front
-	temp = makeConvexShape({cuboid_verticies[4], cuboid_verticies[5], cuboid_verticies[1], cuboid_verticies[0]}, cuboid_verticies[0], {texturevec, 0, 0}, {0, texturevec, 0});
-	cuboid.insert(cuboid.end(), temp.begin(), temp.end());
-	// bottom
-	temp = makeConvexShape({cuboid_verticies[0], cuboid_verticies[1], cuboid_verticies[3], cuboid_verticies[2]}, cuboid_verticies[3], {-texturevec, 0, 0}, {0, 0, -texturevec});
-	cuboid.insert(cuboid.end(), temp.begin(), temp.end());
-	// left
-	temp = makeConvexShape({cuboid_verticies[4], cuboid_verticies[0], cuboid_verticies[2], cuboid_verticies[6]}, cuboid_verticies[0], {0, 0, texturevec}, {0, texturevec, 0});
-	cuboid.insert(cuboid.end(), temp.begin(), temp.end());
-	// back
-	temp = makeConvexShape({cuboid_verticies[2], cuboid_verticies[3], cuboid_verticies[7], cuboid_verticies[6]}, cuboid_verticies[2], {texturevec, 0, 0}, {0, texturevec});
-	cuboid.insert(cuboid.end(), temp.begin(), temp.end());
-	for (int i = 0; i < cuboid.size(); i++) {
-		res.cuboid[i * 3] = cuboid[i].t1[0];
-		res.cuboid[i * 3 + 1] = cuboid[i].t1[1];
-		res.cuboid[i * 3 + 2] = cuboid[i].t1[2];
-	}
-
-	// HexPrism
-	std::vector<Triangle> hexprism;
-	Vector3 hexprism_verticies[12];
-	hexprism_verticies[0] = {0, 0, width};
-	for (int i = 1; i < 6; i++) {
-		hexprism_verticies[i] = rotateXZ(hexprism_verticies[0], 2 * PI * i / 6);
-	}
-	for (int i = 6; i < 12; i++) {
-		hexprism_verticies[i] = hexprism_verticies[i - 6];
-		hexprism_verticies[i].y = height;
-	}
-	// top
-	temp = makeConvexShape({hexprism_verticies[0], hexprism_verticies[1], hexprism_verticies[2],hexprism_verticies[3],hexprism_verticies[4],hexprism_verticies[5]}, {hexprism_verticies[0].x - width, hexprism_verticies[0].y, hexprism_verticies[0].z - 2 * width}, {texturevec, 0, 0}, {0, 0, texturevec});
-	hexprism.insert(hexprism.end(), temp.begin(), temp.end());
-	// bottom
-	temp = makeConvexShape({hexprism_verticies[11], hexprism_verticies[10], hexprism_verticies[9],hexprism_verticies[8],hexprism_verticies[7],hexprism_verticies[6]}, {hexprism_verticies[6].x - width, hexprism_verticies[6].y, hexprism_verticies[6].z - 2 * width}, {texturevec, 0, 0}, {0, 0, texturevec});
-	hexprism.insert(hexprism.end(), temp.begin(), temp.end());
-	float z_impact[6] = {0.5, 1, 0.5, -0.5, -1, -0.5};
-	float x_impact[6] = {sqrt(3) / 2, 0, -sqrt(3) / 2, -sqrt(3) / 2, 0, sqrt(3) / 2};
-	for (int i = 0; i < 6; i++) {
-		temp = makeConvexShape({hexprism_verticies[i], hexprism_verticies[i + 6], hexprism_verticies[((i + 1) % 6) + 6], hexprism_verticies[(i + 1) % 6]}, hexprism_verticies[(i + 1) % 6], {texturevec * x_impact[i], 0, texturevec * z_impact[i]}, {0, texturevec, 0});
-		hexprism.insert(hexprism.end(), temp.begin(), temp.end());
-	}
-	for (int i = 0; i < hexprism.size(); i++) {
-		res.hexprism[i * 3] = hexprism[i].t1[0];
-		res.hexprism[i * 3 + 1] = hexprism[i].t1[1];
-		res.hexprism[i * 3 + 2] = hexprism[i].t1[2];
-	}
-
-	std::vector<Triangle> floor;
-	floor = makeConvexShape({{0, 0, 0}, {0, 0, length}, {length, 0, length}, {length, 0, 0}}, {0, 0, 0}, {texturevec, 0, 0}, {0, 0, texturevec});
-	for (int i = 0; i < floor.size(); i++) {
-		res.floor[i * 3] = floor[i].t1[0];
-		res.floor[i * 3 + 1] = floor[i].t1[1];
-		res.floor[i * 3 + 2] = floor[i].t1[2];
-	}
+void makeMazeBase(Maze& res, float length, float width, float height, int side_edges) {
+	constexpr auto copyMesh = [](const auto& src, auto& dst) {
+		std::copy(std::begin(src), std::end(src), std::begin(dst));
+	};
+	MazeMeshes meshes = makeMazeMeshes(length, width, height);
+	copyMesh(meshes.cuboid, res.cuboid);
+	copyMesh(meshes.hexprism, res.hexprism);
+	copyMesh(meshes.floor, res.floor);
+
+	res.transformations_floor.reserve(floorTileCount(side_edges));
 	for (int z = -side_edges; z < side_edges * 4; z++) {
 		for (int x = -side_edges; x < side_edges * 4; x++) {
 			res.transformations_floor.push_back({{x * length, z * length}});
 		}
 	}
 
+	res.player_coordinates = (coordsToHexOffset(side_edges, side_edges - 1, length, width) + coordsToHexOffset(side_edges, side_edges, length, width) + coordsToHexOffset(side_edges + 1, side_edges - 1, length, width)) / 3;
+	res.graph = {side_edges, std::vector<uint8_t>(size_t(side_edges * 3 + 1) * (side_edges * 3 + 1))};
+}
+
+// std::shuffle and the standard distributions are implementation defined, so
+// a seed would give different mazes on different standard libraries.
+uint32_t boundedRandom(std::mt19937& gen, uint32_t bound) {
+	uint32_t threshold = (0u - bound) % bound;
+	uint32_t r = gen();
+	while (r < threshold) {
+		r = gen();
+	}
+	return r % bound;
+}
+
+template<typename T>
+void stableShuffle(std::vector<T>& v, std::mt19937& gen) {
+	for (size_t i = v.size(); i > 1; i--) {
+		std::swap(v[i - 1], v[boundedRandom(gen, uint32_t(i))]);
+	}
+}
+
+Maze getMaze(float length, float width, float height, int side_edges, int seed) {
+	Maze res;
+	makeMazeBase(res, length, width, height, side_edges);
+
+	// Every buffer is sized up front, so a generation makes a fixed number of allocations.
 	std::vector<edge> final_edges;
 	std::vector<edge> temp_edges;
+	final_edges.reserve(wallCount(side_edges));
+	temp_edges.reserve(hexEdgeCount(side_edges) - borderEdgeCount(side_edges));
+	res.transformations_hexprism.reserve(hexNodeCount(side_edges));
+	res.transformations_cuboid.reserve(wallCount(side_edges));
 
-	std::map<std::pair<int, int>, std::pair<int, int>> leaders;
+	DisjointSet leaders(side_edges * 3 + 1);
 
 	for (int y = 0; y <= side_edges * 3; y++) {
 		for (int x = 0; x <= side_edges * 3; x++) {
 			if (isPartOfHex(x, y, side_edges)) {
 				res.transformations_hexprism.push_back({coordsToHexOffset(x, y, length, width)});
 
-				leaders[{x, y}] = {x, y};
-
 				if (isPartOfHex(x + 1, y, side_edges)) {
 					if (y == 0 || y == 2 * side_edges) {
 						final_edges.push_back({{x, y}, {x + 1, y}});
@@ -213,32 +174,108 @@ Maze getMaze(float length, float width, float height, int side_edges, int seed)
 		}
 	}
 
-	res.player_coordinates = (coordsToHexOffset(side_edges, side_edges - 1, length, width) + coordsToHexOffset(side_edges, side_edges, length, width) + coordsToHexOffset(side_edges + 1, side_edges - 1, length, width)) / 3;
-
 	std::mt19937 random_gen;
 	random_gen.seed(seed);
 
 	for (auto& edge : final_edges) {
-		Union({edge.n1.x, edge.n1.y}, {edge.n2.x, edge.n2.y}, leaders);
+		leaders.Union(edge.n1, edge.n2);
 	}
 
-	std::shuffle(temp_edges.begin(), temp_edges.end(), random_gen);
+	stableShuffle(temp_edges, random_gen);
 
 	for (auto& edge : temp_edges) {
-		if (Find({edge.n1.x, edge.n1.y}, leaders) != Find({edge.n2.x, edge.n2.y}, leaders)) {
+		if (leaders.Union(edge.n1, edge.n2)) {
 			final_edges.push_back(edge);
-			Union({edge.n1.x, edge.n1.y}, {edge.n2.x, edge.n2.y}, leaders);
 		}
 	}
 
 	for (auto& edge : final_edges) {
-		Vector2 v1 = coordsToHexOffset(edge.n1.x, edge.n1.y, length, width), v2 = coordsToHexOffset(edge.n2.x, edge.n2.y, length, width);
-		res.transformations_cuboid.push_back({
-			{(v1.x + v2.x) / 2, (v1.y + v2.y) / 2},
-			float((edge.n1.x - edge.n2.x == 0) ? 2 * PI / 3 :
-			((edge.n1.y - edge.n2.y == 0) ? 0 : -2 * PI / 3))
-			});
+		res.transformations_cuboid.push_back(edgeToCuboid(edge, length, width));
+		addWall(res.graph, edge);
 	}
 
 	return res;
-}
\ No newline at end of file
+}
+
+Maze generateMaze(MazeGenerator generator, float length, float width, float height, int side_edges, int seed) {
+	switch (generator) {
+	case MazeGenerator::ParallelKruskal:
+		return getMazeParallel(length, width, height, side_edges, seed);
+	case MazeGenerator::Eller: {
+		Maze res;
+		makeMazeBase(res, length, width, height, side_edges);
+		res.transformations_hexprism.reserve(hexNodeCount(side_edges));
+		res.transformations_cuboid.reserve(wallCount(side_edges));
+		MazeRowStream stream(length, width, side_edges, seed);
+		MazeRow row;
+		while (stream.next(row)) {
+			res.transformations_hexprism.insert(res.transformations_hexprism.end(), row.hexprisms.begin(), row.hexprisms.end());
+			res.transformations_cuboid.insert(res.transformations_cuboid.end(), row.cuboids.begin(), row.cuboids.end());
+		}
+		res.graph = wallGraph(res.transformations_cuboid, side_edges, length, width);
+		return res;
+	}
+	default:
+		return getMaze(length, width, height, side_edges, seed);
+	}
+}
+
+WallMergeStats mergeCollinearWalls(std::vector<CuboidTransformation>& walls, float length, float width) {
+	const double step = length + width * sqrt(3);
+	const node directions[3] = {{1, 0}, {0, 1}, {-1, 1}};
+	auto direction = [](const CuboidTransformation& t) {
+		return t.rotation == 0 ? 0 : (t.rotation > 0 ? 1 : 2);
+	};
+	auto key = [](node n) {
+		return uint64_t(uint32_t(n.x)) << 32 | uint32_t(n.y);
+	};
+	auto startNode = [&](const CuboidTransformation& t) {
+		return cuboidToEdge(t, length, width).n1;
+	};
+
+	std::unordered_set<uint64_t> starts[3];
+	for (auto& t : walls) {
+		starts[direction(t)].insert(key(startNode(t)));
+	}
+
+	std::vector<CuboidTransformation> merged;
+	for (auto& t : walls) {
+		int dir = direction(t);
+		node d = directions[dir];
+		node start = startNode(t);
+		if (starts[dir].count(key({start.x - d.x, start.y - d.y}))) {
+			continue;
+		}
+		int count = 1;
+		while (starts[dir].count(key({start.x + count * d.x, start.y + count * d.y}))) {
+			count++;
+		}
+		if (count == 1) {
+			merged.push_back(t);
+			continue;
+		}
+		Vector2 a = coordsToHexOffset(start.x, start.y, length, width);
+		Vector2 b = coordsToHexOffset(start.x + count * d.x, start.y + count * d.y, length, width);
+		// Pillars still cover the ends, like for single walls.
+		float merged_length = float(count * step - width * sqrt(3));
+		merged.push_back({(a + b) / 2, t.rotation, merged_length / length});
+	}
+
+	WallMergeStats stats = {walls.size(), merged.size()};
+	walls = std::move(merged);
+	return stats;
+}
+
+MazeGraph wallGraph(std::span<const CuboidTransformation> walls, int side_edges, float length, float width) {
+	MazeGraph graph = {side_edges, std::vector<uint8_t>(size_t(side_edges * 3 + 1) * (side_edges * 3 + 1))};
+	for (auto& t : walls) {
+		edge run = cuboidToEdge(t, length, width);
+		int count = std::max(std::abs(run.n2.x - run.n1.x), run.n2.y - run.n1.y);
+		node d = {(run.n2.x - run.n1.x) / count, (run.n2.y - run.n1.y) / count};
+		for (int i = 0; i < count; i++) {
+			node a = {run.n1.x + i * d.x, run.n1.y + i * d.y};
+			addWall(graph, {a, {a.x + d.x, a.y + d.y}});
+		}
+	}
+	return graph;
+}
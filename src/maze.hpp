@@ -1,21 +1,32 @@
 #pragma once
 
 #include "base.hpp"
+#include "mazemesh.hpp"
+#include <cstdint>
+#include <span>
 #include <vector>
 
-constexpr int CUBOID_VERTEX_COUNT = 3 * 6 * 2;
-constexpr int HEXPRISM_VERTEX_COUNT = 3 * (2 * 4 + 6 * 2);
-constexpr int FLOOR_VERTEX_COUNT = 3 * 2;
-
 struct CuboidTransformation {
 	Vector2 translation;
 	float rotation;
+	// Stretch along the wall, merged walls span several edges.
+	float length_scale = 1;
 };
 
 struct TranslationTransformation {
 	Vector2 translation;
 };
 
+// Walls as edges of the hex lattice, one byte per node of the (3 * side_edges + 1)^2
+// box. Bit d is the wall towards the (+1, 0), (0, +1) or (-1, +1) neighbour.
+struct MazeGraph {
+	int side_edges = 0;
+	std::vector<uint8_t> walls;
+
+	int side() const { return side_edges * 3 + 1; }
+	bool hasWall(int x, int y, int dir) const { return walls[size_t(y) * side() + x] >> dir & 1; }
+};
+
 struct Maze {
 	vertex_t cuboid[CUBOID_VERTEX_COUNT];
 	vertex_t hexprism[HEXPRISM_VERTEX_COUNT];
@@ -24,6 +35,30 @@ struct Maze {
 	std::vector<TranslationTransformation> transformations_hexprism;
 	std::vector<TranslationTransformation> transformations_floor;
 	Vector2 player_coordinates;
+	MazeGraph graph;
 };
 
 Maze getMaze(float length, float width, float height, int side_edges, int seed = 14369);
+
+// Tile-parallel generator, thread_count = 0 uses all hardware threads.
+// Deterministic for a given seed, but produces a different maze than getMaze.
+Maze getMazeParallel(float length, float width, float height, int side_edges, int seed = 14369, int thread_count = 0);
+
+enum class MazeGenerator {
+	Kruskal, ParallelKruskal, Eller
+};
+
+// All generators take the same seed, Eller is the row streaming one from mazestream.hpp.
+Maze generateMaze(MazeGenerator generator, float length, float width, float height, int side_edges, int seed = 14369);
+
+struct WallMergeStats {
+	size_t cuboids_before;
+	size_t cuboids_after;
+};
+
+// Fuses runs of collinear walls into single stretched cuboids. Drawing them
+// would stretch the brick texture too, so they are meant for collision.
+WallMergeStats mergeCollinearWalls(std::vector<CuboidTransformation>& walls, float length, float width);
+
+// Rebuilds the graph from wall transforms, e.g. of a cached maze file. Merged walls are split again.
+MazeGraph wallGraph(std::span<const CuboidTransformation> walls, int side_edges, float length, float width);
@@ -0,0 +1,152 @@
+#include "mazeagents.hpp"
+#include "mazephysics.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <numeric>
+
+void AgentSoA::add(Vector2 p, Vector2 v, float r) {
+	position.push_back(p);
+	velocity.push_back(v);
+	radius.push_back(r);
+}
+
+AgentStepper::AgentStepper(const ObjectHandler& walls, int thread_count):
+	walls(walls), pool(thread_count) {}
+
+void AgentStepper::buildGrid(const AgentSoA& agents) {
+	const size_t n = agents.size();
+	const size_t threads = size_t(pool.threadCount());
+	// The bucket count only depends on the agent count, not on the threads.
+	const size_t bucket_count = std::bit_ceil(std::max<size_t>(2 * n, 64));
+	bucket_mask = uint32_t(bucket_count - 1);
+	agent_bucket.resize(n);
+	bucket_agents.resize(n);
+	bucket_begin.resize(bucket_count + 1);
+	thread_offsets.resize(threads * bucket_count);
+	thread_totals.assign(threads, 0);
+	thread_radius.resize(threads);
+
+	pool.run([&](int t) {
+		float r = 0;
+		for (size_t i = n * t / threads; i < n * (t + 1) / threads; i++) {
+			r = std::max(r, agents.radius[i]);
+		}
+		thread_radius[t] = r;
+	});
+	cell_size = 2 * *std::max_element(thread_radius.begin(), thread_radius.end());
+	if (cell_size == 0) {
+		cell_size = 1;
+	}
+
+	// Count per thread, each thread owns a row of thread_offsets.
+	pool.run([&](int t) {
+		uint32_t* counts = thread_offsets.data() + t * bucket_count;
+		std::fill(counts, counts + bucket_count, 0);
+		for (size_t i = n * t / threads; i < n * (t + 1) / threads; i++) {
+			Vector2 p = agents.position[i];
+			uint32_t b = bucketOf(int(std::floor(p.x / cell_size)), int(std::floor(p.y / cell_size)));
+			agent_bucket[i] = b;
+			counts[b]++;
+		}
+	});
+	// Prefix sums in bucket-major, thread-minor order, so a bucket lists its
+	// agents by index. Each thread sums a range of buckets, then offsets it.
+	pool.forRanges(bucket_count, [&](size_t begin, size_t end, int t) {
+		size_t total = 0;
+		for (size_t b = begin; b < end; b++) {
+			for (size_t u = 0; u < threads; u++) {
+				total += thread_offsets[u * bucket_count + b];
+			}
+		}
+		thread_totals[t] = total;
+	});
+	std::exclusive_scan(thread_totals.begin(), thread_totals.end(), thread_totals.begin(), size_t(0));
+	pool.forRanges(bucket_count, [&](size_t begin, size_t end, int t) {
+		uint32_t offset = uint32_t(thread_totals[t]);
+		for (size_t b = begin; b < end; b++) {
+			bucket_begin[b] = offset;
+			for (size_t u = 0; u < threads; u++) {
+				uint32_t count = thread_offsets[u * bucket_count + b];
+				thread_offsets[u * bucket_count + b] = offset;
+				offset += count;
+			}
+		}
+	});
+	bucket_begin[bucket_count] = uint32_t(n);
+	pool.run([&](int t) {
+		uint32_t* offsets = thread_offsets.data() + t * bucket_count;
+		for (size_t i = n * t / threads; i < n * (t + 1) / threads; i++) {
+			bucket_agents[offsets[agent_bucket[i]]++] = uint32_t(i);
+		}
+	});
+}
+
+Vector2 AgentStepper::moveAgent(const AgentSoA& agents, uint32_t i, float dt, AgentStepStats& stats) const {
+	const Vector2 p = agents.position[i];
+	const float r = agents.radius[i];
+
+	// The 3x3 cells around the agent cover every agent it can overlap. Cells
+	// sharing a bucket are visited once, so no neighbour is counted twice.
+	int cx = int(std::floor(p.x / cell_size)), cy = int(std::floor(p.y / cell_size));
+	uint32_t buckets[9];
+	size_t bucket_count = 0;
+	for (int y = cy - 1; y <= cy + 1; y++) {
+		for (int x = cx - 1; x <= cx + 1; x++) {
+			buckets[bucket_count++] = bucketOf(x, y);
+		}
+	}
+	std::sort(buckets, buckets + bucket_count);
+	bucket_count = size_t(std::unique(buckets, buckets + bucket_count) - buckets);
+
+	// Overlapping agents push each other apart by half the overlap each.
+	Vector2 push = {0, 0};
+	for (size_t k = 0; k < bucket_count; k++) {
+		for (uint32_t e = bucket_begin[buckets[k]]; e < bucket_begin[buckets[k] + 1]; e++) {
+			uint32_t j = bucket_agents[e];
+			Vector2 d = p - agents.position[j];
+			float reach = r + agents.radius[j];
+			float distance2 = d.abs2();
+			if (j == i || distance2 >= reach * reach || distance2 == 0) {
+				continue;
+			}
+			float distance = std::sqrt(distance2);
+			push += d * ((reach - distance) / (2 * distance));
+			stats.contacts++;
+		}
+	}
+
+	// Against the walls, try the whole move, then each axis on its own.
+	const Vector2 delta = agents.velocity[i] * dt + push;
+	for (Vector2 move : {delta, Vector2{delta.x, 0}, Vector2{0, delta.y}}) {
+		Vector2 candidate = p + move;
+		if (!walls.collidesWith(HexObj({candidate}, r))) {
+			return candidate;
+		}
+	}
+	stats.blocked++;
+	return p;
+}
+
+AgentStepStats AgentStepper::step(AgentSoA& agents, float dt) {
+	const size_t n = agents.size();
+	buildGrid(agents);
+	next_position.resize(n);
+	thread_stats.assign(size_t(pool.threadCount()), {});
+	pool.forRanges(n, [&](size_t begin, size_t end, int t) {
+		AgentStepStats stats;
+		for (size_t i = begin; i < end; i++) {
+			next_position[i] = moveAgent(agents, uint32_t(i), dt, stats);
+		}
+		thread_stats[t] = stats;
+	});
+	std::swap(agents.position, next_position);
+
+	AgentStepStats total;
+	for (auto& s : thread_stats) {
+		total.contacts += s.contacts;
+		total.blocked += s.blocked;
+	}
+	return total;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "physics.hpp"
+#include "threadpool.hpp"
+#include <cstdint>
+#include <vector>
+
+// Circle agents in structure-of-arrays form, velocity is where an agent wants to go.
+struct AgentSoA {
+	std::vector<Vector2> position;
+	std::vector<Vector2> velocity;
+	std::vector<float> radius;
+
+	size_t size() const { return position.size(); }
+	void add(Vector2 position, Vector2 velocity, float radius);
+};
+
+struct AgentStepStats {
+	// Overlapping agent pairs, counted from both sides.
+	size_t contacts = 0;
+	// Agents that could not move at all because of a wall.
+	size_t blocked = 0;
+};
+
+// Moves agents against a wall set and each other, one tick at a time. The
+// walls are shared read only. A tick only reads the positions of the previous
+// one, so the results are the same for any number of threads.
+class AgentStepper {
+	const ObjectHandler& walls;
+	ThreadPool pool;
+
+	// Uniform grid over the agents with cells of the largest agent diameter,
+	// hashed into buckets and rebuilt every tick by a parallel counting sort.
+	float cell_size = 0;
+	uint32_t bucket_mask = 0;
+	std::vector<uint32_t> agent_bucket;
+	// Per thread bucket counts, then the write offsets of the threads.
+	std::vector<uint32_t> thread_offsets;
+	std::vector<uint32_t> bucket_begin;
+	std::vector<uint32_t> bucket_agents;
+	std::vector<size_t> thread_totals;
+	std::vector<float> thread_radius;
+	std::vector<AgentStepStats> thread_stats;
+	std::vector<Vector2> next_position;
+
+	uint32_t bucketOf(int x, int y) const {
+		return (uint32_t(x) * 73856093u ^ uint32_t(y) * 19349663u) & bucket_mask;
+	}
+	void buildGrid(const AgentSoA& agents);
+	Vector2 moveAgent(const AgentSoA& agents, uint32_t i, float dt, AgentStepStats& stats) const;
+public:
+	AgentStepper(const ObjectHandler& walls, int thread_count);
+
+	AgentStepStats step(AgentSoA& agents, float dt);
+};
@@ -0,0 +1,624 @@
+#include "mazebvh.hpp"
+#include "mazegrid.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <thread>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MAZE_BVH_SSE
+#include <emmintrin.h>
+#endif
+
+namespace {
+	constexpr float INF = std::numeric_limits<float>::infinity();
+	// Deeper nodes are split in the middle, so no leaf is deeper than
+	// BVH_MAX_DEPTH + 32, and a wide traversal pushes at most 3 entries per level.
+	constexpr int BVH_MAX_DEPTH = 48;
+	constexpr int STACK_SIZE = 3 * (BVH_MAX_DEPTH + 32) + 1;
+
+	constexpr Aabb EMPTY_AABB = {{INF, INF, INF}, {-INF, -INF, -INF}};
+
+	float axisOf(Vector3 v, int axis) {
+		return axis == 0 ? v.x : axis == 1 ? v.y : v.z;
+	}
+
+	void grow(Aabb& a, const Aabb& b) {
+		a.min = {std::min(a.min.x, b.min.x), std::min(a.min.y, b.min.y), std::min(a.min.z, b.min.z)};
+		a.max = {std::max(a.max.x, b.max.x), std::max(a.max.y, b.max.y), std::max(a.max.z, b.max.z)};
+	}
+
+	void grow(Aabb& a, Vector3 p) {
+		grow(a, Aabb{p, p});
+	}
+
+	Vector3 centroid(const Aabb& a) {
+		return {(a.min.x + a.max.x) / 2, (a.min.y + a.max.y) / 2, (a.min.z + a.max.z) / 2};
+	}
+
+	float surfaceArea(const Aabb& a) {
+		float dx = a.max.x - a.min.x, dy = a.max.y - a.min.y, dz = a.max.z - a.min.z;
+		return 2 * (dx * dy + dy * dz + dz * dx);
+	}
+
+	bool overlaps(const Aabb& a, const Aabb& b) {
+		return a.min.x <= b.max.x && a.max.x >= b.min.x &&
+			a.min.y <= b.max.y && a.max.y >= b.min.y &&
+			a.min.z <= b.max.z && a.max.z >= b.min.z;
+	}
+
+	// Zero direction components are nudged, so their inverse is large but finite
+	// and a ray in the plane of a box face does not produce NaNs.
+	Vector3 inverseDirection(Vector3 d) {
+		auto inv = [](float v) { return 1 / (std::abs(v) < 1e-30f ? 1e-30f : v); };
+		return {inv(d.x), inv(d.y), inv(d.z)};
+	}
+
+	// Entry distance into the box, INF if the ray misses it within [0, max_distance].
+	float boxEntry(const Aabb& b, Vector3 o, Vector3 inv, float max_distance) {
+		float x0 = (b.min.x - o.x) * inv.x, x1 = (b.max.x - o.x) * inv.x;
+		float y0 = (b.min.y - o.y) * inv.y, y1 = (b.max.y - o.y) * inv.y;
+		float z0 = (b.min.z - o.z) * inv.z, z1 = (b.max.z - o.z) * inv.z;
+		float t_enter = std::max({std::min(x0, x1), std::min(y0, y1), std::min(z0, z1), 0.f});
+		float t_leave = std::min({std::max(x0, x1), std::max(y0, y1), std::max(z0, z1), max_distance});
+		return t_enter <= t_leave ? t_enter : INF;
+	}
+
+	enum class Containment {
+		Outside, Intersects, Inside
+	};
+
+	// Outside if the box is fully behind one plane, Inside if it is in front of all.
+	Containment classify(const Aabb& b, std::span<const Plane> planes) {
+		Containment res = Containment::Inside;
+		for (const Plane& p : planes) {
+			// The corners furthest along and against the plane normal.
+			float furthest = p.a * (p.a >= 0 ? b.max.x : b.min.x) + p.b * (p.b >= 0 ? b.max.y : b.min.y) + p.c * (p.c >= 0 ? b.max.z : b.min.z) + p.d;
+			if (furthest < 0) {
+				return Containment::Outside;
+			}
+			float nearest = p.a * (p.a >= 0 ? b.min.x : b.max.x) + p.b * (p.b >= 0 ? b.min.y : b.max.y) + p.c * (p.c >= 0 ? b.min.z : b.max.z) + p.d;
+			if (nearest < 0) {
+				res = Containment::Intersects;
+			}
+		}
+		return res;
+	}
+
+	// Keeps the nearest hit, equal distances go to the lower item so every traversal agrees.
+	void keepNearest(BvhHit& hit, uint32_t item, float distance) {
+		if (distance < hit.distance || (distance == hit.distance && item < hit.item)) {
+			hit = {item, distance};
+		}
+	}
+
+	struct RayEntry {
+		uint32_t child;
+		uint32_t count;
+		float t;
+	};
+
+	// Entry distances into the four child boxes of a wide node, INF for misses.
+	void wideRayEntries(const Bvh4Node& n, Vector3 o, Vector3 inv, float max_distance, float out[4]) {
+#ifdef MAZE_BVH_SSE
+		auto slab = [](const float* lo, const float* hi, float origin, float inverse, __m128& t_enter, __m128& t_leave) {
+			__m128 ov = _mm_set1_ps(origin), iv = _mm_set1_ps(inverse);
+			__m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(lo), ov), iv);
+			__m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(hi), ov), iv);
+			t_enter = _mm_max_ps(t_enter, _mm_min_ps(t0, t1));
+			t_leave = _mm_min_ps(t_leave, _mm_max_ps(t0, t1));
+		};
+		__m128 t_enter = _mm_setzero_ps(), t_leave = _mm_set1_ps(max_distance);
+		slab(n.min_x, n.max_x, o.x, inv.x, t_enter, t_leave);
+		slab(n.min_y, n.max_y, o.y, inv.y, t_enter, t_leave);
+		slab(n.min_z, n.max_z, o.z, inv.z, t_enter, t_leave);
+		__m128 hit = _mm_cmple_ps(t_enter, t_leave);
+		_mm_storeu_ps(out, _mm_or_ps(_mm_and_ps(hit, t_enter), _mm_andnot_ps(hit, _mm_set1_ps(INF))));
+#else
+		for (int k = 0; k < 4; k++) {
+			out[k] = boxEntry({{n.min_x[k], n.min_y[k], n.min_z[k]}, {n.max_x[k], n.max_y[k], n.max_z[k]}}, o, inv, max_distance);
+		}
+#endif
+	}
+
+	// Bit k is set if child k overlaps the box.
+	uint32_t wideOverlapMask(const Bvh4Node& n, const Aabb& b) {
+#ifdef MAZE_BVH_SSE
+		auto axis = [](const float* lo, const float* hi, float box_lo, float box_hi) {
+			return _mm_and_ps(_mm_cmple_ps(_mm_load_ps(lo), _mm_set1_ps(box_hi)), _mm_cmpge_ps(_mm_load_ps(hi), _mm_set1_ps(box_lo)));
+		};
+		__m128 hit = _mm_and_ps(axis(n.min_x, n.max_x, b.min.x, b.max.x),
+			_mm_and_ps(axis(n.min_y, n.max_y, b.min.y, b.max.y), axis(n.min_z, n.max_z, b.min.z, b.max.z)));
+		return uint32_t(_mm_movemask_ps(hit));
+#else
+		uint32_t mask = 0;
+		for (int k = 0; k < 4; k++) {
+			mask |= uint32_t(overlaps({{n.min_x[k], n.min_y[k], n.min_z[k]}, {n.max_x[k], n.max_y[k], n.max_z[k]}}, b)) << k;
+		}
+		return mask;
+#endif
+	}
+
+	// classify() for the four children: bits of the children not outside, and
+	// of those fully inside.
+	void wideClassify(const Bvh4Node& n, std::span<const Plane> planes, uint32_t& visible, uint32_t& inside) {
+#ifdef MAZE_BVH_SSE
+		__m128 outside_any = _mm_setzero_ps(), intersects_any = _mm_setzero_ps();
+		const __m128 zero = _mm_setzero_ps();
+		for (const Plane& p : planes) {
+			auto dot = [&](const float* x, const float* y, const float* z) {
+				__m128 v = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(p.a), _mm_load_ps(x)), _mm_mul_ps(_mm_set1_ps(p.b), _mm_load_ps(y)));
+				return _mm_add_ps(_mm_add_ps(v, _mm_mul_ps(_mm_set1_ps(p.c), _mm_load_ps(z))), _mm_set1_ps(p.d));
+			};
+			__m128 furthest = dot(p.a >= 0 ? n.max_x : n.min_x, p.b >= 0 ? n.max_y : n.min_y, p.c >= 0 ? n.max_z : n.min_z);
+			__m128 nearest = dot(p.a >= 0 ? n.min_x : n.max_x, p.b >= 0 ? n.min_y : n.max_y, p.c >= 0 ? n.min_z : n.max_z);
+			outside_any = _mm_or_ps(outside_any, _mm_cmplt_ps(furthest, zero));
+			intersects_any = _mm_or_ps(intersects_any, _mm_cmplt_ps(nearest, zero));
+		}
+		visible = uint32_t(~_mm_movemask_ps(outside_any)) & 0xf;
+		inside = visible & ~uint32_t(_mm_movemask_ps(intersects_any));
+#else
+		visible = inside = 0;
+		for (int k = 0; k < 4; k++) {
+			Containment c = classify({{n.min_x[k], n.min_y[k], n.min_z[k]}, {n.max_x[k], n.max_y[k], n.max_z[k]}}, planes);
+			visible |= uint32_t(c != Containment::Outside) << k;
+			inside |= uint32_t(c == Containment::Inside) << k;
+		}
+#endif
+	}
+}
+
+void MazeBvh::build(std::span<const CuboidTransformation> cuboids, std::span<const TranslationTransformation> hexprisms,
+	float length, float width, float height, int thread_count) {
+	if (thread_count <= 0) {
+		thread_count = std::max(1u, std::thread::hardware_concurrency());
+	}
+	this->height = height;
+	wall_count = uint32_t(cuboids.size());
+	const size_t count = cuboids.size() + hexprisms.size();
+	centers.resize(count);
+	rotations.resize(count);
+	half_extents.resize(count);
+	item_bounds.resize(count);
+	items.resize(count);
+	std::vector<BuildRef> refs(count);
+
+	parallelFor(thread_count, thread_count, [&](int t) {
+		for (size_t i = count * t / thread_count; i < count * (t + 1) / thread_count; i++) {
+			Vector2 half_xz;
+			if (i < wall_count) {
+				const CuboidTransformation& c = cuboids[i];
+				float cs = std::cos(c.rotation), sn = std::sin(c.rotation);
+				centers[i] = c.translation;
+				rotations[i] = {cs, sn};
+				half_extents[i] = {length * c.length_scale / 2, width / 2};
+				half_xz = {std::abs(cs) * half_extents[i].x + std::abs(sn) * half_extents[i].y,
+					std::abs(sn) * half_extents[i].x + std::abs(cs) * half_extents[i].y};
+			}
+			else {
+				centers[i] = hexprisms[i - wall_count].translation;
+				rotations[i] = {1, 0};
+				half_extents[i] = {width, width};
+				half_xz = {width * SQRT3 / 2, width};
+			}
+			item_bounds[i] = {{centers[i].x - half_xz.x, 0, centers[i].y - half_xz.y}, {centers[i].x + half_xz.x, height, centers[i].y + half_xz.y}};
+			refs[i] = {item_bounds[i], centroid(item_bounds[i]), uint32_t(i)};
+		}
+	});
+
+	nodes.clear();
+	wide_nodes.clear();
+	if (count == 0) {
+		return;
+	}
+	// Subtrees are built into slots of their own, so threads never share a
+	// node: the tree over n items uses at most 2n - 1 slots, so the first
+	// child of slot s is at s + 1 and the second after 2 * (left items) - 1 more.
+	std::vector<BvhNode> sparse(2 * count - 1);
+	int spawn_depth = 0;
+	while ((1 << spawn_depth) < thread_count) {
+		spawn_depth++;
+	}
+	buildNode(sparse, refs, 0, 0, uint32_t(count), 0, spawn_depth);
+	for (size_t i = 0; i < count; i++) {
+		items[i] = refs[i].item;
+	}
+
+	// Depth-first copy without the unused slots.
+	nodes.reserve(count);
+	auto compact = [&](auto& self, uint32_t slot) -> uint32_t {
+		uint32_t index = uint32_t(nodes.size());
+		nodes.push_back(sparse[slot]);
+		if (sparse[slot].count == 0) {
+			self(self, slot + 1);
+			uint32_t second = self(self, sparse[slot].offset);
+			nodes[index].offset = second;
+		}
+		return index;
+	};
+	compact(compact, 0);
+	collapse(0);
+}
+
+void MazeBvh::buildNode(std::vector<BvhNode>& sparse, std::vector<BuildRef>& refs, uint32_t slot, uint32_t begin, uint32_t end, int depth, int spawn_depth) {
+	Aabb bounds = EMPTY_AABB, centroids = EMPTY_AABB;
+	for (uint32_t i = begin; i < end; i++) {
+		grow(bounds, refs[i].bounds);
+		grow(centroids, refs[i].centroid);
+	}
+	const uint32_t n = end - begin;
+	sparse[slot] = {bounds, begin, n};
+	if (n <= 2) {
+		return;
+	}
+
+	// Binned SAH over the axes with centroid extent, with the cost of a leaf
+	// being its item count and an inner node costing one item test more.
+	float best_cost = INF;
+	int best_axis = -1, best_bin = 0;
+	if (depth < BVH_MAX_DEPTH) {
+		for (int axis = 0; axis < 3; axis++) {
+			float lo = axisOf(centroids.min, axis), extent = axisOf(centroids.max, axis) - lo;
+			if (extent <= 0) {
+				continue;
+			}
+			Aabb bins[BVH_BINS];
+			uint32_t counts[BVH_BINS] = {};
+			std::fill(std::begin(bins), std::end(bins), EMPTY_AABB);
+			const float scale = BVH_BINS / extent;
+			for (uint32_t i = begin; i < end; i++) {
+				int bin = std::min(BVH_BINS - 1, int((axisOf(refs[i].centroid, axis) - lo) * scale));
+				grow(bins[bin], refs[i].bounds);
+				counts[bin]++;
+			}
+			float right_area[BVH_BINS];
+			Aabb right = EMPTY_AABB;
+			for (int k = BVH_BINS - 1; k > 0; k--) {
+				grow(right, bins[k]);
+				right_area[k] = surfaceArea(right);
+			}
+			Aabb left = EMPTY_AABB;
+			uint32_t left_count = 0;
+			for (int k = 0; k < BVH_BINS - 1; k++) {
+				grow(left, bins[k]);
+				left_count += counts[k];
+				if (left_count == 0 || left_count == n) {
+					continue;
+				}
+				float cost = 1 + (surfaceArea(left) * left_count + right_area[k + 1] * (n - left_count)) / surfaceArea(bounds);
+				if (cost < best_cost) {
+					best_cost = cost;
+					best_axis = axis;
+					best_bin = k;
+				}
+			}
+		}
+		if (n <= BVH_MAX_LEAF && best_cost >= n) {
+			return;
+		}
+	}
+
+	uint32_t middle = begin + n / 2;
+	if (best_axis >= 0) {
+		float lo = axisOf(centroids.min, best_axis);
+		float scale = BVH_BINS / (axisOf(centroids.max, best_axis) - lo);
+		middle = uint32_t(std::partition(refs.begin() + begin, refs.begin() + end, [&](const BuildRef& r) {
+			return std::min(BVH_BINS - 1, int((axisOf(r.centroid, best_axis) - lo) * scale)) <= best_bin;
+		}) - refs.begin());
+	}
+	else {
+		// No useful plane, or too deep: halve along the widest centroid axis.
+		int axis = 0;
+		for (int a = 1; a < 3; a++) {
+			if (axisOf(centroids.max, a) - axisOf(centroids.min, a) > axisOf(centroids.max, axis) - axisOf(centroids.min, axis)) {
+				axis = a;
+			}
+		}
+		std::nth_element(refs.begin() + begin, refs.begin() + middle, refs.begin() + end, [&](const BuildRef& a, const BuildRef& b) {
+			return axisOf(a.centroid, axis) < axisOf(b.centroid, axis);
+		});
+	}
+
+	const uint32_t second = slot + 2 * (middle - begin);
+	sparse[slot] = {bounds, second, 0};
+	if (spawn_depth > 0) {
+		std::thread first([&]() { buildNode(sparse, refs, slot + 1, begin, middle, depth + 1, spawn_depth - 1); });
+		buildNode(sparse, refs, second, middle, end, depth + 1, spawn_depth - 1);
+		first.join();
+	}
+	else {
+		buildNode(sparse, refs, slot + 1, begin, middle, depth + 1, 0);
+		buildNode(sparse, refs, second, middle, end, depth + 1, 0);
+	}
+}
+
+uint32_t MazeBvh::collapse(uint32_t node) {
+	// Opens the inner child with the largest area until there are four children.
+	uint32_t children[4] = {node};
+	int count = 1;
+	if (nodes[node].count == 0) {
+		children[0] = node + 1;
+		children[1] = nodes[node].offset;
+		count = 2;
+		while (count < 4) {
+			int open = -1;
+			for (int k = 0; k < count; k++) {
+				if (nodes[children[k]].count == 0 && (open < 0 || surfaceArea(nodes[children[k]].bounds) > surfaceArea(nodes[children[open]].bounds))) {
+					open = k;
+				}
+			}
+			if (open < 0) {
+				break;
+			}
+			uint32_t opened = children[open];
+			children[open] = opened + 1;
+			children[count++] = nodes[opened].offset;
+		}
+	}
+
+	const uint32_t index = uint32_t(wide_nodes.size());
+	wide_nodes.emplace_back();
+	Bvh4Node wide;
+	for (int k = 0; k < 4; k++) {
+		const BvhNode* child = k < count ? &nodes[children[k]] : nullptr;
+		Aabb b = child ? child->bounds : Aabb{{INF, INF, INF}, {INF, INF, INF}};
+		wide.min_x[k] = b.min.x;
+		wide.min_y[k] = b.min.y;
+		wide.min_z[k] = b.min.z;
+		wide.max_x[k] = b.max.x;
+		wide.max_y[k] = b.max.y;
+		wide.max_z[k] = b.max.z;
+		wide.child[k] = !child ? BVH_NO_ITEM : child->count ? child->offset : collapse(children[k]);
+		wide.count[k] = child ? child->count : 0;
+	}
+	wide_nodes[index] = wide;
+	return index;
+}
+
+float MazeBvh::rayItem(uint32_t item, Vector3 origin, Vector3 direction, float max_distance) const {
+	float t_enter = 0, t_leave = max_distance;
+	// The slab |dot(normal, p - center)| <= half, normal having unit length.
+	auto slab = [&](float offset, float along, float half) {
+		if (along == 0) {
+			return std::abs(offset) <= half;
+		}
+		float t0 = (-half - offset) / along, t1 = (half - offset) / along;
+		t_enter = std::max(t_enter, std::min(t0, t1));
+		t_leave = std::min(t_leave, std::max(t0, t1));
+		return t_enter <= t_leave;
+	};
+	if (!slab(origin.y - height / 2, direction.y, height / 2)) {
+		return INF;
+	}
+	Vector2 o = {origin.x - centers[item].x, origin.z - centers[item].y};
+	Vector2 d = {direction.x, direction.z};
+	Vector2 half = half_extents[item];
+	if (item < wall_count) {
+		// The wall axes as in RectangleObj, along (cos, -sin) and across (sin, cos).
+		float c = rotations[item].x, s = rotations[item].y;
+		if (!slab(c * o.x - s * o.y, c * d.x - s * d.y, half.x) || !slab(s * o.x + c * o.y, s * d.x + c * d.y, half.y)) {
+			return INF;
+		}
+		return t_enter;
+	}
+	// Hexagon with corners at 30, 90 and 150 degrees, the edge normals are at 0, 60 and 120.
+	const float apothem = half.x * SQRT3 / 2;
+	if (!slab(o.x, d.x, apothem) ||
+		!slab(0.5f * o.x + SQRT3 / 2 * o.y, 0.5f * d.x + SQRT3 / 2 * d.y, apothem) ||
+		!slab(-0.5f * o.x + SQRT3 / 2 * o.y, -0.5f * d.x + SQRT3 / 2 * d.y, apothem)) {
+		return INF;
+	}
+	return t_enter;
+}
+
+BvhHit MazeBvh::raycast(Vector3 origin, Vector3 direction, float max_distance) const {
+	BvhHit hit;
+	hit.distance = max_distance;
+	if (nodes.empty()) {
+		return hit;
+	}
+	const Vector3 inv = inverseDirection(direction);
+	RayEntry stack[STACK_SIZE];
+	int size = 0;
+	float t = boxEntry(nodes[0].bounds, origin, inv, max_distance);
+	if (t != INF) {
+		stack[size++] = {0, 0, t};
+	}
+	while (size > 0) {
+		RayEntry e = stack[--size];
+		if (e.t > hit.distance) {
+			continue;
+		}
+		const BvhNode& n = nodes[e.child];
+		if (n.count) {
+			for (uint32_t i = n.offset; i < n.offset + n.count; i++) {
+				keepNearest(hit, items[i], rayItem(items[i], origin, direction, hit.distance));
+			}
+			continue;
+		}
+		// The nearer child goes on top.
+		RayEntry first = {e.child + 1, 0, boxEntry(nodes[e.child + 1].bounds, origin, inv, hit.distance)};
+		RayEntry second = {n.offset, 0, boxEntry(nodes[n.offset].bounds, origin, inv, hit.distance)};
+		if (first.t < second.t) {
+			std::swap(first, second);
+		}
+		for (const RayEntry& c : {first, second}) {
+			if (c.t != INF) {
+				stack[size++] = c;
+			}
+		}
+	}
+	return hit;
+}
+
+void MazeBvh::frustum(std::span<const Plane> planes, std::vector<uint32_t>& out) const {
+	if (nodes.empty()) {
+		return;
+	}
+	struct Entry {
+		uint32_t node;
+		bool inside;
+	};
+	Entry stack[STACK_SIZE];
+	int size = 0;
+	stack[size++] = {0, false};
+	while (size > 0) {
+		Entry e = stack[--size];
+		const BvhNode& n = nodes[e.node];
+		bool inside = e.inside;
+		if (!inside) {
+			Containment c = classify(n.bounds, planes);
+			if (c == Containment::Outside) {
+				continue;
+			}
+			inside = c == Containment::Inside;
+		}
+		if (n.count) {
+			for (uint32_t i = n.offset; i < n.offset + n.count; i++) {
+				if (inside || classify(item_bounds[items[i]], planes) != Containment::Outside) {
+					out.push_back(items[i]);
+				}
+			}
+			continue;
+		}
+		stack[size++] = {n.offset, inside};
+		stack[size++] = {e.node + 1, inside};
+	}
+}
+
+void MazeBvh::overlap(const Aabb& box, std::vector<uint32_t>& out) const {
+	if (nodes.empty()) {
+		return;
+	}
+	uint32_t stack[STACK_SIZE];
+	int size = 0;
+	stack[size++] = 0;
+	while (size > 0) {
+		uint32_t index = stack[--size];
+		const BvhNode& n = nodes[index];
+		if (!overlaps(n.bounds, box)) {
+			continue;
+		}
+		if (n.count) {
+			for (uint32_t i = n.offset; i < n.offset + n.count; i++) {
+				if (overlaps(item_bounds[items[i]], box)) {
+					out.push_back(items[i]);
+				}
+			}
+			continue;
+		}
+		stack[size++] = n.offset;
+		stack[size++] = index + 1;
+	}
+}
+
+BvhHit MazeBvh::raycastWide(Vector3 origin, Vector3 direction, float max_distance) const {
+	BvhHit hit;
+	hit.distance = max_distance;
+	if (wide_nodes.empty()) {
+		return hit;
+	}
+	const Vector3 inv = inverseDirection(direction);
+	RayEntry stack[STACK_SIZE];
+	int size = 0;
+	stack[size++] = {0, 0, 0};
+	while (size > 0) {
+		RayEntry e = stack[--size];
+		if (e.t > hit.distance) {
+			continue;
+		}
+		if (e.count) {
+			for (uint32_t i = e.child; i < e.child + e.count; i++) {
+				keepNearest(hit, items[i], rayItem(items[i], origin, direction, hit.distance));
+			}
+			continue;
+		}
+		const Bvh4Node& n = wide_nodes[e.child];
+		float t[4];
+		wideRayEntries(n, origin, inv, hit.distance, t);
+		// Push the hit children furthest first, so the nearest is popped next.
+		RayEntry hits[4];
+		int count = 0;
+		for (int k = 0; k < 4; k++) {
+			if (t[k] != INF && n.child[k] != BVH_NO_ITEM) {
+				RayEntry c = {n.child[k], n.count[k], t[k]};
+				int j = count++;
+				for (; j > 0 && hits[j - 1].t < c.t; j--) {
+					hits[j] = hits[j - 1];
+				}
+				hits[j] = c;
+			}
+		}
+		for (int k = 0; k < count; k++) {
+			stack[size++] = hits[k];
+		}
+	}
+	return hit;
+}
+
+void MazeBvh::frustumWide(std::span<const Plane> planes, std::vector<uint32_t>& out) const {
+	if (wide_nodes.empty()) {
+		return;
+	}
+	struct Entry {
+		uint32_t child;
+		uint32_t count;
+		bool inside;
+	};
+	Entry stack[STACK_SIZE];
+	int size = 0;
+	stack[size++] = {0, 0, false};
+	while (size > 0) {
+		Entry e = stack[--size];
+		if (e.count) {
+			for (uint32_t i = e.child; i < e.child + e.count; i++) {
+				if (e.inside || classify(item_bounds[items[i]], planes) != Containment::Outside) {
+					out.push_back(items[i]);
+				}
+			}
+			continue;
+		}
+		const Bvh4Node& n = wide_nodes[e.child];
+		uint32_t visible = 0xf, inside = 0xf;
+		if (!e.inside) {
+			wideClassify(n, planes, visible, inside);
+		}
+		for (int k = 3; k >= 0; k--) {
+			if ((visible >> k & 1) && n.child[k] != BVH_NO_ITEM) {
+				stack[size++] = {n.child[k], n.count[k], bool(inside >> k & 1)};
+			}
+		}
+	}
+}
+
+void MazeBvh::overlapWide(const Aabb& box, std::vector<uint32_t>& out) const {
+	if (wide_nodes.empty()) {
+		return;
+	}
+	struct Entry {
+		uint32_t child;
+		uint32_t count;
+	};
+	Entry stack[STACK_SIZE];
+	int size = 0;
+	stack[size++] = {0, 0};
+	while (size > 0) {
+		Entry e = stack[--size];
+		if (e.count) {
+			for (uint32_t i = e.child; i < e.child + e.count; i++) {
+				if (overlaps(item_bounds[items[i]], box)) {
+					out.push_back(items[i]);
+				}
+			}
+			continue;
+		}
+		const Bvh4Node& n = wide_nodes[e.child];
+		uint32_t mask = wideOverlapMask(n, box);
+		for (int k = 3; k >= 0; k--) {
+			if ((mask >> k & 1) && n.child[k] != BVH_NO_ITEM) {
+				stack[size++] = {n.child[k], n.count[k]};
+			}
+		}
+	}
+}
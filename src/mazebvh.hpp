@@ -0,0 +1,100 @@
+#pragma once
+
+#include "maze.hpp"
+#include "mazemesh.hpp"
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// World space as drawn: x and z are the maze plane, y points up.
+struct Aabb {
+	Vector3 min, max;
+};
+
+// Plane a * x + b * y + c * z + d = 0, points with a positive value are inside.
+struct Plane {
+	float a, b, c, d;
+};
+
+// Binary BVH node in 32 bytes. Nodes are stored depth first, so the first
+// child of an inner node follows it and offset is the index of the second.
+// A leaf holds count items from offset in the item order of the tree.
+struct BvhNode {
+	Aabb bounds;
+	uint32_t offset;
+	uint32_t count;
+};
+
+// Four children with their bounds in structure-of-arrays form, so one node
+// is tested with 4-wide instructions. A child with count 0 is an inner node
+// at index child, otherwise a leaf of count items from child. Unused slots
+// have empty bounds, which no test passes.
+struct alignas(64) Bvh4Node {
+	float min_x[4], min_y[4], min_z[4];
+	float max_x[4], max_y[4], max_z[4];
+	uint32_t child[4];
+	uint32_t count[4];
+};
+
+constexpr uint32_t BVH_NO_ITEM = UINT32_MAX;
+constexpr int BVH_BINS = 16;
+constexpr uint32_t BVH_MAX_LEAF = 8;
+
+struct BvhHit {
+	uint32_t item = BVH_NO_ITEM;
+	float distance = 0;
+
+	bool hit() const { return item != BVH_NO_ITEM; }
+};
+
+// Static BVH over the wall cuboids and pillar prisms of a maze, built with a
+// binned SAH. Items are numbered walls first, then pillars, in the order of
+// the maze arrays. Queries on the wide nodes give the same answers.
+class MazeBvh {
+	float height = 0;
+	uint32_t wall_count = 0;
+	// Per item: center and the cos/sin of the rotation in the maze plane, plus
+	// half extents along and across walls. Pillars are hexagons of radius width.
+	std::vector<Vector2> centers;
+	std::vector<Vector2> rotations;
+	std::vector<Vector2> half_extents;
+	std::vector<Aabb> item_bounds;
+	// Items in leaf order, a leaf lists a range of it.
+	std::vector<uint32_t> items;
+	std::vector<BvhNode> nodes;
+	std::vector<Bvh4Node> wide_nodes;
+
+	// Items are partitioned as copies of their bounds, which keeps the build's memory access sequential.
+	struct BuildRef {
+		Aabb bounds;
+		Vector3 centroid;
+		uint32_t item;
+	};
+	void buildNode(std::vector<BvhNode>& sparse, std::vector<BuildRef>& refs, uint32_t slot, uint32_t begin, uint32_t end, int depth, int spawn_depth);
+	uint32_t collapse(uint32_t node);
+public:
+	// Rebuilds from scratch, the top levels of the tree are split over up to
+	// thread_count threads, 0 uses all hardware threads.
+	void build(std::span<const CuboidTransformation> cuboids, std::span<const TranslationTransformation> hexprisms,
+		float length, float width, float height, int thread_count = 1);
+
+	size_t itemCount() const { return item_bounds.size(); }
+	size_t nodeCount() const { return nodes.size(); }
+	size_t wideNodeCount() const { return wide_nodes.size(); }
+	bool isPillar(uint32_t item) const { return item >= wall_count; }
+	const Aabb& itemBounds(uint32_t item) const { return item_bounds[item]; }
+
+	// Exact distance at which the ray enters the item, or a value above max_distance if it does not within it.
+	float rayItem(uint32_t item, Vector3 origin, Vector3 direction, float max_distance) const;
+
+	// Nearest item along origin + direction * t, 0 <= t <= max_distance.
+	BvhHit raycast(Vector3 origin, Vector3 direction, float max_distance) const;
+	// Appends the items whose bounds are not fully outside one of the planes.
+	void frustum(std::span<const Plane> planes, std::vector<uint32_t>& out) const;
+	// Appends the items whose bounds overlap box.
+	void overlap(const Aabb& box, std::vector<uint32_t>& out) const;
+
+	BvhHit raycastWide(Vector3 origin, Vector3 direction, float max_distance) const;
+	void frustumWide(std::span<const Plane> planes, std::vector<uint32_t>& out) const;
+	void overlapWide(const Aabb& box, std::vector<uint32_t>& out) const;
+};
@@ -0,0 +1,259 @@
+#include "mazechunks.hpp"
+#include "mazegrid.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+	uint64_t splitmix64(uint64_t x) {
+		x += 0x9E3779B97F4A7C15ull;
+		x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+		x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+		return x ^ (x >> 31);
+	}
+
+	uint64_t hashCoords(int seed, int kind, int x, int y) {
+		uint64_t h = splitmix64(uint64_t(uint32_t(seed)) * 4 + kind);
+		h = splitmix64(h ^ uint32_t(x));
+		return splitmix64(h ^ uint32_t(y));
+	}
+
+	// Door of the side starting at chunk (cx, cy): kind 0 is the bottom side, kind 1 the left one.
+	int doorPosition(int seed, int kind, int cx, int cy, int chunk_edges) {
+		return int(hashCoords(seed, kind, cx, cy) % uint64_t(chunk_edges));
+	}
+
+	float latticeStep(float length, float width) {
+		return length + width * sqrtf(3);
+	}
+}
+
+std::shared_ptr<MazeChunk> makeMazeChunk(ChunkCoords coords, float length, float width, int chunk_edges, int seed) {
+	auto res = std::make_shared<MazeChunk>();
+	res->coords = coords;
+
+	const int x0 = coords.x * chunk_edges, y0 = coords.y * chunk_edges;
+	const int side = chunk_edges + 1;
+	const int door_bottom = doorPosition(seed, 0, coords.x, coords.y, chunk_edges);
+	const int door_top = doorPosition(seed, 0, coords.x, coords.y + 1, chunk_edges);
+	const int door_left = doorPosition(seed, 1, coords.x, coords.y, chunk_edges);
+	const int door_right = doorPosition(seed, 1, coords.x + 1, coords.y, chunk_edges);
+
+	struct chunk_edge {
+		uint64_t weight;
+		edge e;
+	};
+	std::vector<chunk_edge> outline;
+	std::vector<edge> doors;
+	std::vector<chunk_edge> inner;
+	std::vector<edge> final_edges;
+
+	// Local coordinates, the chunk spans vertices [0, chunk_edges]^2.
+	for (int y = 0; y <= chunk_edges; y++) {
+		for (int x = 0; x <= chunk_edges; x++) {
+			const node neighbours[3] = {{x + 1, y}, {x, y + 1}, {x - 1, y + 1}};
+			for (int dir = 0; dir < 3; dir++) {
+				node n = neighbours[dir];
+				if (n.x < 0 || n.x > chunk_edges || n.y > chunk_edges) {
+					continue;
+				}
+				edge e = {{x, y}, n};
+				if (dir == 0 && (y == 0 || y == chunk_edges)) {
+					if (x != (y == 0 ? door_bottom : door_top)) {
+						outline.push_back({0, e});
+					}
+					else {
+						doors.push_back(e);
+					}
+				}
+				else if (dir == 1 && (x == 0 || x == chunk_edges)) {
+					if (y != (x == 0 ? door_left : door_right)) {
+						outline.push_back({0, e});
+					}
+					else {
+						doors.push_back(e);
+					}
+				}
+				else {
+					inner.push_back({hashCoords(seed, 2 + dir, x0 + x, y0 + y), e});
+				}
+			}
+		}
+	}
+	std::stable_sort(inner.begin(), inner.end(), [](auto& a, auto& b) { return a.weight < b.weight; });
+
+	// Doors join the outline as walls that are never built, otherwise the
+	// inner walls would connect the four outline pieces and seal a region
+	// behind every door.
+	DisjointSet leaders(side);
+	for (auto& e : doors) {
+		leaders.Union(e.n1, e.n2);
+	}
+	for (auto& ce : outline) {
+		leaders.Union(ce.e.n1, ce.e.n2);
+		final_edges.push_back(ce.e);
+	}
+	for (auto& ce : inner) {
+		if (leaders.Union(ce.e.n1, ce.e.n2)) {
+			final_edges.push_back(ce.e);
+		}
+	}
+
+	for (auto e : final_edges) {
+		bool top = e.n1.y == chunk_edges && e.n2.y == chunk_edges;
+		bool right = e.n1.x == chunk_edges && e.n2.x == chunk_edges;
+		if (top || right) {
+			continue;
+		}
+		e.n1.x += x0;
+		e.n1.y += y0;
+		e.n2.x += x0;
+		e.n2.y += y0;
+		res->transformations_cuboid.push_back(edgeToCuboid(e, length, width));
+	}
+	for (int y = 0; y < chunk_edges; y++) {
+		for (int x = 0; x < chunk_edges; x++) {
+			res->transformations_hexprism.push_back({coordsToHexOffset(x0 + x, y0 + y, length, width)});
+		}
+	}
+
+	// Floor tiles whose corner lies inside the (half-open) chunk parallelogram.
+	Vector2 corners[4] = {
+		coordsToHexOffset(x0, y0, length, width),
+		coordsToHexOffset(x0 + chunk_edges, y0, length, width),
+		coordsToHexOffset(x0, y0 + chunk_edges, length, width),
+		coordsToHexOffset(x0 + chunk_edges, y0 + chunk_edges, length, width),
+	};
+	Vector2 low = corners[0], high = corners[0];
+	for (auto& c : corners) {
+		low = {std::min(low.x, c.x), std::min(low.y, c.y)};
+		high = {std::max(high.x, c.x), std::max(high.y, c.y)};
+	}
+	const float step = latticeStep(length, width);
+	for (int z = int(std::floor(low.y / length)); z <= int(std::ceil(high.y / length)); z++) {
+		for (int x = int(std::floor(low.x / length)); x <= int(std::ceil(high.x / length)); x++) {
+			float ly = z * length / (step * sqrtf(3) / 2);
+			float lx = x * length / step - ly / 2;
+			if (std::floor(lx / chunk_edges) == coords.x && std::floor(ly / chunk_edges) == coords.y) {
+				res->transformations_floor.push_back({{x * length, z * length}});
+			}
+		}
+	}
+
+	// Drawn walls stay unit length, merged ones would stretch the bricks.
+	std::vector<CuboidTransformation> collision_walls = res->transformations_cuboid;
+	mergeCollinearWalls(collision_walls, length, width);
+	for (auto& t : collision_walls) {
+		res->collision.addRectangle(t, length, width);
+	}
+	for (auto& t : res->transformations_hexprism) {
+		res->collision.addCircle(t.translation, width);
+	}
+	res->collision.buildIndex(length, width);
+
+	return res;
+}
+
+ChunkWorld::ChunkWorld(float length, float width, float height, int chunk_edges, int seed, size_t cache_capacity):
+	length(length), width(width), height(height), chunk_edges(chunk_edges), seed(seed), cache_capacity(cache_capacity) {
+	worker = std::thread(&ChunkWorld::workerLoop, this);
+}
+
+ChunkWorld::~ChunkWorld() {
+	{
+		std::lock_guard lock(mutex);
+		stopping = true;
+	}
+	requests_cv.notify_all();
+	worker.join();
+}
+
+ChunkCoords ChunkWorld::chunkAt(Vector2 position) const {
+	const float step = latticeStep(length, width);
+	float ly = position.y / (step * sqrtf(3) / 2);
+	float lx = position.x / step - ly / 2;
+	return {int(std::floor(lx / chunk_edges)), int(std::floor(ly / chunk_edges))};
+}
+
+Maze ChunkWorld::base() const {
+	Maze res;
+	makeMazeBase(res, length, width, height, 0);
+	int c = chunk_edges / 2;
+	res.player_coordinates = (coordsToHexOffset(c, c - 1, length, width) + coordsToHexOffset(c, c, length, width) + coordsToHexOffset(c + 1, c - 1, length, width)) / 3;
+	return res;
+}
+
+std::shared_ptr<const MazeChunk> ChunkWorld::cached(ChunkCoords coords) {
+	auto it = cache_index.find(coords);
+	if (it == cache_index.end()) {
+		return nullptr;
+	}
+	cache.splice(cache.begin(), cache, it->second);
+	return cache.front();
+}
+
+void ChunkWorld::insert(std::shared_ptr<const MazeChunk> chunk) {
+	if (cache_index.count(chunk->coords)) {
+		return;
+	}
+	cache.push_front(std::move(chunk));
+	cache_index[cache.front()->coords] = cache.begin();
+	while (cache.size() > cache_capacity) {
+		cache_index.erase(cache.back()->coords);
+		cache.pop_back();
+	}
+}
+
+std::shared_ptr<const MazeChunk> ChunkWorld::tryGet(ChunkCoords coords) {
+	std::lock_guard lock(mutex);
+	if (auto chunk = cached(coords)) {
+		return chunk;
+	}
+	if (std::find(requests.begin(), requests.end(), coords) == requests.end()) {
+		requests.push_back(coords);
+		requests_cv.notify_one();
+	}
+	return nullptr;
+}
+
+std::shared_ptr<const MazeChunk> ChunkWorld::get(ChunkCoords coords) {
+	{
+		std::lock_guard lock(mutex);
+		if (auto chunk = cached(coords)) {
+			return chunk;
+		}
+	}
+	std::shared_ptr<const MazeChunk> chunk = makeMazeChunk(coords, length, width, chunk_edges, seed);
+	std::lock_guard lock(mutex);
+	insert(chunk);
+	return chunk;
+}
+
+void ChunkWorld::release(std::shared_ptr<const MazeChunk> chunk) {
+	std::lock_guard lock(mutex);
+	if (!cached(chunk->coords)) {
+		insert(std::move(chunk));
+	}
+}
+
+void ChunkWorld::workerLoop() {
+	std::unique_lock lock(mutex);
+	while (true) {
+		requests_cv.wait(lock, [this]() { return stopping || !requests.empty(); });
+		if (stopping) {
+			return;
+		}
+		ChunkCoords coords = requests.front();
+		if (cache_index.count(coords)) {
+			requests.pop_front();
+			continue;
+		}
+
+		lock.unlock();
+		std::shared_ptr<const MazeChunk> chunk = makeMazeChunk(coords, length, width, chunk_edges, seed);
+		lock.lock();
+
+		requests.pop_front();
+		insert(std::move(chunk));
+	}
+}
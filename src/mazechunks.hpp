@@ -0,0 +1,76 @@
+#pragma once
+
+#include "maze.hpp"
+#include "collisionworld.hpp"
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Unbounded maze built from parallelogram chunks of chunk_edges x chunk_edges
+// hex cells. Every chunk is a closed perfect maze with one door per side; the
+// outline and the doors only depend on the seed and the side's coordinates,
+// so neighbouring chunks agree on their shared walls. Walls on the top and
+// right side belong to the next chunk, so each wall is emitted exactly once.
+
+struct ChunkCoords {
+	int x;
+	int y;
+
+	bool operator==(const ChunkCoords&) const = default;
+	bool operator<(const ChunkCoords& oth) const {
+		return x != oth.x ? x < oth.x : y < oth.y;
+	}
+};
+
+struct MazeChunk {
+	ChunkCoords coords;
+	std::vector<CuboidTransformation> transformations_cuboid;
+	std::vector<TranslationTransformation> transformations_hexprism;
+	std::vector<TranslationTransformation> transformations_floor;
+	CollisionWorld collision;
+};
+
+std::shared_ptr<MazeChunk> makeMazeChunk(ChunkCoords coords, float length, float width, int chunk_edges, int seed);
+
+// Generates chunks on a background thread and keeps the most recently used
+// ones in an LRU cache.
+class ChunkWorld {
+	float length;
+	float width;
+	float height;
+	int chunk_edges;
+	int seed;
+	size_t cache_capacity;
+
+	std::mutex mutex;
+	std::condition_variable requests_cv;
+	std::deque<ChunkCoords> requests;
+	std::list<std::shared_ptr<const MazeChunk>> cache;
+	std::map<ChunkCoords, std::list<std::shared_ptr<const MazeChunk>>::iterator> cache_index;
+	bool stopping = false;
+	std::thread worker;
+
+	void workerLoop();
+	std::shared_ptr<const MazeChunk> cached(ChunkCoords coords);
+	void insert(std::shared_ptr<const MazeChunk> chunk);
+public:
+	ChunkWorld(float length, float width, float height, int chunk_edges, int seed = 14369, size_t cache_capacity = 64);
+	~ChunkWorld();
+
+	ChunkCoords chunkAt(Vector2 position) const;
+
+	// Mesh templates and the player start, the transformation arrays are empty.
+	Maze base() const;
+
+	// Returns the chunk if it is ready, otherwise queues it and returns nullptr.
+	std::shared_ptr<const MazeChunk> tryGet(ChunkCoords coords);
+	// Generates the chunk on the calling thread if it is not ready yet.
+	std::shared_ptr<const MazeChunk> get(ChunkCoords coords);
+	// Puts a chunk that is no longer drawn back at the front of the cache.
+	void release(std::shared_ptr<const MazeChunk> chunk);
+};
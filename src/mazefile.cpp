@@ -0,0 +1,186 @@
+#include "mazefile.hpp"
+
+#include <cstring>
+#include <fstream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static_assert(sizeof(MazeFileHeader) % alignof(vertex_t) == 0);
+static_assert(sizeof(vertex_t) % alignof(CuboidTransformation) == 0);
+static_assert(sizeof(CuboidTransformation) % alignof(TranslationTransformation) == 0);
+
+// Takes count items off the bytes left in the file, false if they do not
+// fit. Divides instead of multiplying, so a corrupt count cannot wrap around.
+template<typename T>
+static bool take(const unsigned char*& bytes, size_t& left, uint64_t count, std::span<const T>& out) {
+	if (count > left / sizeof(T)) {
+		return false;
+	}
+	out = std::span<const T>(reinterpret_cast<const T*>(bytes), size_t(count));
+	bytes += sizeof(T) * out.size();
+	left -= sizeof(T) * out.size();
+	return true;
+}
+
+MazeView viewOf(const Maze& maze) {
+	return {
+		maze.cuboid,
+		maze.hexprism,
+		maze.floor,
+		maze.transformations_cuboid,
+		maze.transformations_hexprism,
+		maze.transformations_floor,
+		maze.player_coordinates,
+	};
+}
+
+bool writeMazeFile(const char* path, const MazeFileKey& key, const MazeView& maze) {
+	// Zeroed first, the padding before the counts would otherwise go to disk as stack garbage.
+	MazeFileHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = MAZE_FILE_MAGIC;
+	header.version = MAZE_FILE_VERSION;
+	header.vertex_size = sizeof(vertex_t);
+	header.header_size = sizeof(MazeFileHeader);
+	header.key = key;
+	header.player_coordinates = maze.player_coordinates;
+	header.cuboid_count = maze.transformations_cuboid.size();
+	header.hexprism_count = maze.transformations_hexprism.size();
+	header.floor_count = maze.transformations_floor.size();
+
+	std::ofstream out(path, std::ios::binary | std::ios::trunc);
+	auto write = [&](auto span) {
+		out.write(reinterpret_cast<const char*>(span.data()), span.size_bytes());
+	};
+	write(std::span(&header, 1));
+	write(maze.cuboid);
+	write(maze.hexprism);
+	write(maze.floor);
+	write(maze.transformations_cuboid);
+	write(maze.transformations_hexprism);
+	write(maze.transformations_floor);
+	return bool(out);
+}
+
+MazeFile::~MazeFile() {
+	close();
+}
+
+bool MazeFile::open(const char* path, const MazeFileKey& key) {
+	close();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	file_handle = file;
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart < LONGLONG(sizeof(MazeFileHeader))) {
+		close();
+		return false;
+	}
+	size = size_t(file_size.QuadPart);
+	mapping_handle = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping_handle == nullptr) {
+		close();
+		return false;
+	}
+	data = MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0);
+	if (data == nullptr) {
+		close();
+		return false;
+	}
+#else
+	int fd = ::open(path, O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(MazeFileHeader)) {
+		::close(fd);
+		return false;
+	}
+	size = size_t(st.st_size);
+	void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (mapped == MAP_FAILED) {
+		size = 0;
+		return false;
+	}
+	data = mapped;
+#endif
+
+	const auto* bytes = static_cast<const unsigned char*>(data);
+	const auto& header = *reinterpret_cast<const MazeFileHeader*>(bytes);
+	if (header.magic != MAZE_FILE_MAGIC || header.version != MAZE_FILE_VERSION
+		|| header.vertex_size != sizeof(vertex_t) || header.header_size != sizeof(MazeFileHeader)
+		|| !(header.key == key)) {
+		close();
+		return false;
+	}
+
+	// The counts come from the file, every array has to fit in what is left
+	// of it and together they have to fill it exactly.
+	bytes += sizeof(MazeFileHeader);
+	size_t left = size - sizeof(MazeFileHeader);
+	MazeView view = {};
+	bool fits = take(bytes, left, CUBOID_VERTEX_COUNT, view.cuboid)
+		&& take(bytes, left, HEXPRISM_VERTEX_COUNT, view.hexprism)
+		&& take(bytes, left, FLOOR_VERTEX_COUNT, view.floor)
+		&& take(bytes, left, header.cuboid_count, view.transformations_cuboid)
+		&& take(bytes, left, header.hexprism_count, view.transformations_hexprism)
+		&& take(bytes, left, header.floor_count, view.transformations_floor);
+	if (!fits || left != 0) {
+		close();
+		return false;
+	}
+	view.player_coordinates = header.player_coordinates;
+	maze = view;
+	return true;
+}
+
+void MazeFile::close() {
+#ifdef _WIN32
+	if (data != nullptr) {
+		UnmapViewOfFile(data);
+	}
+	if (mapping_handle != nullptr) {
+		CloseHandle(mapping_handle);
+	}
+	if (file_handle != nullptr) {
+		CloseHandle(file_handle);
+	}
+	mapping_handle = nullptr;
+	file_handle = nullptr;
+#else
+	if (data != nullptr) {
+		munmap(data, size);
+	}
+#endif
+	data = nullptr;
+	size = 0;
+	maze = {};
+}
+
+bool openOrCreateMazeFile(MazeFile& file, const char* path, const MazeFileKey& key) {
+	if (file.open(path, key)) {
+		return true;
+	}
+	Maze maze = generateMaze(MazeGenerator(key.generator), key.length, key.width, key.height, key.side_edges, key.seed);
+	if (key.merge_walls) {
+		mergeCollinearWalls(maze.transformations_cuboid, key.length, key.width);
+	}
+	if (!writeMazeFile(path, key, viewOf(maze))) {
+		return false;
+	}
+	return file.open(path, key);
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "maze.hpp"
+#include <cstdint>
+#include <span>
+
+// Versioned binary dump of a Maze. The file is memory-mapped on load and the
+// arrays are used in place, so the layout below is exactly what is on disk:
+// header, cuboid/hexprism/floor vertices, then the three transformation arrays.
+
+constexpr uint32_t MAZE_FILE_MAGIC = 0x455A414D; // "MAZE"
+constexpr uint32_t MAZE_FILE_VERSION = 2;
+
+// Everything the generated maze depends on.
+struct MazeFileKey {
+	float length;
+	float width;
+	float height;
+	int32_t side_edges;
+	int32_t seed;
+	uint32_t generator;
+	uint32_t merge_walls;
+
+	bool operator==(const MazeFileKey&) const = default;
+};
+
+struct MazeFileHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t vertex_size;
+	uint32_t header_size;
+	MazeFileKey key;
+	Vector2 player_coordinates;
+	uint64_t cuboid_count;
+	uint64_t hexprism_count;
+	uint64_t floor_count;
+};
+
+// Non-owning view of a maze, either of a Maze or of a mapped file.
+struct MazeView {
+	std::span<const vertex_t> cuboid;
+	std::span<const vertex_t> hexprism;
+	std::span<const vertex_t> floor;
+	std::span<const CuboidTransformation> transformations_cuboid;
+	std::span<const TranslationTransformation> transformations_hexprism;
+	std::span<const TranslationTransformation> transformations_floor;
+	Vector2 player_coordinates;
+};
+
+MazeView viewOf(const Maze& maze);
+
+bool writeMazeFile(const char* path, const MazeFileKey& key, const MazeView& maze);
+
+class MazeFile {
+	void* data = nullptr;
+	size_t size = 0;
+#ifdef _WIN32
+	void* file_handle = nullptr;
+	void* mapping_handle = nullptr;
+#endif
+	MazeView maze;
+public:
+	MazeFile() = default;
+	MazeFile(const MazeFile&) = delete;
+	MazeFile& operator=(const MazeFile&) = delete;
+	~MazeFile();
+
+	// Returns false if the file is missing, truncated, from another version or for another key.
+	bool open(const char* path, const MazeFileKey& key);
+	void close();
+
+	const MazeView& view() const { return maze; }
+};
+
+// Opens the cached maze for key, generating and writing it first if the file is missing or stale.
+bool openOrCreateMazeFile(MazeFile& file, const char* path, const MazeFileKey& key);
@@ -0,0 +1,125 @@
+#pragma once
+
+#include "maze.hpp"
+#include <cstdint>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Shared pieces of the maze generators. Cells of the hex grid live in the
+// (3 * side_edges + 1)^2 bounding box, walls are edges between neighbouring cells.
+
+struct node {
+	int x;
+	int y;
+};
+
+struct edge {
+	node n1;
+	node n2;
+};
+
+// Closed-form sizes of a side_edges maze, used to reserve buffers up front.
+constexpr size_t hexNodeCount(int side_edges) {
+	return 3 * size_t(side_edges) * side_edges + 3 * size_t(side_edges) + 1;
+}
+constexpr size_t hexEdgeCount(int side_edges) {
+	return 9 * size_t(side_edges) * side_edges + 3 * size_t(side_edges);
+}
+constexpr size_t borderEdgeCount(int side_edges) {
+	return 6 * size_t(side_edges);
+}
+// A spanning tree of the nodes plus the edge closing the outline.
+constexpr size_t wallCount(int side_edges) {
+	return hexNodeCount(side_edges);
+}
+constexpr size_t floorTileCount(int side_edges) {
+	return 25 * size_t(side_edges) * side_edges;
+}
+
+bool isPartOfHex(int x, int y, int size);
+Vector2 coordsToHexOffset(int x, int y, float length, float width);
+
+// Edges on the outline of the hex, these are always part of the maze.
+bool isBorderEdge(edge e, int side_edges);
+
+CuboidTransformation edgeToCuboid(edge e, float length, float width);
+
+// Inverse of edgeToCuboid, a merged wall gives the edge spanning its whole run.
+edge cuboidToEdge(const CuboidTransformation& t, float length, float width);
+
+// Marks the wall between the nodes of e, which must be neighbours.
+void addWall(MazeGraph& graph, edge e);
+
+// Fills the cuboid/hexprism/floor templates, floor instances and the player start.
+void makeMazeBase(Maze& res, float length, float width, float height, int side_edges);
+
+// Runs f(0) .. f(count - 1) interleaved over thread_count threads, including the caller.
+template<typename F>
+void parallelFor(int count, int thread_count, F f) {
+	std::vector<std::thread> workers;
+	for (int t = 1; t < thread_count; t++) {
+		workers.emplace_back([=, &f]() {
+			for (int i = t; i < count; i += thread_count) {
+				f(i);
+			}
+		});
+	}
+	for (int i = 0; i < count; i += thread_count) {
+		f(i);
+	}
+	for (auto& w : workers) {
+		w.join();
+	}
+}
+
+// Disjoint-set over the hex-cell bounding box, cells are indexed by y * side + x.
+struct DisjointSet {
+	int side;
+	std::vector<int> parent;
+	std::vector<uint8_t> rank;
+
+	DisjointSet(int side): side(side), parent(size_t(side) * side), rank(size_t(side) * side) {
+		reset(0, parent.size());
+	}
+
+	void reset(size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			parent[i] = int(i);
+			rank[i] = 0;
+		}
+	}
+
+	int index(node n) const {
+		return n.y * side + n.x;
+	}
+
+	int Find(int i) {
+		int root = i;
+		while (parent[root] != root) {
+			root = parent[root];
+		}
+		while (parent[i] != root) {
+			int next = parent[i];
+			parent[i] = root;
+			i = next;
+		}
+		return root;
+	}
+
+	// Returns false if both cells were already in the same set.
+	bool Union(node a, node b) {
+		int leader_a = Find(index(a)), leader_b = Find(index(b));
+		if (leader_a == leader_b) {
+			return false;
+		}
+		if (rank[leader_a] < rank[leader_b]) {
+			std::swap(leader_a, leader_b);
+		}
+		parent[leader_b] = leader_a;
+		if (rank[leader_a] == rank[leader_b]) {
+			rank[leader_a]++;
+		}
+		return true;
+	}
+};
@@ -0,0 +1,142 @@
+#pragma once
+
+#include "base.hpp"
+#include <algorithm>
+#include <array>
+
+// Mesh templates of the maze, built entirely in constexpr functions so that
+// constant dimensions give compile-time vertex arrays.
+
+constexpr int CUBOID_VERTEX_COUNT = 3 * 6 * 2;
+constexpr int HEXPRISM_VERTEX_COUNT = 3 * (2 * 4 + 6 * 2);
+constexpr int FLOOR_VERTEX_COUNT = 3 * 2;
+
+struct SimpleColor {
+	float r, g, b;
+};
+
+struct Vector3 {
+	float x;
+	float y;
+	float z;
+};
+
+struct Triangle {
+	vertex_t t1[3];
+};
+
+constexpr SimpleColor color = {1.0f, 1.0f, 1.0f};
+
+// std::sqrt is not constexpr.
+constexpr float SQRT3 = 1.7320508075688772f;
+
+constexpr float textureCoords(Vector3 v, Vector3 texture_offset, Vector3 base) {
+	return (v.x - texture_offset.x) * base.x + (v.y - texture_offset.y) * base.y + (v.z - texture_offset.z) * base.z;
+}
+
+constexpr Triangle makeSingleTriangle(Vector3 p1, Vector3 p2, Vector3 p3, Vector3 texture_offset, Vector3 basex, Vector3 basey) {
+	float Ax = p2.x - p1.x;
+	float Ay = p2.y - p1.y;
+	float Az = p2.z - p1.z;
+
+	float Bx = p3.x - p1.x;
+	float By = p3.y - p1.y;
+	float Bz = p3.z - p1.z;
+
+	float Nx = Ay * Bz - Az * By;
+	float Ny = Az * Bx - Ax * Bz;
+	float Nz = Ax * By - Ay * Bx;
+	
+	return { {
+		{p1.x, p1.y, p1.z,     Nx, Ny, Nz,    color.r, color.g, color.b, 1.0f,   textureCoords(p1, texture_offset, basex), textureCoords(p1, texture_offset, basey)},
+		{p2.x, p2.y, p2.z,     Nx, Ny, Nz,    color.r, color.g, color.b, 1.0f,   textureCoords(p2, texture_offset, basex), textureCoords(p2, texture_offset, basey)},
+		{p3.x, p3.y, p3.z,     Nx, Ny, Nz,    color.r, color.g, color.b, 1.0f,   textureCoords(p3, texture_offset, basex), textureCoords(p3, texture_offset, basey)},
+	} };
+}
+
+// Fans the convex polygon p into triangles, written to dst starting at vertex pos.
+template<size_t N>
+constexpr void makeConvexShape(vertex_t* dst, size_t& pos, const std::array<Vector3, N>& p, Vector3 texture_offset, Vector3 basex, Vector3 basey) {
+	for (size_t i = 1; i < N - 1; i++) {
+		Triangle t = makeSingleTriangle(p[0], p[i], p[i + 1], texture_offset, basex, basey);
+		for (auto& v : t.t1) {
+			dst[pos++] = v;
+		}
+	}
+}
+
+// cos and sin of 2 * PI * i / 6.
+constexpr float HEX_COS[6] = {1, 0.5f, -0.5f, -1, -0.5f, 0.5f};
+constexpr float HEX_SIN[6] = {0, SQRT3 / 2, SQRT3 / 2, 0, -SQRT3 / 2, -SQRT3 / 2};
+
+constexpr Vector3 rotateXZ(Vector3 v, int sixth) {
+	return {
+		HEX_COS[sixth] * v.x - HEX_SIN[sixth] * v.z,
+		v.y,
+		HEX_SIN[sixth] * v.x + HEX_COS[sixth] * v.z,
+	};
+}
+
+struct MazeMeshes {
+	vertex_t cuboid[CUBOID_VERTEX_COUNT];
+	vertex_t hexprism[HEXPRISM_VERTEX_COUNT];
+	vertex_t floor[FLOOR_VERTEX_COUNT];
+};
+
+constexpr MazeMeshes makeMazeMeshes(float length, float width, float height) {
+	float texturevec = 1 / std::max(std::max(height, length), 2 * width);
+	MazeMeshes res = {};
+	size_t pos = 0;
+
+	// Cuboid
+	Vector3 cuboid_verticies[8] = {};
+	for (int h = 0; h <= 1; h++) {
+		for (int w = 0; w <= 1; w++) {
+			for (int l = 0; l <= 1; l++) {
+				cuboid_verticies[l * 1 + w * 2 + h * 4] = {l == 0 ? -length / 2 : length / 2, h == 0 ? 0 : height, w == 0 ? -width / 2 : width / 2};
+			}
+		}
+	}
+	auto cuboidFace = [&](int a, int b, int c, int d, Vector3 texture_offset, Vector3 basex, Vector3 basey) {
+		makeConvexShape<4>(res.cuboid, pos, {cuboid_verticies[a], cuboid_verticies[b], cuboid_verticies[c], cuboid_verticies[d]}, texture_offset, basex, basey);
+	};
+	// top
+	cuboidFace(4, 6, 7, 5, cuboid_verticies[4], {texturevec, 0, 0}, {0, 0, texturevec});
+	// right
+	cuboidFace(5, 7, 3, 1, cuboid_verticies[1], {0, 0, texturevec}, {0, texturevec, 0});
+	// front
+	cuboidFace(4, 5, 1, 0, cuboid_verticies[0], {texturevec, 0, 0}, {0, texturevec, 0});
+	// bottom
+	cuboidFace(0, 1, 3, 2, cuboid_verticies[3], {-texturevec, 0, 0}, {0, 0, -texturevec});
+	// left
+	cuboidFace(4, 0, 2, 6, cuboid_verticies[0], {0, 0, texturevec}, {0, texturevec, 0});
+	// back
+	cuboidFace(2, 3, 7, 6, cuboid_verticies[2], {texturevec, 0, 0}, {0, texturevec, 0});
+
+	// HexPrism
+	pos = 0;
+	Vector3 hexprism_verticies[12] = {};
+	hexprism_verticies[0] = {0, 0, width};
+	for (int i = 1; i < 6; i++) {
+		hexprism_verticies[i] = rotateXZ(hexprism_verticies[0], i);
+	}
+	for (int i = 6; i < 12; i++) {
+		hexprism_verticies[i] = hexprism_verticies[i - 6];
+		hexprism_verticies[i].y = height;
+	}
+	auto& hv = hexprism_verticies;
+	// top
+	makeConvexShape<6>(res.hexprism, pos, {hv[0], hv[1], hv[2], hv[3], hv[4], hv[5]}, {hv[0].x - width, hv[0].y, hv[0].z - 2 * width}, {texturevec, 0, 0}, {0, 0, texturevec});
+	// bottom
+	makeConvexShape<6>(res.hexprism, pos, {hv[11], hv[10], hv[9], hv[8], hv[7], hv[6]}, {hv[6].x - width, hv[6].y, hv[6].z - 2 * width}, {texturevec, 0, 0}, {0, 0, texturevec});
+	constexpr float z_impact[6] = {0.5, 1, 0.5, -0.5, -1, -0.5};
+	constexpr float x_impact[6] = {SQRT3 / 2, 0, -SQRT3 / 2, -SQRT3 / 2, 0, SQRT3 / 2};
+	for (int i = 0; i < 6; i++) {
+		makeConvexShape<4>(res.hexprism, pos, {hv[i], hv[i + 6], hv[((i + 1) % 6) + 6], hv[(i + 1) % 6]}, hv[(i + 1) % 6], {texturevec * x_impact[i], 0, texturevec * z_impact[i]}, {0, texturevec, 0});
+	}
+
+	pos = 0;
+	makeConvexShape<4>(res.floor, pos, {Vector3{0, 0, 0}, {0, 0, length}, {length, 0, length}, {length, 0, 0}}, {0, 0, 0}, {texturevec, 0, 0}, {0, 0, texturevec});
+
+	return res;
+}
@@ -0,0 +1,118 @@
+#include "mazenav.hpp"
+#include "mazegrid.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+MazeNav::MazeNav(const MazeGraph& graph, float length, float width):
+	length(length), width(width), side(graph.side()), cell_index(size_t(graph.side()) * graph.side() * 2, NAV_NO_CELL) {
+	const int s = graph.side_edges;
+	auto inside = [&](int x, int y) {
+		return isPartOfHex(x, y, s);
+	};
+	for (int y = 0; y < side; y++) {
+		for (int x = 0; x < side; x++) {
+			size_t i = (size_t(y) * side + x) * 2;
+			if (inside(x, y) && inside(x + 1, y) && inside(x, y + 1)) {
+				cell_index[i] = int(centers.size());
+				centers.push_back((coordsToHexOffset(x, y, length, width) + coordsToHexOffset(x + 1, y, length, width) + coordsToHexOffset(x, y + 1, length, width)) / 3);
+			}
+			if (inside(x + 1, y) && inside(x, y + 1) && inside(x + 1, y + 1)) {
+				cell_index[i + 1] = int(centers.size());
+				centers.push_back((coordsToHexOffset(x + 1, y, length, width) + coordsToHexOffset(x, y + 1, length, width) + coordsToHexOffset(x + 1, y + 1, length, width)) / 3);
+			}
+		}
+	}
+
+	// Neighbour across the edge, if the edge is not a wall.
+	auto open = [&](int x, int y, int dir, int neighbour) {
+		return graph.hasWall(x, y, dir) ? NAV_NO_CELL : neighbour;
+	};
+	adjacency.resize(centers.size());
+	for (int y = 0; y < side; y++) {
+		for (int x = 0; x < side; x++) {
+			if (int c = latticeCell(x, y, 0); c != NAV_NO_CELL) {
+				adjacency[c] = {open(x, y, 0, latticeCell(x, y - 1, 1)), open(x, y, 1, latticeCell(x - 1, y, 1)), open(x + 1, y, 2, latticeCell(x, y, 1))};
+			}
+			if (int c = latticeCell(x, y, 1); c != NAV_NO_CELL) {
+				adjacency[c] = {open(x + 1, y, 2, latticeCell(x, y, 0)), open(x, y + 1, 0, latticeCell(x, y + 1, 0)), open(x + 1, y, 1, latticeCell(x + 1, y, 0))};
+			}
+		}
+	}
+}
+
+int MazeNav::cellAt(Vector2 position) const {
+	const float step = length + width * sqrtf(3);
+	float fy = position.y / (step * sqrtf(3) / 2);
+	float fx = position.x / step - fy / 2;
+	int x = int(std::floor(fx)), y = int(std::floor(fy));
+	if (x < 0 || y < 0 || x >= side || y >= side) {
+		return NAV_NO_CELL;
+	}
+	int down = (fx - x) + (fy - y) >= 1;
+	return cell_index[(size_t(y) * side + x) * 2 + down];
+}
+
+void MazeNav::buildFlowField(int target, FlowField& field) const {
+	field.target = target;
+	field.distance.assign(adjacency.size(), NAV_UNREACHABLE);
+	field.step.assign(adjacency.size(), NAV_NO_STEP);
+
+	std::vector<int> queue;
+	queue.reserve(adjacency.size());
+	queue.push_back(target);
+	field.distance[target] = 0;
+	for (size_t head = 0; head < queue.size(); head++) {
+		int c = queue[head];
+		for (int n : adjacency[c]) {
+			if (n == NAV_NO_CELL || field.distance[n] != NAV_UNREACHABLE) {
+				continue;
+			}
+			field.distance[n] = field.distance[c] + 1;
+			field.step[n] = uint8_t(std::find(adjacency[n].begin(), adjacency[n].end(), c) - adjacency[n].begin());
+			queue.push_back(n);
+		}
+	}
+}
+
+void FlowFieldCache::insert(std::shared_ptr<const FlowField> field) {
+	cache.push_front(field);
+	cache_index[field->target] = cache.begin();
+	while (cache.size() > capacity) {
+		cache_index.erase(cache.back()->target);
+		cache.pop_back();
+	}
+}
+
+void FlowFieldCache::build(std::span<const int> targets, int thread_count) {
+	if (thread_count <= 0) {
+		thread_count = std::max(1u, std::thread::hardware_concurrency());
+	}
+	std::vector<int> missing;
+	for (int target : targets) {
+		if (!cache_index.count(target) && std::find(missing.begin(), missing.end(), target) == missing.end()) {
+			missing.push_back(target);
+		}
+	}
+
+	std::vector<std::shared_ptr<FlowField>> fields(missing.size());
+	parallelFor(int(missing.size()), std::min(thread_count, int(missing.size())), [&](int i) {
+		fields[i] = std::make_shared<FlowField>();
+		nav.buildFlowField(missing[i], *fields[i]);
+	});
+	for (auto& field : fields) {
+		insert(field);
+	}
+}
+
+std::shared_ptr<const FlowField> FlowFieldCache::get(int target) {
+	auto it = cache_index.find(target);
+	if (it != cache_index.end()) {
+		cache.splice(cache.begin(), cache, it->second);
+		return cache.front();
+	}
+	auto field = std::make_shared<FlowField>();
+	nav.buildFlowField(target, *field);
+	insert(field);
+	return field;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "maze.hpp"
+#include <array>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <span>
+#include <vector>
+
+// Navigation over the triangular cells between the walls. Every lattice node
+// (x, y) owns an up cell (x, y), (x + 1, y), (x, y + 1) and a down cell
+// (x + 1, y), (x, y + 1), (x + 1, y + 1); only cells inside the hex get an index.
+// Since the walls are a spanning tree plus the outline, the cells form a tree.
+
+constexpr int NAV_NO_CELL = -1;
+constexpr uint8_t NAV_NO_STEP = 3;
+constexpr uint32_t NAV_UNREACHABLE = UINT32_MAX;
+
+// Distances and the next step towards one target, indexed by cell.
+struct FlowField {
+	int target;
+	std::vector<uint32_t> distance;
+	// Slot of MazeNav::neighbours to move to, NAV_NO_STEP at the target.
+	std::vector<uint8_t> step;
+};
+
+class MazeNav {
+	float length;
+	float width;
+	int side;
+	// Cell index of the up and down cell of every node, NAV_NO_CELL outside the hex.
+	std::vector<int> cell_index;
+	// Passable neighbours of every cell, NAV_NO_CELL where a wall is.
+	std::vector<std::array<int, 3>> adjacency;
+	std::vector<Vector2> centers;
+public:
+	MazeNav(const MazeGraph& graph, float length, float width);
+
+	int cellCount() const { return int(adjacency.size()); }
+	// Cell containing the position, NAV_NO_CELL outside the maze.
+	int cellAt(Vector2 position) const;
+	Vector2 cellCenter(int cell) const { return centers[cell]; }
+	// Up (down = 0) or down cell of node (x, y), NAV_NO_CELL outside the hex.
+	int latticeCell(int x, int y, int down) const {
+		if (x < 0 || y < 0 || x >= side || y >= side) {
+			return NAV_NO_CELL;
+		}
+		return cell_index[(size_t(y) * side + x) * 2 + down];
+	}
+	const std::array<int, 3>& neighbours(int cell) const { return adjacency[cell]; }
+
+	void buildFlowField(int target, FlowField& field) const;
+
+	// O(1), returns the cell itself at the target or if it cannot reach it.
+	int nextCell(const FlowField& field, int cell) const {
+		uint8_t s = field.step[cell];
+		return s == NAV_NO_STEP ? cell : adjacency[cell][s];
+	}
+};
+
+// Flow fields of the most recently used targets. Not thread safe, but the
+// fields it hands out stay valid after they are evicted.
+class FlowFieldCache {
+	const MazeNav& nav;
+	size_t capacity;
+	std::list<std::shared_ptr<const FlowField>> cache;
+	std::map<int, std::list<std::shared_ptr<const FlowField>>::iterator> cache_index;
+
+	void insert(std::shared_ptr<const FlowField> field);
+public:
+	FlowFieldCache(const MazeNav& nav, size_t capacity = 16): nav(nav), capacity(capacity) {}
+
+	// Computes the missing fields in parallel, thread_count = 0 uses all hardware threads.
+	void build(std::span<const int> targets, int thread_count = 0);
+	// Computes the field on the calling thread if it is not cached.
+	std::shared_ptr<const FlowField> get(int target);
+};
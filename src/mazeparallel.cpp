@@ -0,0 +1,171 @@
+#include "mazegrid.hpp"
+
+#include <algorithm>
+#include <queue>
+#include <thread>
+
+// Tile-parallel Kruskal. Every edge gets a weight hashed from the seed and its
+// position, which makes the spanning tree unique: each tile (a band of rows)
+// computes its minimum spanning forest on a worker thread, and the final tree is
+// the minimum spanning tree of the tile forests plus the edges crossing between
+// tiles. The result therefore depends only on the seed, not on the thread count.
+
+namespace {
+	struct weighted_edge {
+		uint64_t weight;
+		edge e;
+
+		bool operator>(const weighted_edge& oth) const {
+			return weight > oth.weight;
+		}
+	};
+
+	uint64_t splitmix64(uint64_t x) {
+		x += 0x9E3779B97F4A7C15ull;
+		x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+		x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+		return x ^ (x >> 31);
+	}
+
+	// splitmix64 is a bijection, so distinct edge keys never share a weight.
+	uint64_t edgeWeight(int seed, uint64_t key) {
+		return splitmix64(uint64_t(uint32_t(seed)) * 0xD1B54A32D192ED03ull + key);
+	}
+
+	struct Tile {
+		int y_begin, y_end;
+		std::vector<TranslationTransformation> hexprisms;
+		std::vector<weighted_edge> border;
+		std::vector<weighted_edge> forest;
+		std::vector<weighted_edge> crossing;
+	};
+
+	void buildTile(Tile& tile, DisjointSet& leaders, int side_edges, float length, float width, int seed) {
+		std::vector<weighted_edge> inner;
+		const int side = side_edges * 3 + 1;
+
+		for (int y = tile.y_begin; y < tile.y_end; y++) {
+			for (int x = 0; x < side; x++) {
+				if (!isPartOfHex(x, y, side_edges)) {
+					continue;
+				}
+				tile.hexprisms.push_back({coordsToHexOffset(x, y, length, width)});
+
+				const node neighbours[3] = {{x + 1, y}, {x, y + 1}, {x - 1, y + 1}};
+				for (int dir = 0; dir < 3; dir++) {
+					node n = neighbours[dir];
+					if (!isPartOfHex(n.x, n.y, side_edges)) {
+						continue;
+					}
+					edge e = {{x, y}, n};
+					weighted_edge we = {edgeWeight(seed, uint64_t(leaders.index(e.n1)) * 3 + dir), e};
+					if (isBorderEdge(e, side_edges)) {
+						tile.border.push_back(we);
+					}
+					else if (n.y < tile.y_end) {
+						inner.push_back(we);
+					}
+					else {
+						tile.crossing.push_back(we);
+					}
+				}
+			}
+		}
+
+		for (auto& we : tile.border) {
+			if (we.e.n2.y < tile.y_end) {
+				leaders.Union(we.e.n1, we.e.n2);
+			}
+		}
+
+		std::sort(inner.begin(), inner.end(), [](auto& a, auto& b) { return a.weight < b.weight; });
+		for (auto& we : inner) {
+			if (leaders.Union(we.e.n1, we.e.n2)) {
+				tile.forest.push_back(we);
+			}
+		}
+		std::sort(tile.crossing.begin(), tile.crossing.end(), [](auto& a, auto& b) { return a.weight < b.weight; });
+
+		// Unions only touched this tile's rows, so it can clear them for the merge.
+		leaders.reset(size_t(tile.y_begin) * side, size_t(tile.y_end) * side);
+	}
+}
+
+Maze getMazeParallel(float length, float width, float height, int side_edges, int seed, int thread_count) {
+	if (thread_count <= 0) {
+		thread_count = std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	Maze res;
+	makeMazeBase(res, length, width, height, side_edges);
+
+	const int rows = side_edges * 3 + 1;
+	const int tile_count = std::min(thread_count, rows);
+	DisjointSet leaders(rows);
+
+	std::vector<Tile> tiles(tile_count);
+	for (int t = 0; t < tile_count; t++) {
+		tiles[t].y_begin = rows * t / tile_count;
+		tiles[t].y_end = rows * (t + 1) / tile_count;
+	}
+
+	parallelFor(tile_count, thread_count, [&](int t) {
+		buildTile(tiles[t], leaders, side_edges, length, width, seed);
+	});
+
+	std::vector<edge> final_edges;
+	std::vector<weighted_edge> border;
+	final_edges.reserve(wallCount(side_edges));
+	border.reserve(borderEdgeCount(side_edges));
+	res.transformations_hexprism.reserve(hexNodeCount(side_edges));
+	for (auto& tile : tiles) {
+		res.transformations_hexprism.insert(res.transformations_hexprism.end(), tile.hexprisms.begin(), tile.hexprisms.end());
+		border.insert(border.end(), tile.border.begin(), tile.border.end());
+	}
+	std::sort(border.begin(), border.end(), [](auto& a, auto& b) { return a.weight < b.weight; });
+	for (auto& we : border) {
+		leaders.Union(we.e.n1, we.e.n2);
+		final_edges.push_back(we.e);
+	}
+
+	// Kruskal over the sorted tile forests and crossings, merged through a heap.
+	std::vector<const std::vector<weighted_edge>*> lists;
+	for (auto& tile : tiles) {
+		lists.push_back(&tile.forest);
+		lists.push_back(&tile.crossing);
+	}
+	std::vector<size_t> positions(lists.size(), 0);
+	using heap_entry = std::pair<uint64_t, size_t>;
+	std::priority_queue<heap_entry, std::vector<heap_entry>, std::greater<heap_entry>> heap;
+	for (size_t i = 0; i < lists.size(); i++) {
+		if (!lists[i]->empty()) {
+			heap.push({lists[i]->front().weight, i});
+		}
+	}
+	while (!heap.empty()) {
+		size_t i = heap.top().second;
+		heap.pop();
+		const edge& e = (*lists[i])[positions[i]++].e;
+		if (leaders.Union(e.n1, e.n2)) {
+			final_edges.push_back(e);
+		}
+		if (positions[i] < lists[i]->size()) {
+			heap.push({(*lists[i])[positions[i]].weight, i});
+		}
+	}
+
+	res.transformations_cuboid.resize(final_edges.size());
+	const int chunks = thread_count;
+	parallelFor(chunks, thread_count, [&](int c) {
+		size_t begin = final_edges.size() * c / chunks;
+		size_t end = final_edges.size() * (c + 1) / chunks;
+		for (size_t i = begin; i < end; i++) {
+			res.transformations_cuboid[i] = edgeToCuboid(final_edges[i], length, width);
+		}
+	});
+	for (auto& e : final_edges) {
+		addWall(res.graph, e);
+	}
+
+	return res;
+}
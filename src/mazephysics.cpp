@@ -1,36 +1,120 @@
 #include "mazephysics.hpp"
 
-Vector2 RectangleObj::supportFunction(float angle) const {
-	float rotation = fmod(angle - t.rotation + 4 * PI, 2 * PI);
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MAZE_SUPPORT_SSE
+#include <emmintrin.h>
+#endif
 
-	if (rotation < PI / 2) {
-		return Vector2{length / 2, width / 2} + t.translation;
+#ifdef MAZE_SUPPORT_SSE
+namespace {
+	static_assert(sizeof(Vector2) == 2 * sizeof(float));
+
+	// x and y of four consecutive directions.
+	void loadDirections(const Vector2* directions, __m128& x, __m128& y) {
+		const __m128 lo = _mm_loadu_ps(&directions[0].x), hi = _mm_loadu_ps(&directions[2].x);
+		x = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0));
+		y = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1));
+	}
+
+	void storePoints(Vector2* out, __m128 x, __m128 y) {
+		_mm_storeu_ps(&out[0].x, _mm_unpacklo_ps(x, y));
+		_mm_storeu_ps(&out[2].x, _mm_unpackhi_ps(x, y));
 	}
-	if (rotation < PI) {
-		return Vector2{length / 2, -width / 2} + t.translation;
+
+	// The same float operations as dot().
+	__m128 dot4(__m128 x, __m128 y, Vector2 v) {
+		return _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(v.x)), _mm_mul_ps(y, _mm_set1_ps(v.y)));
 	}
-	if (rotation < 3 * PI / 2) {
-		return Vector2{-length / 2, -width / 2} + t.translation;
+
+	__m128 select(__m128 mask, __m128 a, __m128 b) {
+		return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
 	}
-	return Vector2{-length / 2, width / 2} + t.translation;
+}
+#endif
+
+RectangleObj::RectangleObj(CuboidTransformation t, float length, float width):
+	t(t), length(length * t.length_scale), width(width) {
+	// collides() maps world to local with rot(t.rotation), so the local axes are rotated back.
+	float c = std::cos(t.rotation), s = std::sin(t.rotation);
+	half_axis = Vector2{c, -s} * (this->length / 2);
+	half_side = Vector2{s, c} * (width / 2);
 }
 
-Vector2 HexObj::supportFunction(float angle) const {
-	float rotation = fmod(angle - PI / 6 + 4 * PI, 2 * PI);
-	if (rotation < PI / 3) {
-		return Vector2{0, width} + t.translation;
+Vector2 RectangleObj::support(Vector2 direction) const {
+	Vector2 res = t.translation;
+	res += dot(direction, half_axis) >= 0 ? half_axis : -half_axis;
+	res += dot(direction, half_side) >= 0 ? half_side : -half_side;
+	return res;
+}
+
+void RectangleObj::supportBatch(std::span<const Vector2> directions, Vector2* out) const {
+	size_t i = 0;
+#ifdef MAZE_SUPPORT_SSE
+	// Four directions at a time, the signs of both dot products flip the half
+	// extents with the same additions as support().
+	const __m128 zero = _mm_setzero_ps(), sign = _mm_set1_ps(-0.0f);
+	const __m128 axis_x = _mm_set1_ps(half_axis.x), axis_y = _mm_set1_ps(half_axis.y);
+	const __m128 side_x = _mm_set1_ps(half_side.x), side_y = _mm_set1_ps(half_side.y);
+	const __m128 center_x = _mm_set1_ps(t.translation.x), center_y = _mm_set1_ps(t.translation.y);
+	for (; i + 4 <= directions.size(); i += 4) {
+		__m128 x, y;
+		loadDirections(&directions[i], x, y);
+		const __m128 axis_flip = _mm_and_ps(_mm_cmplt_ps(dot4(x, y, half_axis), zero), sign);
+		const __m128 side_flip = _mm_and_ps(_mm_cmplt_ps(dot4(x, y, half_side), zero), sign);
+		const __m128 res_x = _mm_add_ps(_mm_add_ps(center_x, _mm_xor_ps(axis_x, axis_flip)), _mm_xor_ps(side_x, side_flip));
+		const __m128 res_y = _mm_add_ps(_mm_add_ps(center_y, _mm_xor_ps(axis_y, axis_flip)), _mm_xor_ps(side_y, side_flip));
+		storePoints(out + i, res_x, res_y);
 	}
-	if (rotation < 2 * PI / 3) {
-		return Vector2{sqrtf(3) * width, width / 2} + t.translation;
+#endif
+	for (; i < directions.size(); i++) {
+		out[i] = support(directions[i]);
 	}
-	if (rotation < 3 * PI / 3) {
-		return Vector2{sqrtf(3) * width, -width / 2} + t.translation;
+}
+
+namespace {
+	// Corners of the hexprism mesh at 30, 90 and 150 degrees, the other three are their negatives.
+	constexpr Vector2 HEX_CORNERS[3] = {{SQRT3 / 2, 0.5f}, {0, 1}, {-SQRT3 / 2, 0.5f}};
+}
+
+Vector2 HexObj::support(Vector2 direction) const {
+	// The corner with the largest dot product, the sign picks it or its negative.
+	float best = 0;
+	Vector2 corner = HEX_CORNERS[0];
+	for (auto& c : HEX_CORNERS) {
+		float d = dot(direction, c);
+		if (std::abs(d) > std::abs(best)) {
+			best = d;
+			corner = c;
+		}
 	}
-	if (rotation < 4 * PI / 3) {
-		return Vector2{0, -width} + t.translation;
+	return (best >= 0 ? corner : -corner) * width + t.translation;
+}
+
+void HexObj::supportBatch(std::span<const Vector2> directions, Vector2* out) const {
+	size_t i = 0;
+#ifdef MAZE_SUPPORT_SSE
+	// Four directions at a time, the same corner choice as support() with masks.
+	const __m128 zero = _mm_setzero_ps(), sign = _mm_set1_ps(-0.0f), w = _mm_set1_ps(width);
+	const __m128 center_x = _mm_set1_ps(t.translation.x), center_y = _mm_set1_ps(t.translation.y);
+	for (; i + 4 <= directions.size(); i += 4) {
+		__m128 x, y;
+		loadDirections(&directions[i], x, y);
+		__m128 best = zero;
+		__m128 corner_x = _mm_set1_ps(HEX_CORNERS[0].x), corner_y = _mm_set1_ps(HEX_CORNERS[0].y);
+		for (auto& c : HEX_CORNERS) {
+			const __m128 d = dot4(x, y, c);
+			const __m128 larger = _mm_cmpgt_ps(_mm_andnot_ps(sign, d), _mm_andnot_ps(sign, best));
+			best = select(larger, d, best);
+			corner_x = select(larger, _mm_set1_ps(c.x), corner_x);
+			corner_y = select(larger, _mm_set1_ps(c.y), corner_y);
+		}
+		const __m128 flip = _mm_and_ps(_mm_cmplt_ps(best, zero), sign);
+		const __m128 res_x = _mm_add_ps(_mm_mul_ps(_mm_xor_ps(corner_x, flip), w), center_x);
+		const __m128 res_y = _mm_add_ps(_mm_mul_ps(_mm_xor_ps(corner_y, flip), w), center_y);
+		storePoints(out + i, res_x, res_y);
 	}
-	if (rotation < 5 * PI / 3) {
-		return Vector2{-sqrtf(3) * width, -width / 2} + t.translation;
+#endif
+	for (; i < directions.size(); i++) {
+		out[i] = support(directions[i]);
 	}
-	return Vector2{-sqrtf(3) * width, width / 2} + t.translation;
 }
@@ -7,10 +7,14 @@ struct RectangleObj: public Object {
 	CuboidTransformation t;
 	float length;
 	float width;
-	RectangleObj(CuboidTransformation t, float length, float width):
-		t(t), length(length), width(width) {}
-	
-	Vector2 supportFunction(float angle) const override;
+	// Half extents along the wall and across it in world space, fixed at construction.
+	Vector2 half_axis;
+	Vector2 half_side;
+	// length is the unscaled wall length, t.length_scale is applied here.
+	RectangleObj(CuboidTransformation t, float length, float width);
+
+	Vector2 support(Vector2 direction) const override;
+	void supportBatch(std::span<const Vector2> directions, Vector2* out) const override;
 
 	ObjectType type() const override { return ObjectType::Rect; };
 };
@@ -21,7 +25,8 @@ struct HexObj: public Object {
 	HexObj(TranslationTransformation t, float width):
 		t(t), width(width) {}
 
-	Vector2 supportFunction(float angle) const override;
+	Vector2 support(Vector2 direction) const override;
+	void supportBatch(std::span<const Vector2> directions, Vector2* out) const override;
 	ObjectType type() const override { return ObjectType::Hex; };
 };
 
@@ -0,0 +1,318 @@
+#include "mazeportals.hpp"
+#include "culling.hpp"
+#include "physics.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+namespace {
+	// Cell and neighbour slot on each side of the unit edge from the lower node
+	// a in direction dir, as x, y, down and slot. Up cells have the edges
+	// {0, 1}, {0, 2}, {1, 2} of their corners in the slots, down cells {0, 1},
+	// {1, 2}, {0, 2}, see MazeNav.
+	struct EdgeSide {
+		int x, y, down, slot;
+	};
+
+	std::array<EdgeSide, 2> edgeSides(node a, int dir) {
+		switch (dir) {
+		case 0:
+			return {{{a.x, a.y, 0, 0}, {a.x, a.y - 1, 1, 1}}};
+		case 1:
+			return {{{a.x, a.y, 0, 1}, {a.x - 1, a.y, 1, 2}}};
+		default:
+			return {{{a.x - 1, a.y, 0, 2}, {a.x - 1, a.y, 1, 0}}};
+		}
+	}
+
+	// Orders the ends of a unit edge as addWall does and returns its direction.
+	int edgeDirection(node& a, node& b) {
+		if (b.y < a.y || (b.y == a.y && b.x < a.x)) {
+			std::swap(a, b);
+		}
+		return b.y == a.y ? 0 : (b.x == a.x ? 1 : 2);
+	}
+
+	constexpr float WEDGE_EPS = 1e-5f;
+
+	// Directions on the boundary count as inside, so the traversal stays conservative.
+	bool inside(const ViewWedge& w, Vector2 d) {
+		return w.full || (cross(w.from, d) >= -WEDGE_EPS && cross(d, w.to) >= -WEDGE_EPS);
+	}
+
+	// Both at most half the circle, so the intersection is one wedge or nothing.
+	bool intersect(const ViewWedge& a, const ViewWedge& b, ViewWedge& res) {
+		if (a.full || b.full) {
+			res = a.full ? b : a;
+			return true;
+		}
+		if (inside(a, b.from)) {
+			res.from = b.from;
+		}
+		else if (inside(b, a.from)) {
+			res.from = a.from;
+		}
+		else {
+			return false;
+		}
+		if (inside(a, b.to)) {
+			res.to = b.to;
+		}
+		else if (inside(b, a.to)) {
+			res.to = a.to;
+		}
+		else {
+			return false;
+		}
+		res.full = false;
+		return true;
+	}
+
+	float segmentDistance(Vector2 p, Vector2 a, Vector2 b) {
+		Vector2 ab = b - a;
+		float t = std::clamp(dot(p - a, ab) / dot(ab, ab), 0.0f, 1.0f);
+		return (p - (a + ab * t)).abs();
+	}
+}
+
+ViewWedge playerViewWedge(float rot_y, float rot_up_down, float aspect) {
+	const float cy = std::cos(rot_y), sy = std::sin(rot_y);
+	const float cx = std::cos(rot_up_down), sx = std::sin(rot_up_down);
+	const float tan_y = std::tan(PLAYER_FOV_Y / 2), tan_x = tan_y * aspect;
+	// View space to the maze plane, the transpose of the rotations of playerViewProjection.
+	auto toPlane = [&](float x, float y, float z) {
+		float z_level = cx * z - sx * y;
+		return Vector2{cy * x - sy * z_level, sy * x + cy * z_level};
+	};
+	const Vector2 forward = toPlane(0, 0, 1);
+	if (forward.abs() < 1e-3f) {
+		return {{}, {}, true};
+	}
+	ViewWedge res;
+	float min_slope = 0, max_slope = 0;
+	bool first = true;
+	for (float x : {-tan_x, tan_x}) {
+		for (float y : {-tan_y, tan_y}) {
+			Vector2 corner = toPlane(x, y, 1);
+			float along = dot(forward, corner);
+			if (along <= 1e-3f * corner.abs()) {
+				return {{}, {}, true};
+			}
+			float slope = cross(forward, corner) / along;
+			if (first || slope < min_slope) {
+				min_slope = slope;
+				res.from = corner.normUnit();
+			}
+			if (first || slope > max_slope) {
+				max_slope = slope;
+				res.to = corner.normUnit();
+			}
+			first = false;
+		}
+	}
+	return res;
+}
+
+MazePortals::MazePortals(const MazeGraph& graph, std::span<const CuboidTransformation> walls, std::span<const TranslationTransformation> pillars,
+	std::span<const TranslationTransformation> floors, const Aabb& floor_bounds, float length, float width):
+	nav(graph, length, width) {
+	const int side = graph.side();
+	const float step = length + width * sqrtf(3), apothem = width * sqrtf(3) / 2;
+	const size_t cell_count = size_t(nav.cellCount());
+	across.resize(cell_count * 3);
+	edge_walls.assign(cell_count * 3, PORTAL_NO_WALL);
+	ends.resize(cell_count * 6);
+	corner_pillars.assign(cell_count * 3, PORTAL_NO_WALL);
+
+	std::vector<uint32_t> node_pillar(size_t(side) * side, PORTAL_NO_WALL);
+	for (size_t i = 0; i < pillars.size(); i++) {
+		int y = int(std::lround(pillars[i].translation.y / (step * sqrtf(3) / 2)));
+		int x = int(std::lround(pillars[i].translation.x / step - y / 2.0));
+		if (x >= 0 && y >= 0 && x < side && y < side) {
+			node_pillar[size_t(y) * side + x] = uint32_t(i);
+		}
+	}
+	// Floor tiles are a square grid with spacing length, as makeMazeBase lays them out.
+	int floor_x0 = INT32_MAX, floor_z0 = INT32_MAX, floor_x1 = INT32_MIN, floor_z1 = INT32_MIN;
+	auto floorCoords = [&](const TranslationTransformation& t) {
+		return node{int(std::lround(t.translation.x / length)), int(std::lround(t.translation.y / length))};
+	};
+	for (auto& t : floors) {
+		node g = floorCoords(t);
+		floor_x0 = std::min(floor_x0, g.x);
+		floor_z0 = std::min(floor_z0, g.y);
+		floor_x1 = std::max(floor_x1, g.x);
+		floor_z1 = std::max(floor_z1, g.y);
+	}
+	const int floor_columns = floors.empty() ? 0 : floor_x1 - floor_x0 + 1;
+	std::vector<uint32_t> floor_grid(size_t(floor_columns) * (floors.empty() ? 0 : floor_z1 - floor_z0 + 1), PORTAL_NO_WALL);
+	for (size_t i = 0; i < floors.size(); i++) {
+		node g = floorCoords(floors[i]);
+		floor_grid[size_t(g.y - floor_z0) * floor_columns + (g.x - floor_x0)] = uint32_t(i);
+	}
+
+	floor_offsets.assign(cell_count + 1, 0);
+	auto addCell = [&](int cell, node c0, node c1, node c2, const int (&slots)[3][2], const std::array<int, 3>& neighbours) {
+		const node corners[3] = {c0, c1, c2};
+		Vector2 p[3];
+		for (int i = 0; i < 3; i++) {
+			p[i] = coordsToHexOffset(corners[i].x, corners[i].y, length, width);
+			corner_pillars[size_t(cell) * 3 + i] = node_pillar[size_t(corners[i].y) * side + corners[i].x];
+		}
+		for (int k = 0; k < 3; k++) {
+			Vector2 a = p[slots[k][0]], b = p[slots[k][1]];
+			Vector2 along = (b - a).normUnit() * apothem;
+			ends[(size_t(cell) * 3 + k) * 2] = a + along;
+			ends[(size_t(cell) * 3 + k) * 2 + 1] = b - along;
+			across[size_t(cell) * 3 + k] = neighbours[k];
+		}
+		if (floor_columns > 0) {
+			float x0 = std::min({p[0].x, p[1].x, p[2].x}), x1 = std::max({p[0].x, p[1].x, p[2].x});
+			float z0 = std::min({p[0].y, p[1].y, p[2].y}), z1 = std::max({p[0].y, p[1].y, p[2].y});
+			int gx0 = std::max(floor_x0, int(std::ceil((x0 - floor_bounds.max.x) / length)));
+			int gx1 = std::min(floor_x1, int(std::floor((x1 - floor_bounds.min.x) / length)));
+			int gz0 = std::max(floor_z0, int(std::ceil((z0 - floor_bounds.max.z) / length)));
+			int gz1 = std::min(floor_z1, int(std::floor((z1 - floor_bounds.min.z) / length)));
+			for (int gz = gz0; gz <= gz1; gz++) {
+				for (int gx = gx0; gx <= gx1; gx++) {
+					if (uint32_t tile = floor_grid[size_t(gz - floor_z0) * floor_columns + (gx - floor_x0)]; tile != PORTAL_NO_WALL) {
+						floor_tiles.push_back(tile);
+					}
+				}
+			}
+		}
+		floor_offsets[cell + 1] = uint32_t(floor_tiles.size());
+	};
+	static const int up_slots[3][2] = {{0, 1}, {0, 2}, {1, 2}};
+	static const int down_slots[3][2] = {{0, 1}, {1, 2}, {0, 2}};
+	// Cells are numbered in this order, so the floor tiles can be appended.
+	for (int y = 0; y < side; y++) {
+		for (int x = 0; x < side; x++) {
+			if (int c = nav.latticeCell(x, y, 0); c != NAV_NO_CELL) {
+				addCell(c, {x, y}, {x + 1, y}, {x, y + 1}, up_slots,
+					{nav.latticeCell(x, y - 1, 1), nav.latticeCell(x - 1, y, 1), nav.latticeCell(x, y, 1)});
+			}
+			if (int c = nav.latticeCell(x, y, 1); c != NAV_NO_CELL) {
+				addCell(c, {x + 1, y}, {x, y + 1}, {x + 1, y + 1}, down_slots,
+					{nav.latticeCell(x, y, 0), nav.latticeCell(x, y + 1, 0), nav.latticeCell(x + 1, y, 0)});
+			}
+		}
+	}
+
+	for (size_t i = 0; i < walls.size(); i++) {
+		edge run = cuboidToEdge(walls[i], length, width);
+		int count = std::max(std::abs(run.n2.x - run.n1.x), std::abs(run.n2.y - run.n1.y));
+		node d = {(run.n2.x - run.n1.x) / count, (run.n2.y - run.n1.y) / count};
+		for (int k = 0; k < count; k++) {
+			setWall({run.n1.x + k * d.x, run.n1.y + k * d.y}, {run.n1.x + (k + 1) * d.x, run.n1.y + (k + 1) * d.y}, uint32_t(i));
+		}
+	}
+
+	cell_marks.assign(cell_count, 0);
+	on_path.assign(cell_count, 0);
+	wall_marks.assign(walls.size(), 0);
+	pillar_marks.assign(pillars.size(), 0);
+	floor_marks.assign(floors.size(), 0);
+}
+
+void MazePortals::setWall(node a, node b, uint32_t wall) {
+	int dir = edgeDirection(a, b);
+	for (const EdgeSide& e : edgeSides(a, dir)) {
+		if (int cell = nav.latticeCell(e.x, e.y, e.down); cell != NAV_NO_CELL) {
+			edge_walls[size_t(cell) * 3 + e.slot] = wall;
+		}
+	}
+}
+
+void MazePortals::mark(std::vector<uint32_t>& marks, uint32_t instance, std::vector<uint32_t>& out) {
+	if (instance >= marks.size()) {
+		marks.resize(size_t(instance) + 1, 0);
+	}
+	if (marks[instance] != query) {
+		marks[instance] = query;
+		out.push_back(instance);
+	}
+}
+
+struct MazePortals::Traversal {
+	MazePortals& portals;
+	Vector2 eye;
+	float max_distance;
+	PvsSets& out;
+	PortalStats stats;
+
+	void visit(int cell, const ViewWedge& view) {
+		stats.visits++;
+		if (portals.cell_marks[cell] != portals.query) {
+			portals.cell_marks[cell] = portals.query;
+			stats.cells++;
+			for (int k = 0; k < 3; k++) {
+				if (uint32_t wall = portals.wallAt(cell, k); wall != PORTAL_NO_WALL) {
+					portals.mark(portals.wall_marks, wall, out.walls);
+				}
+				if (uint32_t pillar = portals.pillarAt(cell, k); pillar != PORTAL_NO_WALL) {
+					portals.mark(portals.pillar_marks, pillar, out.pillars);
+				}
+			}
+			for (uint32_t tile : portals.floorTiles(cell)) {
+				portals.mark(portals.floor_marks, tile, out.floors);
+			}
+		}
+
+		portals.on_path[cell] = 1;
+		const Vector2 center = portals.cellCenter(cell);
+		for (int k = 0; k < 3; k++) {
+			int next = portals.neighbour(cell, k);
+			if (next == NAV_NO_CELL || portals.on_path[next]) {
+				continue;
+			}
+			stats.portals++;
+			const Vector2* p = portals.portalEnds(cell, k);
+			Vector2 a = p[0], b = p[1];
+			if (segmentDistance(eye, a, b) > max_distance) {
+				continue;
+			}
+			// The eye has to be on this cell's side of the portal to look through it.
+			Vector2 edge = b - a;
+			float eye_side = cross(edge, eye - a), cell_side = cross(edge, center - a);
+			if (eye_side * cell_side < 0 && std::abs(eye_side) > WEDGE_EPS * edge.abs()) {
+				continue;
+			}
+			ViewWedge through;
+			Vector2 to_a = (a - eye).normUnit(), to_b = (b - eye).normUnit();
+			if (std::abs(eye_side) <= WEDGE_EPS * edge.abs()) {
+				// On the line of the portal everything beyond it is in view.
+				Vector2 u = edge.normUnit();
+				through = cell_side > 0 ? ViewWedge{u * -1, u} : ViewWedge{u, u * -1};
+			}
+			else {
+				through = cross(to_a, to_b) > 0 ? ViewWedge{to_a, to_b} : ViewWedge{to_b, to_a};
+			}
+			ViewWedge clipped;
+			if (intersect(view, through, clipped)) {
+				visit(next, clipped);
+			}
+		}
+		portals.on_path[cell] = 0;
+	}
+};
+
+PortalStats MazePortals::visible(Vector2 eye, const ViewWedge& view, float max_distance, PvsSets& out) {
+	out.walls.clear();
+	out.pillars.clear();
+	out.floors.clear();
+	int cell = nav.cellAt(eye);
+	if (cell == NAV_NO_CELL) {
+		return {};
+	}
+	if (++query == 0) {
+		for (auto* marks : {&cell_marks, &wall_marks, &pillar_marks, &floor_marks}) {
+			std::fill(marks->begin(), marks->end(), 0);
+		}
+		query = 1;
+	}
+	Traversal traversal = {*this, eye, max_distance, out, {}};
+	traversal.visit(cell, view);
+	return traversal.stats;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "mazebvh.hpp"
+#include "mazegrid.hpp"
+#include "mazenav.hpp"
+#include "mazepvs.hpp"
+#include <cstdint>
+#include <span>
+#include <vector>
+
+constexpr uint32_t PORTAL_NO_WALL = UINT32_MAX;
+
+// Directions in the maze plane from from counterclockwise to to, at most half
+// the circle unless full is set.
+struct ViewWedge {
+	Vector2 from, to;
+	bool full = false;
+};
+
+// Horizontal extent of the player's view frustum as seen from above, full
+// when it spans half the circle or more, e.g. when looking down.
+ViewWedge playerViewWedge(float rot_y, float rot_up_down, float aspect);
+
+struct PortalStats {
+	size_t cells = 0;
+	// Cell entries of the traversal, a cell seen through two paths counts twice.
+	size_t visits = 0;
+	size_t portals = 0;
+};
+
+// The open edges between the MazeNav cells as portals, for visibility from
+// the camera at runtime. Every frame the view wedge is clipped through the
+// portals from the camera's cell, and the walls, pillars and floor tiles of
+// the cells it reaches are visible. Valid while the camera is below the top
+// of the walls, like MazePvs, but walls can be opened and closed in between.
+//
+// Cells are convex and a line crosses each of them once, so the traversal
+// never needs a visited set, only the cells on the current path. Not thread
+// safe, queries reuse the marks of the last one.
+class MazePortals {
+	MazeNav nav;
+	// Per cell and neighbour slot of MazeNav: the cell across the edge even if
+	// a wall is there, the wall on it, and the ends of the edge shrunk by the pillars.
+	std::vector<int> across;
+	std::vector<uint32_t> edge_walls;
+	std::vector<Vector2> ends;
+	// Pillars on the corners of every cell and the floor tiles below it.
+	std::vector<uint32_t> corner_pillars;
+	std::vector<uint32_t> floor_offsets;
+	std::vector<uint32_t> floor_tiles;
+
+	// Last query that reached each cell or instance, and the cells on the current path.
+	uint32_t query = 0;
+	std::vector<uint32_t> cell_marks, wall_marks, pillar_marks, floor_marks;
+	std::vector<uint8_t> on_path;
+
+	struct Traversal;
+	void mark(std::vector<uint32_t>& marks, uint32_t instance, std::vector<uint32_t>& out);
+public:
+	// walls may be merged, floor_bounds is the floor mesh in its own space.
+	MazePortals(const MazeGraph& graph, std::span<const CuboidTransformation> walls, std::span<const TranslationTransformation> pillars,
+		std::span<const TranslationTransformation> floors, const Aabb& floor_bounds, float length, float width);
+
+	int cellCount() const { return nav.cellCount(); }
+	// O(1), NAV_NO_CELL outside the maze.
+	int cellAt(Vector2 position) const { return nav.cellAt(position); }
+	Vector2 cellCenter(int cell) const { return nav.cellCenter(cell); }
+	// Cell across the edge in slot 0..2, NAV_NO_CELL if a wall is there.
+	int neighbour(int cell, int slot) const {
+		size_t i = size_t(cell) * 3 + slot;
+		return edge_walls[i] == PORTAL_NO_WALL ? across[i] : NAV_NO_CELL;
+	}
+	// Wall instance on the edge in slot 0..2, PORTAL_NO_WALL if it is open.
+	uint32_t wallAt(int cell, int slot) const { return edge_walls[size_t(cell) * 3 + slot]; }
+	// Ends of the edge in slot 0..2 without the parts covered by the pillars.
+	const Vector2* portalEnds(int cell, int slot) const { return &ends[(size_t(cell) * 3 + slot) * 2]; }
+	// Pillar on corner 0..2, PORTAL_NO_WALL if there is none.
+	uint32_t pillarAt(int cell, int corner) const { return corner_pillars[size_t(cell) * 3 + corner]; }
+	std::span<const uint32_t> floorTiles(int cell) const {
+		return {floor_tiles.data() + floor_offsets[cell], floor_tiles.data() + floor_offsets[cell + 1]};
+	}
+
+	// Puts wall instance wall on the edge between neighbouring lattice nodes a
+	// and b, PORTAL_NO_WALL opens it. Edges on the outline of the maze stay closed.
+	void setWall(node a, node b, uint32_t wall);
+
+	// Replaces out with the instances in the cells the wedge reaches from eye
+	// through the portals, up to max_distance from it. out has the same
+	// indices as the arrays the portals were built from.
+	PortalStats visible(Vector2 eye, const ViewWedge& view, float max_distance, PvsSets& out);
+};
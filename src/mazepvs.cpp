@@ -0,0 +1,263 @@
+#include "mazepvs.hpp"
+#include "mazeportals.hpp"
+#include "physics.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+namespace {
+	constexpr uint32_t NO_INSTANCE = UINT32_MAX;
+	// Cells per parallel job, each job encodes its cells into its own buffer.
+	constexpr int PVS_BLOCK = 256;
+
+	// Open edge seen from the cell it is crossed from, ends named by their
+	// side of the direction of travel.
+	struct Portal {
+		Vector2 left, right;
+	};
+
+	// Normals n with dot(n, v) >= 0 for every constraint v so far, from from
+	// counterclockwise to to, never more than half the circle. For portals
+	// the constraints are left_i - right_j of every pair: the line through
+	// them with normal n has all left ends on one side and all right ends on
+	// the other, so it passes through every portal.
+	struct NormalArc {
+		Vector2 from, to;
+	};
+
+	NormalArc halfCircle(Vector2 v) {
+		v = v.normUnit();
+		return {{v.y, -v.x}, {-v.y, v.x}};
+	}
+
+	// Clips the arc to dot(n, v) >= 0, false if nothing is left. Normals on
+	// the edge count as inside, so the sets stay conservative.
+	bool clip(NormalArc& arc, Vector2 v) {
+		float length = v.abs();
+		if (length == 0) {
+			return true;
+		}
+		v = v / length;
+		constexpr float EPS = 1e-5f;
+		bool from_inside = dot(arc.from, v) >= -EPS, to_inside = dot(arc.to, v) >= -EPS;
+		if (from_inside && to_inside) {
+			return true;
+		}
+		if (!from_inside && !to_inside) {
+			return false;
+		}
+		if (from_inside) {
+			arc.to = {-v.y, v.x};
+		}
+		else {
+			arc.from = {v.y, -v.x};
+		}
+		return true;
+	}
+
+	struct Flood {
+		const MazePortals& portals;
+		std::vector<Portal> path;
+		std::vector<int> visible;
+
+		// Cells form a tree, so every cell is reached at most once.
+		void visit(int cell, int parent, NormalArc arc) {
+			visible.push_back(cell);
+			const Vector2 center = portals.cellCenter(cell);
+			for (int k = 0; k < 3; k++) {
+				int next = portals.neighbour(cell, k);
+				if (next == NAV_NO_CELL || next == parent) {
+					continue;
+				}
+				const Vector2* ends = portals.portalEnds(cell, k);
+				Vector2 a = ends[0], b = ends[1];
+				Vector2 travel = portals.cellCenter(next) - center;
+				Portal p = cross(travel, a - (a + b) / 2) > 0 ? Portal{a, b} : Portal{b, a};
+
+				NormalArc clipped = arc;
+				bool open = true;
+				if (path.empty()) {
+					clipped = halfCircle(p.left - p.right);
+				}
+				else {
+					open = clip(clipped, p.left - p.right);
+					for (size_t i = 0; i < path.size() && open; i++) {
+						open = clip(clipped, p.left - path[i].right) && clip(clipped, path[i].left - p.right);
+					}
+				}
+				if (open) {
+					path.push_back(p);
+					visit(next, cell, clipped);
+					path.pop_back();
+				}
+			}
+		}
+	};
+
+	void putVarint(std::vector<uint8_t>& out, uint32_t v) {
+		while (v >= 0x80) {
+			out.push_back(uint8_t(v | 0x80));
+			v >>= 7;
+		}
+		out.push_back(uint8_t(v));
+	}
+
+	uint32_t getVarint(const uint8_t*& p) {
+		uint32_t v = 0;
+		for (int shift = 0;; shift += 7) {
+			uint8_t byte = *p++;
+			v |= uint32_t(byte & 0x7f) << shift;
+			if (byte < 0x80) {
+				return v;
+			}
+		}
+	}
+}
+
+MazePvs::MazePvs(const MazeGraph& graph, std::span<const CuboidTransformation> walls, std::span<const TranslationTransformation> pillars,
+	std::span<const TranslationTransformation> floors, const Aabb& floor_bounds, float length, float width, int thread_count):
+	nav(graph, length, width) {
+	if (thread_count <= 0) {
+		thread_count = std::max(1u, std::thread::hardware_concurrency());
+	}
+	const MazePortals portals(graph, walls, pillars, floors, floor_bounds, length, width);
+	const int cell_count = portals.cellCount();
+
+	// Number the instances in the order the cells first show them, which is
+	// row order of the lattice, each kind on its own. Instances no cell shows
+	// go last.
+	std::vector<uint32_t> wall_numbers(walls.size(), NO_INSTANCE), pillar_numbers(pillars.size(), NO_INSTANCE);
+	std::vector<uint32_t> floor_numbers(floors.size(), NO_INSTANCE);
+	auto number = [&](std::vector<uint32_t>& numbers, uint32_t instance) {
+		if (numbers[instance] == NO_INSTANCE) {
+			numbers[instance] = uint32_t(order.size());
+			order.push_back(instance);
+		}
+	};
+	auto numberRest = [&](std::vector<uint32_t>& numbers) {
+		for (uint32_t i = 0; i < numbers.size(); i++) {
+			number(numbers, i);
+		}
+	};
+	for (int cell = 0; cell < cell_count; cell++) {
+		for (int k = 0; k < 3; k++) {
+			if (uint32_t wall = portals.wallAt(cell, k); wall != PORTAL_NO_WALL) {
+				number(wall_numbers, wall);
+			}
+		}
+	}
+	numberRest(wall_numbers);
+	pillar_begin = uint32_t(order.size());
+	for (int cell = 0; cell < cell_count; cell++) {
+		for (int k = 0; k < 3; k++) {
+			if (uint32_t pillar = portals.pillarAt(cell, k); pillar != PORTAL_NO_WALL) {
+				number(pillar_numbers, pillar);
+			}
+		}
+	}
+	numberRest(pillar_numbers);
+	floor_begin = uint32_t(order.size());
+	for (int cell = 0; cell < cell_count; cell++) {
+		for (uint32_t tile : portals.floorTiles(cell)) {
+			number(floor_numbers, tile);
+		}
+	}
+	numberRest(floor_numbers);
+
+	// The instances each cell shows: walls on its closed edges, pillars on
+	// its corners, floor tiles under it.
+	std::vector<uint32_t> own_offsets = {0}, own;
+	for (int cell = 0; cell < cell_count; cell++) {
+		const size_t begin = own.size();
+		for (int k = 0; k < 3; k++) {
+			if (uint32_t wall = portals.wallAt(cell, k); wall != PORTAL_NO_WALL) {
+				own.push_back(wall_numbers[wall]);
+			}
+			if (uint32_t pillar = portals.pillarAt(cell, k); pillar != PORTAL_NO_WALL) {
+				own.push_back(pillar_numbers[pillar]);
+			}
+		}
+		for (uint32_t tile : portals.floorTiles(cell)) {
+			own.push_back(floor_numbers[tile]);
+		}
+		std::sort(own.begin() + begin, own.end());
+		own.erase(std::unique(own.begin() + begin, own.end()), own.end());
+		own_offsets.push_back(uint32_t(own.size()));
+	}
+
+	const size_t block_count = size_t(cell_count + PVS_BLOCK - 1) / PVS_BLOCK;
+	std::vector<std::vector<uint8_t>> block_runs(block_count);
+	std::vector<uint32_t> cell_bytes(size_t(cell_count), 0);
+	std::vector<size_t> block_visible(block_count), block_max(block_count);
+	parallelFor(int(block_count), std::min(thread_count, std::max(int(block_count), 1)), [&](int block) {
+		Flood flood = {portals, {}, {}};
+		std::vector<uint32_t> ids;
+		auto& out = block_runs[block];
+		for (int cell = block * PVS_BLOCK; cell < std::min(cell_count, (block + 1) * PVS_BLOCK); cell++) {
+			flood.visible.clear();
+			flood.visit(cell, NAV_NO_CELL, {});
+			ids.clear();
+			for (int c : flood.visible) {
+				ids.insert(ids.end(), own.begin() + own_offsets[c], own.begin() + own_offsets[c + 1]);
+			}
+			std::sort(ids.begin(), ids.end());
+			ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+			block_visible[block] += ids.size();
+			block_max[block] = std::max(block_max[block], ids.size());
+
+			const size_t begin = out.size();
+			uint32_t position = 0;
+			for (size_t i = 0; i < ids.size();) {
+				size_t j = i + 1;
+				while (j < ids.size() && ids[j] == ids[j - 1] + 1) {
+					j++;
+				}
+				putVarint(out, ids[i] - position);
+				putVarint(out, uint32_t(j - i - 1));
+				position = ids[j - 1] + 1;
+				i = j;
+			}
+			cell_bytes[cell] = uint32_t(out.size() - begin);
+		}
+	});
+
+	cell_offsets.resize(size_t(cell_count) + 1);
+	cell_offsets[0] = 0;
+	std::inclusive_scan(cell_bytes.begin(), cell_bytes.end(), cell_offsets.begin() + 1);
+	runs.reserve(cell_offsets.back());
+	for (auto& r : block_runs) {
+		runs.insert(runs.end(), r.begin(), r.end());
+	}
+	visible_total = std::accumulate(block_visible.begin(), block_visible.end(), size_t(0));
+	max_visible = block_max.empty() ? 0 : *std::max_element(block_max.begin(), block_max.end());
+}
+
+void MazePvs::visible(int cell, PvsSets& out) const {
+	out.walls.clear();
+	out.pillars.clear();
+	out.floors.clear();
+	const uint8_t* p = runs.data() + cell_offsets[cell];
+	const uint8_t* end = runs.data() + cell_offsets[cell + 1];
+	uint32_t position = 0;
+	while (p < end) {
+		uint32_t begin = position + getVarint(p);
+		position = begin + getVarint(p) + 1;
+		for (uint32_t i = begin; i < position; i++) {
+			auto& kind = i < pillar_begin ? out.walls : i < floor_begin ? out.pillars : out.floors;
+			kind.push_back(order[i]);
+		}
+	}
+}
+
+PvsStats MazePvs::stats() const {
+	PvsStats res;
+	res.cells = size_t(nav.cellCount());
+	res.instances = order.size();
+	res.max_visible = max_visible;
+	res.mean_visible = res.cells ? double(visible_total) / res.cells : 0;
+	res.bytes = runs.size() + cell_offsets.size() * sizeof(uint32_t) + order.size() * sizeof(uint32_t);
+	res.bitset_bytes = res.cells * ((res.instances + 7) / 8);
+	res.list_bytes = visible_total * sizeof(uint32_t) + cell_offsets.size() * sizeof(uint32_t);
+	return res;
+}
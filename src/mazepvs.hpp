@@ -0,0 +1,59 @@
+#pragma once
+
+#include "mazebvh.hpp"
+#include "mazenav.hpp"
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Instance indices of each kind, as in the arrays the set was built from.
+struct PvsSets {
+	std::vector<uint32_t> walls;
+	std::vector<uint32_t> pillars;
+	std::vector<uint32_t> floors;
+};
+
+struct PvsStats {
+	size_t cells = 0;
+	size_t instances = 0;
+	size_t max_visible = 0;
+	double mean_visible = 0;
+	// Encoded runs plus offsets and the instance order.
+	size_t bytes = 0;
+	// The same sets as one bitset per cell, and as uint32_t lists.
+	size_t bitset_bytes = 0;
+	size_t list_bytes = 0;
+};
+
+// Potentially visible set of every MazeNav cell: the walls, pillars and
+// floor tiles that can be seen from anywhere in the cell while the camera is
+// below the top of the walls. The open edges of the cells are portals, and a
+// cell is visible if a line passes through every portal on the way to it,
+// with the portals shrunk by the pillars at their ends.
+//
+// Instances are numbered walls, then pillars, then floor tiles, each kind in
+// row order of the lattice, so a set is a few runs of that order. Every cell
+// stores its runs as varint pairs of the gap since the last run and the length.
+class MazePvs {
+	MazeNav nav;
+	// Instance index of each number, and where the pillars and floor tiles start.
+	std::vector<uint32_t> order;
+	uint32_t pillar_begin = 0;
+	uint32_t floor_begin = 0;
+	std::vector<uint32_t> cell_offsets;
+	std::vector<uint8_t> runs;
+	size_t visible_total = 0;
+	size_t max_visible = 0;
+public:
+	// walls may be merged, floor_bounds is the floor mesh in its own space.
+	// thread_count = 0 uses all hardware threads.
+	MazePvs(const MazeGraph& graph, std::span<const CuboidTransformation> walls, std::span<const TranslationTransformation> pillars,
+		std::span<const TranslationTransformation> floors, const Aabb& floor_bounds, float length, float width, int thread_count = 0);
+
+	int cellCount() const { return nav.cellCount(); }
+	// O(1), NAV_NO_CELL outside the maze.
+	int cellAt(Vector2 position) const { return nav.cellAt(position); }
+	// Replaces out with the set of the cell.
+	void visible(int cell, PvsSets& out) const;
+	PvsStats stats() const;
+};
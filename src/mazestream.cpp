@@ -0,0 +1,163 @@
+#include "mazestream.hpp"
+#include "mazegrid.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+namespace {
+	// Rows are contiguous, x in [rowBegin, rowEnd].
+	int rowBegin(int y, int side_edges) {
+		return std::max(0, side_edges - y);
+	}
+
+	int rowEnd(int y, int side_edges) {
+		return std::min(3 * side_edges - y, 2 * side_edges);
+	}
+}
+
+MazeRowStream::MazeRowStream(float length, float width, int side_edges, int seed):
+	length(length), width(width), side_edges(side_edges), row_size(3 * side_edges + 1),
+	prev_label(row_size), cur_label(row_size), parent(2 * row_size), remap(2 * row_size), has_down(row_size) {
+	random_gen.seed(seed);
+}
+
+int MazeRowStream::find(int label) {
+	int root = label;
+	while (parent[root] != root) {
+		root = parent[root];
+	}
+	while (parent[label] != root) {
+		int next = parent[label];
+		parent[label] = root;
+		label = next;
+	}
+	return root;
+}
+
+bool MazeRowStream::unite(int a, int b) {
+	a = find(a);
+	b = find(b);
+	if (a == b) {
+		return false;
+	}
+	parent[b] = a;
+	return true;
+}
+
+// Raw engine bits are specified by the standard, unlike the distributions.
+bool MazeRowStream::coin() {
+	return random_gen() & 1;
+}
+
+bool MazeRowStream::next(MazeRow& row) {
+	if (y >= rowCount()) {
+		return false;
+	}
+	row.y = y;
+	row.hexprisms.clear();
+	row.cuboids.clear();
+
+	const int begin = rowBegin(y, side_edges), end = rowEnd(y, side_edges);
+	for (int x = begin; x <= end; x++) {
+		assert(isPartOfHex(x, y, side_edges));
+		row.hexprisms.push_back({coordsToHexOffset(x, y, length, width)});
+		cur_label[x] = row_size + x;
+		parent[row_size + x] = row_size + x;
+	}
+
+	auto addEdge = [&](edge e, int a, int b) {
+		unite(a, b);
+		row.cuboids.push_back(edgeToCuboid(e, length, width));
+	};
+
+	// Border edges come first, like in getMaze, and are always walls.
+	if (y == 0 || y == 2 * side_edges) {
+		for (int x = begin; x < end; x++) {
+			addEdge({{x, y}, {x + 1, y}}, cur_label[x], cur_label[x + 1]);
+		}
+	}
+
+	if (y > 0) {
+		const int prev_begin = rowBegin(y - 1, side_edges), prev_end = rowEnd(y - 1, side_edges);
+		auto downEdges = [&](int x, edge (&edges)[2]) {
+			int count = 0;
+			for (int nx : {x, x - 1}) {
+				if (nx >= begin && nx <= end) {
+					edges[count++] = {{x, y - 1}, {nx, y}};
+				}
+			}
+			return count;
+		};
+
+		for (int x = prev_begin; x <= prev_end; x++) {
+			has_down[x] = false;
+			edge edges[2];
+			int count = downEdges(x, edges);
+			for (int i = 0; i < count; i++) {
+				if (isBorderEdge(edges[i], side_edges)) {
+					addEdge(edges[i], prev_label[x], cur_label[edges[i].n2.x]);
+					has_down[x] = true;
+				}
+			}
+		}
+
+		for (int x = prev_begin; x <= prev_end; x++) {
+			edge edges[2];
+			int count = downEdges(x, edges);
+			for (int i = 0; i < count; i++) {
+				int target = cur_label[edges[i].n2.x];
+				if (!isBorderEdge(edges[i], side_edges) && coin() && find(prev_label[x]) != find(target)) {
+					addEdge(edges[i], prev_label[x], target);
+					has_down[x] = true;
+				}
+			}
+		}
+
+		// Every set of the previous row has to continue downwards, otherwise it is cut off.
+		std::fill(remap.begin(), remap.end(), 0);
+		for (int x = prev_begin; x <= prev_end; x++) {
+			remap[find(prev_label[x])] |= has_down[x];
+		}
+		for (int x = prev_begin; x <= prev_end; x++) {
+			if (remap[find(prev_label[x])]) {
+				continue;
+			}
+			edge edges[2];
+			int count = downEdges(x, edges);
+			int first = count > 1 ? int(coin()) : 0;
+			for (int i = 0; i < count; i++) {
+				edge e = edges[(first + i) % count];
+				if (find(prev_label[x]) != find(cur_label[e.n2.x])) {
+					addEdge(e, prev_label[x], cur_label[e.n2.x]);
+					remap[find(prev_label[x])] = 1;
+					break;
+				}
+			}
+		}
+	}
+
+	if (y != 0 && y != 2 * side_edges) {
+		for (int x = begin; x < end; x++) {
+			if (coin() && find(cur_label[x]) != find(cur_label[x + 1])) {
+				addEdge({{x, y}, {x + 1, y}}, cur_label[x], cur_label[x + 1]);
+			}
+		}
+	}
+
+	// Compact the current row's sets into [0, row_size) for the next row.
+	std::fill(remap.begin(), remap.end(), -1);
+	int next_label = 0;
+	for (int x = begin; x <= end; x++) {
+		int root = find(cur_label[x]);
+		if (remap[root] < 0) {
+			remap[root] = next_label++;
+		}
+		prev_label[x] = remap[root];
+	}
+	for (int i = 0; i < row_size; i++) {
+		parent[i] = i;
+	}
+
+	y++;
+	return true;
+}
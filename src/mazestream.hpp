@@ -0,0 +1,44 @@
+#pragma once
+
+#include "maze.hpp"
+#include <cstdint>
+#include <random>
+#include <vector>
+
+// Walls and pillars of a single hex row. Cuboids are the walls added while
+// the row was generated: inside the row and towards the row above it.
+struct MazeRow {
+	int y;
+	std::vector<TranslationTransformation> hexprisms;
+	std::vector<CuboidTransformation> cuboids;
+};
+
+// Eller-style generator, produces the maze one row at a time and keeps only
+// O(side_edges) state, so the full maze never has to be resident in memory.
+class MazeRowStream {
+	float length;
+	float width;
+	int side_edges;
+	int row_size;
+	int y = 0;
+	std::mt19937 random_gen;
+
+	// Set labels of the previous and current row cells, indexed by x.
+	// Previous row uses labels [0, row_size), current row [row_size, 2 * row_size).
+	std::vector<int> prev_label;
+	std::vector<int> cur_label;
+	std::vector<int> parent;
+	std::vector<int> remap;
+	std::vector<uint8_t> has_down;
+
+	int find(int label);
+	bool unite(int a, int b);
+	bool coin();
+public:
+	MazeRowStream(float length, float width, int side_edges, int seed = 14369);
+
+	int rowCount() const { return 2 * side_edges + 1; }
+
+	// Generates the next row into `row`, returns false once all rows were emitted.
+	bool next(MazeRow& row);
+};
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Fixed-size blocks of T with a free list, so objects get stable addresses
+// without one heap allocation each. Objects still alive when the pool is
+// destroyed are released without a destructor call, hence the static_assert.
+template<typename T, size_t BlockSize = 1024>
+class ObjectPool {
+	static_assert(std::is_trivially_destructible_v<T>, "ObjectPool does not run destructors of live objects");
+
+	union Node {
+		Node* next;
+		T value;
+		Node() {}
+	};
+
+	std::vector<std::unique_ptr<Node[]>> blocks;
+	Node* free_list = nullptr;
+	size_t used_in_block = BlockSize;
+	size_t live = 0;
+public:
+	ObjectPool() = default;
+	ObjectPool(const ObjectPool&) = delete;
+	ObjectPool& operator=(const ObjectPool&) = delete;
+
+	template<typename... Args>
+	T* create(Args&&... args) {
+		Node* node;
+		if (free_list) {
+			node = free_list;
+			free_list = free_list->next;
+		}
+		else {
+			if (used_in_block == BlockSize) {
+				blocks.emplace_back(new Node[BlockSize]);
+				used_in_block = 0;
+			}
+			node = &blocks.back()[used_in_block++];
+		}
+		live++;
+		return new (&node->value) T(std::forward<Args>(args)...);
+	}
+
+	// obj must come from create() of this pool.
+	void destroy(T* obj) {
+		obj->~T();
+		Node* node = reinterpret_cast<Node*>(obj);
+		node->next = free_list;
+		free_list = node;
+		live--;
+	}
+
+	size_t size() const { return live; }
+	size_t capacity() const { return blocks.size() * BlockSize; }
+};
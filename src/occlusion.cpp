@@ -0,0 +1,299 @@
+#include "occlusion.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <thread>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MAZE_OCCLUSION_SSE
+#include <emmintrin.h>
+#endif
+
+namespace {
+	// A box counts as behind a pixel only if it is this much further, so a
+	// wall is never hidden by its own faces after rounding.
+	constexpr float OCCLUSION_BIAS = 1e-3f;
+
+	struct ClipVertex {
+		float x, y, z, w;
+	};
+
+	struct ScreenVertex {
+		float x, y, depth;
+	};
+
+	// Faces of a box as quads of its corners, bit 0, 1, 2 of a corner being
+	// its max x, y, z. Counterclockwise seen from outside in a right handed basis.
+	constexpr int BOX_FACES[6][4] = {
+		{0, 4, 6, 2}, {1, 3, 7, 5}, {0, 1, 5, 4}, {2, 6, 7, 3}, {0, 2, 3, 1}, {4, 5, 7, 6},
+	};
+
+	ClipVertex transform(float x, float y, float z, const InstanceMatrix& m) {
+		return {
+			x * m.m[0][0] + y * m.m[1][0] + z * m.m[2][0] + m.m[3][0],
+			x * m.m[0][1] + y * m.m[1][1] + z * m.m[2][1] + m.m[3][1],
+			x * m.m[0][2] + y * m.m[1][2] + z * m.m[2][2] + m.m[3][2],
+			x * m.m[0][3] + y * m.m[1][3] + z * m.m[2][3] + m.m[3][3],
+		};
+	}
+
+	float determinant3(const InstanceMatrix& m) {
+		return m.m[0][0] * (m.m[1][1] * m.m[2][2] - m.m[1][2] * m.m[2][1])
+			- m.m[0][1] * (m.m[1][0] * m.m[2][2] - m.m[1][2] * m.m[2][0])
+			+ m.m[0][2] * (m.m[1][0] * m.m[2][1] - m.m[1][1] * m.m[2][0]);
+	}
+
+	// Cuts the polygon at the near plane z = 0 of D3D clip space.
+	int clipNear(const ClipVertex* in, int count, ClipVertex* out) {
+		int res = 0;
+		for (int i = 0; i < count; i++) {
+			const ClipVertex& a = in[i];
+			const ClipVertex& b = in[(i + 1) % count];
+			if (a.z >= 0) {
+				out[res++] = a;
+			}
+			if ((a.z >= 0) != (b.z >= 0)) {
+				float t = a.z / (a.z - b.z);
+				out[res++] = {a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, 0, a.w + (b.w - a.w) * t};
+			}
+		}
+		return res;
+	}
+}
+
+struct OcclusionBuffer::ScreenRect {
+	float x0, y0, x1, y1;
+	// 1 / w of the nearest corner.
+	float nearest;
+};
+
+OcclusionBuffer::OcclusionBuffer(int width, int height, int thread_count):
+	width(width), height(height), tiles_x(width / OCCLUSION_TILE), tiles_y(height / OCCLUSION_TILE),
+	pool(thread_count > 0 ? thread_count : int(std::max(1u, std::thread::hardware_concurrency()))),
+	depth(size_t(width) * height), tile_depth(size_t(tiles_x) * tiles_y),
+	thread_triangles(size_t(pool.threadCount())) {
+	assert(width % OCCLUSION_TILE == 0 && height % OCCLUSION_TILE == 0);
+}
+
+void OcclusionBuffer::setupBoxes(const Aabb& local, std::span<const InstanceMatrix> occluders, std::vector<Triangle>& out) const {
+	const float half_width = width * 0.5f, half_height = height * 0.5f;
+	for (const InstanceMatrix& m : occluders) {
+		const InstanceMatrix mvp = multiply(m, view_projection);
+		ClipVertex corners[8];
+		for (int c = 0; c < 8; c++) {
+			corners[c] = transform(c & 1 ? local.max.x : local.min.x, c & 2 ? local.max.y : local.min.y,
+				c & 4 ? local.max.z : local.min.z, mvp);
+		}
+		// Front faces are clockwise on screen, y pointing down, unless the matrix mirrors.
+		const float front = determinant3(m) > 0 ? 1.0f : -1.0f;
+		for (auto& face : BOX_FACES) {
+			ClipVertex quad[4], clipped[8];
+			bool outside[5] = {true, true, true, true, true};
+			for (int k = 0; k < 4; k++) {
+				const ClipVertex& v = quad[k] = corners[face[k]];
+				outside[0] &= v.x > v.w;
+				outside[1] &= v.x < -v.w;
+				outside[2] &= v.y > v.w;
+				outside[3] &= v.y < -v.w;
+				outside[4] &= v.z < 0;
+			}
+			if (std::any_of(std::begin(outside), std::end(outside), [](bool o) { return o; })) {
+				continue;
+			}
+			int count = clipNear(quad, 4, clipped);
+			ScreenVertex screen[8];
+			for (int k = 0; k < count; k++) {
+				const float inv_w = 1 / clipped[k].w;
+				screen[k] = {(clipped[k].x * inv_w + 1) * half_width, (1 - clipped[k].y * inv_w) * half_height, inv_w};
+			}
+			for (int k = 1; k + 1 < count; k++) {
+				ScreenVertex v[3] = {screen[0], screen[k], screen[k + 1]};
+				float area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[1].y - v[0].y) * (v[2].x - v[0].x);
+				if (area * front <= 0) {
+					continue;
+				}
+				if (area < 0) {
+					std::swap(v[1], v[2]);
+					area = -area;
+				}
+				Triangle t;
+				for (int e = 0; e < 3; e++) {
+					const ScreenVertex& a = v[e];
+					const ScreenVertex& b = v[(e + 1) % 3];
+					t.edge_a[e] = a.y - b.y;
+					t.edge_b[e] = b.x - a.x;
+					t.edge_c[e] = (b.y - a.y) * a.x - (b.x - a.x) * a.y;
+				}
+				t.depth_a = ((v[1].depth - v[0].depth) * (v[2].y - v[0].y) - (v[2].depth - v[0].depth) * (v[1].y - v[0].y)) / area;
+				t.depth_b = ((v[1].x - v[0].x) * (v[2].depth - v[0].depth) - (v[2].x - v[0].x) * (v[1].depth - v[0].depth)) / area;
+				t.depth_c = v[0].depth - t.depth_a * v[0].x - t.depth_b * v[0].y;
+				// Pixels with their center in the bounds of the triangle.
+				const float min_x = std::min({v[0].x, v[1].x, v[2].x}), max_x = std::max({v[0].x, v[1].x, v[2].x});
+				const float min_y = std::min({v[0].y, v[1].y, v[2].y}), max_y = std::max({v[0].y, v[1].y, v[2].y});
+				t.x0 = int(std::ceil(std::max(min_x - 0.5f, 0.0f)));
+				t.x1 = int(std::floor(std::min(max_x - 0.5f, float(width - 1))));
+				t.y0 = int(std::ceil(std::max(min_y - 0.5f, 0.0f)));
+				t.y1 = int(std::floor(std::min(max_y - 0.5f, float(height - 1))));
+				if (t.x0 <= t.x1 && t.y0 <= t.y1) {
+					out.push_back(t);
+				}
+			}
+		}
+	}
+}
+
+template<bool SIMD>
+void OcclusionBuffer::drawRows(int tile_row_begin, int tile_row_end) {
+	const int y_begin = tile_row_begin * OCCLUSION_TILE, y_end = tile_row_end * OCCLUSION_TILE;
+	std::fill(depth.begin() + size_t(y_begin) * width, depth.begin() + size_t(y_end) * width, 0.0f);
+	for (auto& triangles : thread_triangles) {
+		for (const Triangle& t : triangles) {
+			// Whole groups of four pixels, the same ones with and without SIMD.
+			const int x_begin = t.x0 & ~3, x_end = t.x1 | 3;
+			for (int y = std::max(t.y0, y_begin); y <= std::min(t.y1, y_end - 1); y++) {
+				const float yc = float(y) + 0.5f;
+				const float row_e0 = t.edge_b[0] * yc + t.edge_c[0], row_e1 = t.edge_b[1] * yc + t.edge_c[1];
+				const float row_e2 = t.edge_b[2] * yc + t.edge_c[2], row_depth = t.depth_b * yc + t.depth_c;
+				float* row = depth.data() + size_t(y) * width;
+#ifdef MAZE_OCCLUSION_SSE
+				if constexpr (SIMD) {
+					const __m128 a0 = _mm_set1_ps(t.edge_a[0]), a1 = _mm_set1_ps(t.edge_a[1]), a2 = _mm_set1_ps(t.edge_a[2]);
+					const __m128 r0 = _mm_set1_ps(row_e0), r1 = _mm_set1_ps(row_e1), r2 = _mm_set1_ps(row_e2);
+					const __m128 da = _mm_set1_ps(t.depth_a), rd = _mm_set1_ps(row_depth), zero = _mm_setzero_ps();
+					const __m128 centers = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+					for (int x = x_begin; x <= x_end; x += 4) {
+						const __m128 xc = _mm_add_ps(_mm_set1_ps(float(x)), centers);
+						__m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a0, xc), r0), zero);
+						inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a1, xc), r1), zero));
+						inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a2, xc), r2), zero));
+						if (_mm_movemask_ps(inside) == 0) {
+							continue;
+						}
+						const __m128 old_depth = _mm_loadu_ps(row + x);
+						const __m128 nearer = _mm_max_ps(old_depth, _mm_add_ps(_mm_mul_ps(da, xc), rd));
+						_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, old_depth)));
+					}
+					continue;
+				}
+#endif
+				for (int x = x_begin; x <= x_end; x++) {
+					const float xc = float(x) + 0.5f;
+					if (t.edge_a[0] * xc + row_e0 >= 0 && t.edge_a[1] * xc + row_e1 >= 0 && t.edge_a[2] * xc + row_e2 >= 0) {
+						row[x] = std::max(row[x], t.depth_a * xc + row_depth);
+					}
+				}
+			}
+		}
+	}
+	for (int ty = tile_row_begin; ty < tile_row_end; ty++) {
+		for (int tx = 0; tx < tiles_x; tx++) {
+			float farthest = depth[size_t(ty) * OCCLUSION_TILE * width + size_t(tx) * OCCLUSION_TILE];
+			for (int y = 0; y < OCCLUSION_TILE; y++) {
+				const float* row = depth.data() + (size_t(ty) * OCCLUSION_TILE + y) * width + size_t(tx) * OCCLUSION_TILE;
+				farthest = std::min(farthest, *std::min_element(row, row + OCCLUSION_TILE));
+			}
+			tile_depth[size_t(ty) * tiles_x + tx] = farthest;
+		}
+	}
+}
+
+void OcclusionBuffer::render(const InstanceMatrix& view_projection, const Aabb& local, std::span<const InstanceMatrix> occluders) {
+	this->view_projection = view_projection;
+	pool.run([&](int t) {
+		const size_t threads = thread_triangles.size();
+		thread_triangles[t].clear();
+		setupBoxes(local, occluders.subspan(occluders.size() * t / threads, occluders.size() * (t + 1) / threads - occluders.size() * t / threads),
+			thread_triangles[t]);
+	});
+	pool.forRanges(size_t(tiles_y), [&](size_t begin, size_t end, int) {
+		drawRows<true>(int(begin), int(end));
+	});
+}
+
+void OcclusionBuffer::renderScalar(const InstanceMatrix& view_projection, const Aabb& local, std::span<const InstanceMatrix> occluders) {
+	this->view_projection = view_projection;
+	for (auto& triangles : thread_triangles) {
+		triangles.clear();
+	}
+	setupBoxes(local, occluders, thread_triangles[0]);
+	drawRows<false>(0, tiles_y);
+}
+
+bool OcclusionBuffer::screenRect(const Aabb& local, const InstanceMatrix& m, ScreenRect& rect) const {
+	const InstanceMatrix mvp = multiply(m, view_projection);
+	rect = {float(width), float(height), -1, -1, 0};
+	for (int c = 0; c < 8; c++) {
+		ClipVertex v = transform(c & 1 ? local.max.x : local.min.x, c & 2 ? local.max.y : local.min.y, c & 4 ? local.max.z : local.min.z, mvp);
+		if (v.z < 0) {
+			return false;
+		}
+		const float inv_w = 1 / v.w;
+		const float x = (v.x * inv_w + 1) * width * 0.5f, y = (1 - v.y * inv_w) * height * 0.5f;
+		rect.x0 = std::min(rect.x0, x);
+		rect.x1 = std::max(rect.x1, x);
+		rect.y0 = std::min(rect.y0, y);
+		rect.y1 = std::max(rect.y1, y);
+		rect.nearest = std::max(rect.nearest, inv_w);
+	}
+	// Every pixel the rectangle touches and one more around it, empty if it is
+	// off screen. Occluders cover pixels whose center they contain, so a box
+	// showing past the edge of one by less than a pixel only touches covered
+	// pixels, but the pixel next to them is not covered.
+	rect.x0 = std::floor(std::max(rect.x0 - 1, 0.0f));
+	rect.y0 = std::floor(std::max(rect.y0 - 1, 0.0f));
+	rect.x1 = std::floor(std::min(rect.x1 + 1, float(width - 1)));
+	rect.y1 = std::floor(std::min(rect.y1 + 1, float(height - 1)));
+	return rect.x0 <= rect.x1 && rect.y0 <= rect.y1;
+}
+
+bool OcclusionBuffer::occluded(const Aabb& local, const InstanceMatrix& m) const {
+	ScreenRect rect;
+	if (!screenRect(local, m, rect)) {
+		return false;
+	}
+	const int x0 = int(rect.x0), y0 = int(rect.y0), x1 = int(rect.x1), y1 = int(rect.y1);
+	const float limit = rect.nearest * (1 + OCCLUSION_BIAS);
+	for (int ty = y0 / OCCLUSION_TILE; ty <= y1 / OCCLUSION_TILE; ty++) {
+		for (int tx = x0 / OCCLUSION_TILE; tx <= x1 / OCCLUSION_TILE; tx++) {
+			if (tile_depth[size_t(ty) * tiles_x + tx] > limit) {
+				continue;
+			}
+			// Some pixel of the tile is not in front, look at the ones the box touches.
+			for (int y = std::max(y0, ty * OCCLUSION_TILE); y <= std::min(y1, ty * OCCLUSION_TILE + OCCLUSION_TILE - 1); y++) {
+				for (int x = std::max(x0, tx * OCCLUSION_TILE); x <= std::min(x1, tx * OCCLUSION_TILE + OCCLUSION_TILE - 1); x++) {
+					if (depth[size_t(y) * width + x] <= limit) {
+						return false;
+					}
+				}
+			}
+		}
+	}
+	return true;
+}
+
+bool OcclusionBuffer::occludedReference(const Aabb& local, const InstanceMatrix& m) const {
+	ScreenRect rect;
+	if (!screenRect(local, m, rect)) {
+		return false;
+	}
+	const float limit = rect.nearest * (1 + OCCLUSION_BIAS);
+	for (int y = int(rect.y0); y <= int(rect.y1); y++) {
+		for (int x = int(rect.x0); x <= int(rect.x1); x++) {
+			if (depth[size_t(y) * width + x] <= limit) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+size_t OcclusionBuffer::cull(const Aabb& local, std::span<const InstanceMatrix> matrices, InstanceMatrix* out) const {
+	size_t count = 0;
+	for (const InstanceMatrix& m : matrices) {
+		if (!occluded(local, m)) {
+			out[count++] = m;
+		}
+	}
+	return count;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "instances.hpp"
+#include "mazebvh.hpp"
+#include "threadpool.hpp"
+#include <cstddef>
+#include <span>
+#include <vector>
+
+// Software occlusion culling: nearby walls are rasterized as occluders into
+// a small depth buffer on the CPU, then instances whose box is behind it
+// everywhere it covers are dropped before they go into the instance buffer.
+// Like culling.hpp it only needs the matrices calcNewMatrix builds.
+
+constexpr int OCCLUSION_WIDTH = 256;
+constexpr int OCCLUSION_HEIGHT = 144;
+// Tiles keep the farthest depth of their pixels, so most tests never read pixels.
+constexpr int OCCLUSION_TILE = 8;
+
+// Depth buffer of 1 / w, larger is nearer and 0 is empty, which stays linear
+// in screen space and precise far away. Pixels are covered where their
+// center is inside a triangle.
+class OcclusionBuffer {
+	// Edge functions a * x + b * y + c, at least 0 inside, and 1 / w as a
+	// plane over the pixel position, with the pixel bounds of the triangle.
+	struct Triangle {
+		float edge_a[3], edge_b[3], edge_c[3];
+		float depth_a, depth_b, depth_c;
+		int x0, y0, x1, y1;
+	};
+
+	int width, height, tiles_x, tiles_y;
+	ThreadPool pool;
+	InstanceMatrix view_projection = {};
+	std::vector<float> depth;
+	std::vector<float> tile_depth;
+	// Triangles set up by each thread, every thread then draws all of them
+	// into its own rows of tiles.
+	std::vector<std::vector<Triangle>> thread_triangles;
+
+	void setupBoxes(const Aabb& local, std::span<const InstanceMatrix> occluders, std::vector<Triangle>& out) const;
+	template<bool SIMD>
+	void drawRows(int tile_row_begin, int tile_row_end);
+	struct ScreenRect;
+	bool screenRect(const Aabb& local, const InstanceMatrix& m, ScreenRect& rect) const;
+public:
+	// Width and height have to be multiples of OCCLUSION_TILE. thread_count
+	// includes the caller, 0 uses all hardware threads.
+	OcclusionBuffer(int width = OCCLUSION_WIDTH, int height = OCCLUSION_HEIGHT, int thread_count = 1);
+
+	int bufferWidth() const { return width; }
+	int bufferHeight() const { return height; }
+	float depthAt(int x, int y) const { return depth[size_t(y) * width + x]; }
+
+	// Clears the buffer and draws the boxes with bounds local seen through
+	// each occluder matrix, SSE2 where available and split over the threads.
+	void render(const InstanceMatrix& view_projection, const Aabb& local, std::span<const InstanceMatrix> occluders);
+	// Same on the calling thread one pixel at a time, with the same float
+	// operations, so both give the same buffer.
+	void renderScalar(const InstanceMatrix& view_projection, const Aabb& local, std::span<const InstanceMatrix> occluders);
+
+	// True if the box with bounds local drawn with matrix m is behind the
+	// buffer at every pixel it touches and the ones next to them, so boxes
+	// showing past an occluder by part of a pixel stay. Boxes through the near
+	// plane are visible.
+	bool occluded(const Aabb& local, const InstanceMatrix& m) const;
+	// Same without the tiles, pixel by pixel.
+	bool occludedReference(const Aabb& local, const InstanceMatrix& m) const;
+
+	// Copies the matrices of the boxes that are not occluded to out, in order,
+	// and returns how many. out may be matrices itself.
+	size_t cull(const Aabb& local, std::span<const InstanceMatrix> matrices, InstanceMatrix* out) const;
+};
@@ -1,20 +1,186 @@
 #include "physics.hpp"
 #include "mazephysics.hpp"
+#include <algorithm>
 #include <utility>
-#include <cassert>
+#include <cmath>
+#include <vector>
 
 
 float dot(Vector2 v1, Vector2 v2) {
 	return v1.x * v2.x + v1.y * v2.y;
 }
 
-struct NearestSimplex {
-	Vector2 p0, p1;
-	Vector2 direction;
-};
+float cross(Vector2 v1, Vector2 v2) {
+	return v1.x * v2.y - v1.y * v2.x;
+}
+
+namespace {
+	Vector2 support(const Object& p, const Object& q, Vector2 direction) {
+		return p.support(direction) - q.support(-direction);
+	}
+
+	// (a x b) x c, perpendicular to c on the side of a x b.
+	Vector2 tripleProduct(Vector2 a, Vector2 b, Vector2 c) {
+		return b * dot(a, c) - a * dot(b, c);
+	}
+
+	// False for a flat triangle, whose three zero cross products would pass the sign test.
+	bool triangleContainsOrigin(const Vector2* t) {
+		Vector2 ab = t[1] - t[0], ac = t[2] - t[0];
+		if (std::abs(cross(ab, ac)) <= 1e-6f * (ab.abs2() + ac.abs2())) {
+			return false;
+		}
+		float c0 = cross(t[1] - t[0], -t[0]), c1 = cross(t[2] - t[1], -t[1]), c2 = cross(t[0] - t[2], -t[2]);
+		return (c0 >= 0 && c1 >= 0 && c2 >= 0) || (c0 <= 0 && c1 <= 0 && c2 <= 0);
+	}
+
+	void keep(GjkSimplex& s, std::initializer_list<int> indices) {
+		int n = 0;
+		for (int i : indices) {
+			s.points[n] = s.points[i];
+			s.directions[n] = s.directions[i];
+			n++;
+		}
+		s.count = n;
+	}
+
+	// Reduces the simplex to the feature closest to the origin, the newest point
+	// is last. Sets the next search direction, returns true if the origin is enclosed.
+	bool nextSimplex(GjkSimplex& s, Vector2& d) {
+		Vector2 a = s.points[s.count - 1], ao = -a;
+		if (s.count == 1) {
+			d = ao;
+			return ao.abs2() == 0;
+		}
+		if (s.count == 2) {
+			Vector2 ab = s.points[0] - a;
+			if (dot(ab, ao) > 0) {
+				d = tripleProduct(ab, ao, ab);
+				// The origin is on the segment.
+				return d.abs2() == 0;
+			}
+			keep(s, {1});
+			d = ao;
+			return false;
+		}
+		Vector2 ab = s.points[1] - a, ac = s.points[0] - a;
+		Vector2 ab_perp = tripleProduct(ac, ab, ab), ac_perp = tripleProduct(ab, ac, ac);
+		if (dot(ab_perp, ao) > 0) {
+			keep(s, {1, 2});
+			d = ab_perp;
+			return false;
+		}
+		if (dot(ac_perp, ao) > 0) {
+			keep(s, {0, 2});
+			d = ac_perp;
+			return false;
+		}
+		return true;
+	}
+}
+
+bool gjkIntersects(const Object& p, const Object& q, GjkSimplex& s) {
+	s.iterations = 0;
+	if (s.count == 3) {
+		for (int i = 0; i < 3; i++) {
+			s.points[i] = support(p, q, s.directions[i]);
+		}
+		s.iterations = 1;
+		if (triangleContainsOrigin(s.points)) {
+			return true;
+		}
+	}
+
+	Vector2 d = s.direction.abs2() > 0 ? s.direction : Vector2{1, 0};
+	s.count = 0;
+	while (s.iterations < GJK_MAX_ITERATIONS) {
+		s.iterations++;
+		Vector2 a = support(p, q, d);
+		if (dot(a, d) < 0) {
+			s.direction = d;
+			return false;
+		}
+		s.points[s.count] = a;
+		s.directions[s.count] = d;
+		s.count++;
+		if (nextSimplex(s, d)) {
+			s.direction = d;
+			return true;
+		}
+	}
+	// No progress within the limit, the origin is on the boundary up to rounding.
+	// Report no intersection rather than a hit the loop could not confirm.
+	s.direction = d;
+	return false;
+}
+
+Penetration epaPenetration(const Object& p, const Object& q, const GjkSimplex& simplex) {
+	// GJK stops early on a point or segment through the origin, and rounding
+	// can leave a flat triangle. Reduce to distinct points, then grow a triangle.
+	std::vector<Vector2> polytope;
+	for (int i = 0; i < simplex.count; i++) {
+		if (std::none_of(polytope.begin(), polytope.end(), [&](Vector2 v) { return (v - simplex.points[i]).abs2() == 0; })) {
+			polytope.push_back(simplex.points[i]);
+		}
+	}
+	if (polytope.size() == 3 && cross(polytope[1] - polytope[0], polytope[2] - polytope[0]) == 0) {
+		// Keep the two ends of the flat triangle.
+		size_t middle = 0;
+		for (size_t i = 0; i < 3; i++) {
+			if (dot(polytope[(i + 1) % 3] - polytope[i], polytope[(i + 2) % 3] - polytope[i]) < 0) {
+				middle = i;
+			}
+		}
+		polytope.erase(polytope.begin() + middle);
+	}
+	if (polytope.size() == 1) {
+		Vector2 a = support(p, q, {1, 0});
+		polytope.push_back((a - polytope[0]).abs2() > 0 ? a : support(p, q, {-1, 0}));
+	}
+	Vector2 side = (polytope[1] - polytope[0]).rot90();
+	if (polytope.size() == 2) {
+		Vector2 a = support(p, q, side);
+		polytope.push_back(cross(polytope[1] - polytope[0], a - polytope[0]) != 0 ? a : support(p, q, -side));
+	}
+	if (cross(polytope[1] - polytope[0], polytope[2] - polytope[0]) == 0) {
+		// The difference is flat, the objects only touch.
+		return {side.abs2() > 0 ? side.normUnit() : Vector2{1, 0}, 0};
+	}
+	if (cross(polytope[1] - polytope[0], polytope[2] - polytope[0]) < 0) {
+		std::swap(polytope[1], polytope[2]);
+	}
+
+	Penetration best = {{1, 0}, 0};
+	for (int iteration = 0; iteration < EPA_MAX_ITERATIONS; iteration++) {
+		size_t closest = 0;
+		best.depth = INFINITY;
+		for (size_t i = 0; i < polytope.size(); i++) {
+			Vector2 edge = polytope[(i + 1) % polytope.size()] - polytope[i];
+			if (edge.abs2() == 0) {
+				continue;
+			}
+			// Outward normal of a counter-clockwise polygon.
+			Vector2 n = edge.rot270().normUnit();
+			float distance = dot(n, polytope[i]);
+			if (distance < best.depth) {
+				best = {n, distance};
+				closest = i;
+			}
+		}
+		Vector2 s = support(p, q, best.normal);
+		if (dot(s, best.normal) - best.depth < 1e-5f) {
+			break;
+		}
+		polytope.insert(polytope.begin() + closest + 1, s);
+	}
+	return best;
+}
 
 bool collides(const Object& p, const Object& q) {
-	assert(q.type() == ObjectType::Hex);
+	if (q.type() != ObjectType::Hex || (p.type() != ObjectType::Hex && p.type() != ObjectType::Rect)) {
+		GjkSimplex simplex;
+		return gjkIntersects(p, q, simplex);
+	}
 	const HexObj& qh = dynamic_cast<const HexObj&>(q);
 
 	if (p.type() == ObjectType::Hex) {
@@ -53,15 +219,106 @@ bool collides(const Object& p, const Object& q) {
 }
 
 
-void ObjectHandler::addObject(Object* obj) {
-	objects.push_back(obj);
+namespace {
+	// Disks covering the object, a hex as its circumscribed circle.
+	template<typename F>
+	void coveringDisks(const Object& obj, float step, F f) {
+		if (obj.type() == ObjectType::Hex) {
+			const HexObj& h = dynamic_cast<const HexObj&>(obj);
+			f(h.t.translation, h.width);
+			return;
+		}
+		const RectangleObj& r = dynamic_cast<const RectangleObj&>(obj);
+		rectangleDisks(r.t.translation, r.half_axis, r.length, r.width, step, f);
+	}
+}
+
+const ObjectHandler::Slot* ObjectHandler::slot(ObjectHandle h) const {
+	if (h.index >= slots.size() || slots[h.index].generation != h.generation || !slots[h.index].object) {
+		return nullptr;
+	}
+	return &slots[h.index];
+}
+
+void ObjectHandler::place(uint32_t i) {
+	index.place(i, [&](auto f) { coveringDisks(*slots[i].object, index.cellStep(), f); });
+}
+
+ObjectHandle ObjectHandler::addObject(Object* obj) {
+	uint32_t i;
+	if (!free_slots.empty()) {
+		i = free_slots.back();
+		free_slots.pop_back();
+	}
+	else {
+		i = uint32_t(slots.size());
+		slots.emplace_back();
+	}
+	slots[i].object = obj;
+	if (index.built()) {
+		// Grow the hash with the objects, the rehash is amortized over the adds.
+		if (slots.size() * 2 > index.bucketCount()) {
+			buildIndex(index_length, index_width);
+		}
+		else {
+			place(i);
+		}
+	}
+	return {i, slots[i].generation};
+}
+
+bool ObjectHandler::removeObject(ObjectHandle h) {
+	if (!slot(h)) {
+		return false;
+	}
+	index.remove(h.index);
+	slots[h.index].object = nullptr;
+	slots[h.index].generation++;
+	free_slots.push_back(h.index);
+	return true;
+}
+
+bool ObjectHandler::updateObject(ObjectHandle h) {
+	if (!slot(h)) {
+		return false;
+	}
+	if (index.built()) {
+		place(h.index);
+	}
+	return true;
+}
+
+Object* ObjectHandler::get(ObjectHandle h) const {
+	const Slot* s = slot(h);
+	return s ? s->object : nullptr;
+}
+
+void ObjectHandler::buildIndex(float length, float width) {
+	index_length = length;
+	index_width = width;
+	index.reset(length, width, slots.size() * 4);
+	for (uint32_t i = 0; i < slots.size(); i++) {
+		if (slots[i].object) {
+			place(i);
+		}
+	}
 }
 
 bool ObjectHandler::collidesWith(const Object& obj) const {
-	for (const auto& o: objects) {
-		if (collides(*o, obj)) {
-			return true;
+	if (!index.built()) {
+		for (const Slot& s : slots) {
+			if (s.object && collides(*s.object, obj)) {
+				return true;
+			}
 		}
+		return false;
 	}
-	return false;
+
+	bool hit = false;
+	coveringDisks(obj, index.cellStep(), [&](Vector2 center, float radius) {
+		hit = hit || index.any(center, radius, [&](uint32_t i) {
+			return collides(*slots[i].object, obj);
+		});
+	});
+	return hit;
 }
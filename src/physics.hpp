@@ -1,6 +1,10 @@
 #pragma once
 
 #include "base.hpp"
+#include "spatialhash.hpp"
+#include <cmath>
+#include <cstdint>
+#include <span>
 #include <vector>
 
 enum class ObjectType {
@@ -9,16 +13,91 @@ enum class ObjectType {
 
 struct Object {
 	virtual ObjectType type() const = 0;
-	virtual Vector2 supportFunction(float angle) const = 0;
+	// Point of the object furthest along direction, which does not have to be normalized.
+	virtual Vector2 support(Vector2 direction) const = 0;
+	// support() for every direction with a single virtual call, the maze
+	// shapes work on four directions at a time where SSE2 is available.
+	virtual void supportBatch(std::span<const Vector2> directions, Vector2* out) const = 0;
+
+	Vector2 supportFunction(float angle) const {
+		return support({std::cos(angle), std::sin(angle)});
+	}
+
+protected:
+	// Never deleted through, so the shapes stay trivially destructible for ObjectPool.
+	~Object() = default;
 };
 
+float dot(Vector2 v1, Vector2 v2);
+float cross(Vector2 v1, Vector2 v2);
+
+// Hexes against hexes and walls against hexes are tested analytically, with
+// the hex as a circle. Every other pair goes through GJK.
 bool collides(const Object&, const Object&);
 
+constexpr int GJK_MAX_ITERATIONS = 32;
+constexpr int EPA_MAX_ITERATIONS = 32;
+
+// Simplex of the Minkowski difference p - q. Keep one per pair of objects
+// between frames: the next query re-evaluates the support functions in the
+// stored directions, so a pair that barely moved is decided in one iteration.
+struct GjkSimplex {
+	Vector2 points[3];
+	Vector2 directions[3];
+	int count = 0;
+	// Last search direction, a separating axis if the objects did not intersect.
+	Vector2 direction = {1, 0};
+	// Support evaluations the last query needed.
+	int iterations = 0;
+};
+
+// Touching counts as intersecting. A query that runs out of iterations, with
+// the origin on the boundary up to rounding, reports no intersection.
+bool gjkIntersects(const Object& p, const Object& q, GjkSimplex& simplex);
+
+struct Penetration {
+	// Points from p towards q, moving p by -normal * depth separates the objects.
+	Vector2 normal;
+	float depth;
+};
+
+// EPA on the simplex of a gjkIntersects query that returned true.
+Penetration epaPenetration(const Object& p, const Object& q, const GjkSimplex& simplex);
+
+// Refers to an object added to an ObjectHandler. The generation makes handles
+// of removed objects stale, even after their slot is reused.
+struct ObjectHandle {
+	uint32_t index = UINT32_MAX;
+	uint32_t generation = 0;
+};
+
+// Tracks objects it does not own, see ObjectPool for allocating them.
 class ObjectHandler {
-	std::vector<Object*> objects;
+	struct Slot {
+		Object* object = nullptr;
+		uint32_t generation = 0;
+	};
+	std::vector<Slot> slots;
+	std::vector<uint32_t> free_slots;
+	SpatialHash index;
+	float index_length = 0, index_width = 0;
+
+	const Slot* slot(ObjectHandle h) const;
+	void place(uint32_t i);
 public:
-	void addObject(Object*);
+	ObjectHandle addObject(Object*);
+	// Stops tracking the object, returns false for a stale handle.
+	bool removeObject(ObjectHandle);
+	// Call after moving or resizing the object to refresh its cells, costs
+	// O(1) for an object of bounded size. Returns false for a stale handle.
+	bool updateObject(ObjectHandle);
+	// nullptr for a stale handle.
+	Object* get(ObjectHandle) const;
+	size_t size() const { return slots.size() - free_slots.size(); }
+
+	// Hashes the objects by the lattice of a maze with walls of this size, after
+	// which collidesWith only tests objects in the query's cells. Objects added,
+	// moved or removed later keep the index up to date.
+	void buildIndex(float length, float width);
 	bool collidesWith(const Object&) const;
 };
-
-
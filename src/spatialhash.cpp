@@ -0,0 +1,23 @@
+#include "spatialhash.hpp"
+
+#include <bit>
+
+void SpatialHash::reset(float length, float width, size_t bucket_count) {
+	step = length + width * sqrtf(3);
+	buckets.assign(std::bit_ceil(std::max<size_t>(bucket_count, 1)), {});
+	mask = uint32_t(buckets.size() - 1);
+	item_slots.clear();
+}
+
+void SpatialHash::unlink(uint32_t item) {
+	std::vector<Slot>& slots = item_slots[item];
+	for (const Slot& s : slots) {
+		// Swap-remove, the entry moved into the hole gets its new position.
+		std::vector<Entry>& bucket = buckets[s.bucket];
+		Entry last = bucket.back();
+		bucket[s.position] = last;
+		item_slots[last.item][last.slot].position = s.position;
+		bucket.pop_back();
+	}
+	slots.clear();
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "latticeindex.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// Items bucketed by the lattice cells of latticeRange, with the cells hashed
+// into a power of two number of buckets. Unlike LatticeIndex, items are placed,
+// moved and removed one at a time: every item keeps the list of its bucket
+// slots, so moving it only touches its own buckets.
+class SpatialHash {
+	struct Entry {
+		uint32_t item;
+		// Index of this entry in the slot list of the item.
+		uint32_t slot;
+	};
+	struct Slot {
+		uint32_t bucket;
+		uint32_t position;
+	};
+
+	float step = 0;
+	uint32_t mask = 0;
+	std::vector<std::vector<Entry>> buckets;
+	std::vector<std::vector<Slot>> item_slots;
+	std::vector<uint32_t> scratch;
+
+	uint32_t bucketOf(int x, int y) const {
+		return (uint32_t(x) * 73856093u ^ uint32_t(y) * 19349663u) & mask;
+	}
+	void unlink(uint32_t item);
+public:
+	bool built() const { return step != 0; }
+	size_t bucketCount() const { return buckets.size(); }
+	// Side of the lattice cells, as in LatticeIndex.
+	float cellStep() const { return step; }
+	// Empties the hash for a maze with walls of this size, bucket_count is rounded up to a power of two.
+	void reset(float length, float width, size_t bucket_count);
+
+	// disks(f) calls f(center, radius) for the covering disks of the item. Replaces
+	// the cells of the item, and returns early if its buckets did not change.
+	template<typename Disks>
+	void place(uint32_t item, Disks disks) {
+		scratch.clear();
+		disks([&](Vector2 center, float radius) {
+			LatticeRange r = latticeRange(center, radius, step);
+			for (int y = r.y0; y <= r.y1; y++) {
+				for (int x = r.x0; x <= r.x1; x++) {
+					scratch.push_back(bucketOf(x, y));
+				}
+			}
+		});
+		std::sort(scratch.begin(), scratch.end());
+		scratch.erase(std::unique(scratch.begin(), scratch.end()), scratch.end());
+
+		if (item >= item_slots.size()) {
+			item_slots.resize(size_t(item) + 1);
+		}
+		std::vector<Slot>& slots = item_slots[item];
+		if (std::equal(slots.begin(), slots.end(), scratch.begin(), scratch.end(),
+			[](const Slot& s, uint32_t bucket) { return s.bucket == bucket; })) {
+			return;
+		}
+		unlink(item);
+		for (uint32_t bucket : scratch) {
+			slots.push_back({bucket, uint32_t(buckets[bucket].size())});
+			buckets[bucket].push_back({item, uint32_t(slots.size() - 1)});
+		}
+	}
+
+	void remove(uint32_t item) {
+		if (item < item_slots.size()) {
+			unlink(item);
+		}
+	}
+
+	// Calls f(item) for the items in the buckets of the cells under the square
+	// around center, stops and returns true as soon as f does. Items sharing a
+	// bucket with those cells are passed too, and some may be passed twice.
+	template<typename F>
+	bool any(Vector2 center, float radius, F f) const {
+		LatticeRange r = latticeRange(center, radius, step);
+		for (int y = r.y0; y <= r.y1; y++) {
+			for (int x = r.x0; x <= r.x1; x++) {
+				for (const Entry& e : buckets[bucketOf(x, y)]) {
+					if (f(e.item)) {
+						return true;
+					}
+				}
+			}
+		}
+		return false;
+	}
+};
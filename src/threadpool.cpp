@@ -0,0 +1,53 @@
+#include "threadpool.hpp"
+
+ThreadPool::ThreadPool(int thread_count) {
+	for (int t = 1; t < thread_count; t++) {
+		workers.emplace_back([this, t]() { work(t); });
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard lock(mutex);
+		stopping = true;
+	}
+	start.notify_all();
+	for (auto& w : workers) {
+		w.join();
+	}
+}
+
+void ThreadPool::work(int index) {
+	size_t seen = 0;
+	while (true) {
+		const std::function<void(int)>* f;
+		{
+			std::unique_lock lock(mutex);
+			start.wait(lock, [&]() { return stopping || generation != seen; });
+			if (stopping) {
+				return;
+			}
+			seen = generation;
+			f = job;
+		}
+		(*f)(index);
+		{
+			std::lock_guard lock(mutex);
+			running--;
+		}
+		done.notify_one();
+	}
+}
+
+void ThreadPool::run(const std::function<void(int)>& f) {
+	{
+		std::lock_guard lock(mutex);
+		job = &f;
+		running = int(workers.size());
+		generation++;
+	}
+	start.notify_all();
+	f(0);
+	std::unique_lock lock(mutex);
+	done.wait(lock, [&]() { return running == 0; });
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Workers kept alive between jobs, for work that runs every tick where
+// starting threads like parallelFor does would cost more than the job.
+class ThreadPool {
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable start, done;
+	const std::function<void(int)>* job = nullptr;
+	size_t generation = 0;
+	int running = 0;
+	bool stopping = false;
+
+	void work(int index);
+public:
+	// thread_count includes the calling thread, which takes part in run().
+	explicit ThreadPool(int thread_count);
+	~ThreadPool();
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	int threadCount() const { return int(workers.size()) + 1; }
+
+	// Calls f(thread) once on every thread, thread 0 being the caller, and
+	// returns when all calls are done.
+	void run(const std::function<void(int)>& f);
+
+	// Calls f(begin, end, thread) for threadCount() contiguous ranges of [0, count).
+	// Thread t always gets the same range, so results do not depend on timing.
+	template<typename F>
+	void forRanges(size_t count, F f) {
+		const size_t threads = size_t(threadCount());
+		run([&](int t) {
+			size_t begin = count * t / threads, end = count * (t + 1) / threads;
+			if (begin < end) {
+				f(begin, end, t);
+			}
+		});
+	}
+};